@@ -16,6 +16,7 @@
 #define CONFIG_STREAM_USART1
 #define CONFIG_STREAM_USART4
 #define CONFIG_STREAM_USB
+#define CONFIG_STREAM_USB_DOUBLE_BUFFER
 
 /* the UART console is on USART2 (PA14/PA15) */
 #undef CONFIG_UART_CONSOLE
@@ -29,6 +30,7 @@
 #define CONFIG_USB
 #define CONFIG_USB_PID 0x500f
 #define CONFIG_USB_CONSOLE
+#define CONFIG_USB_CONSOLE_DOUBLE_BUFFER
 
 /* USB interface indexes (use define rather than enum to expand them) */
 #define USB_IFACE_STREAM  0
@@ -54,6 +56,7 @@
 
 
 #define CONFIG_USB_SPI
+#define CONFIG_USB_SPI_PIPELINE
 
 #undef CONFIG_WATCHDOG_HELP
 #undef CONFIG_LID_SWITCH
@@ -30,15 +30,7 @@ int fan_get_enabled(int ch)
 	return mock_enabled;
 }
 
-static int mock_percent;
-void fan_set_duty(int ch, int percent)
-{
-	mock_percent = percent;
-}
-int fan_get_duty(int ch)
-{
-	return mock_percent;
-}
+int mock_rpm;
 
 static int mock_rpm_mode;
 void fan_set_rpm_mode(int ch, int rpm_mode)
@@ -50,7 +42,23 @@ int fan_get_rpm_mode(int ch)
 	return mock_rpm_mode;
 }
 
-int mock_rpm;
+/* Set to make the fan stop turning, whatever the duty cycle */
+int mock_stuck;
+
+static int mock_percent;
+void fan_set_duty(int ch, int percent)
+{
+	mock_percent = percent;
+
+	/* Without RPM mode, act like a fan whose speed follows its duty */
+	if (!mock_rpm_mode)
+		mock_rpm = mock_stuck ? 0 : percent * fans[ch].rpm_max / 100;
+}
+int fan_get_duty(int ch)
+{
+	return mock_percent;
+}
+
 void fan_set_rpm_target(int ch, int rpm)
 {
 	mock_rpm = rpm;
@@ -165,6 +165,37 @@ int i2c_write8(int port, int slave_addr, int offset, int data)
 	return EC_ERROR_UNKNOWN;
 }
 
+/*
+ * The test devices only model register accesses, so a raw transfer is taken
+ * as a register address followed by data for consecutive registers, as
+ * auto-incrementing devices do.  Whatever is written goes out as 8-bit
+ * writes, and anything read comes from 8-bit reads.
+ */
+int i2c_xfer(int port, int slave_addr, const uint8_t *out, int out_size,
+	     uint8_t *in, int in_size, int flags)
+{
+	int i, data;
+	int rv = EC_SUCCESS;
+
+	if (out_size < 1)
+		return EC_ERROR_INVAL;
+
+	for (i = 1; i < out_size && rv == EC_SUCCESS; i++)
+		rv = i2c_write8(port, slave_addr, out[0] + i - 1, out[i]);
+
+	for (i = 0; i < in_size && rv == EC_SUCCESS; i++) {
+		rv = i2c_read8(port, slave_addr, out[0] + i, &data);
+		in[i] = data;
+	}
+
+	return rv;
+}
+
+void i2c_lock(int port, int lock)
+{
+	/* The emulator has no other bus masters to lock out */
+}
+
 int i2c_read_string(int port, int slave_addr, int offset, uint8_t *data,
 			int len)
 {
@@ -5,19 +5,35 @@
 
 /* Persistence module for emulator */
 
-#include <unistd.h>
+#include <libgen.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define BUF_SIZE 1024
 
 static void get_storage_path(char *out)
 {
 	char buf[BUF_SIZE];
+	const char *dir = getenv("EC_PERSIST_DIR");
 	int sz;
 
-	sz = readlink("/proc/self/exe", buf, BUF_SIZE);
+	sz = readlink("/proc/self/exe", buf, BUF_SIZE - 1);
 	buf[sz] = '\0';
+
+	/*
+	 * Storage normally lives next to the executable. A test runner can
+	 * point it somewhere else, so that several copies of one test can run
+	 * at the same time without sharing state.
+	 */
+	if (dir && *dir) {
+		if (snprintf(out, BUF_SIZE, "%s/%s_persist", dir,
+			     basename(buf)) >= BUF_SIZE)
+			out[BUF_SIZE - 1] = '\0';
+		return;
+	}
+
 	if (snprintf(out, BUF_SIZE, "%s_persist", buf) >= BUF_SIZE)
 		out[BUF_SIZE - 1] = '\0';
 }
@@ -17,10 +17,15 @@
 #include "util.h"
 
 #define SHARED_MEM_SIZE 512 /* bytes */
-uint8_t __shared_mem_buf[SHARED_MEM_SIZE];
-
 #define RAM_DATA_SIZE (sizeof(struct panic_data) + 512) /* bytes */
-static char __ram_data[RAM_DATA_SIZE];
+
+/*
+ * As on a real EC, RAM data (jump data and tags, then panic data) directly
+ * follows the shared memory buffer, which may use whatever the jump tags
+ * don't.
+ */
+uint8_t __shared_mem_buf[SHARED_MEM_SIZE + RAM_DATA_SIZE];
+static char * const __ram_data = (char *)__shared_mem_buf + SHARED_MEM_SIZE;
 
 static enum system_image_copy_t __running_copy;
 
@@ -31,7 +36,7 @@ static void ramdata_set_persistent(void)
 
 	ASSERT(f != NULL);
 
-	sz = fwrite(__ram_data, sizeof(__ram_data), 1, f);
+	sz = fwrite(__ram_data, RAM_DATA_SIZE, 1, f);
 	ASSERT(sz == 1);
 
 	release_persistent_storage(f);
@@ -44,11 +49,11 @@ static void ramdata_get_persistent(void)
 	if (f == NULL) {
 		fprintf(stderr,
 			"No RAM data found. Initializing to 0x00.\n");
-		memset(__ram_data, 0, sizeof(__ram_data));
+		memset(__ram_data, 0, RAM_DATA_SIZE);
 		return;
 	}
 
-	fread(__ram_data, sizeof(__ram_data), 1, f);
+	fread(__ram_data, RAM_DATA_SIZE, 1, f);
 
 	release_persistent_storage(f);
 
@@ -106,6 +106,20 @@
 	EC_PROTO2_RESPONSE_TRAILER_BYTES + 1)
 #define SHI_PROTO3_OVERHEAD (EC_SPI_PAST_END_LENGTH + EC_SPI_FRAME_START_LENGTH)
 
+/*
+ * SHI events we want interrupts for. The half/full input buffer events are
+ * only needed while data has to move between the msg buffers and the SHI
+ * buffers; they are masked while the EC is processing a request (the AP is
+ * just clocking out EC_SPI_PROCESSING bytes) and once the whole response has
+ * been written to the output buffer.
+ */
+#define SHI_EVENABLE_BUF_MASK  ((1 << NPCX_EVENABLE_IBHFEN) |	\
+				(1 << NPCX_EVENABLE_IBFEN))
+#define SHI_EVSTAT_BUF_MASK    ((1 << NPCX_EVSTAT_IBHF) |	\
+				(1 << NPCX_EVSTAT_IBF))
+#define SHI_EVENABLE_DEFAULT   ((1 << NPCX_EVENABLE_EOREN) |	\
+				SHI_EVENABLE_BUF_MASK)
+
 /*
  * Our input and output msg buffers. These must be large enough for our largest
  * message, including protocol overhead, and must be 32-bit aligned.
@@ -157,6 +171,7 @@ static void shi_error(int need_reset);
 static void shi_fill_out_status(uint8_t status);
 static void shi_write_half_outbuf(void);
 static void shi_write_outbuf_wait(uint16_t szbytes);
+static void shi_buf_events_enable(int enable);
 static int shi_read_inbuf_wait(uint16_t szbytes);
 
 /*****************************************************************************/
@@ -227,6 +242,9 @@ static void shi_reply_response(enum ec_status status, uint8_t *msg_ptr,
 		CPRINTF("SND-");
 		/* Start to fill output buffer with msg buffer */
 		shi_write_outbuf_wait(shi_params.sz_response);
+		/* Only need buffer events if the response didn't fit */
+		if (shi_params.sz_sending < shi_params.sz_response)
+			shi_buf_events_enable(1);
 		/* Enable SHI interrupt */
 		task_enable_irq(NPCX_IRQ_SHI);
 	}
@@ -275,6 +293,8 @@ void shi_handle_host_command(void)
 		/* Move to processing state immediately */
 		state = SHI_STATE_PROCESSING;
 		CPRINTF("PRC-");
+		/* Nothing to move while the host command is running */
+		shi_buf_events_enable(0);
 		/* Read remaining bytes from input buffer directly */
 		if (!shi_read_inbuf_wait(remain_bytes))
 			return shi_error(1);
@@ -330,6 +350,9 @@ static void shi_send_response_packet(struct host_packet *pkt)
 		CPRINTF("SND-");
 		/* Start to fill output buffer with msg buffer */
 		shi_write_outbuf_wait(shi_params.sz_response);
+		/* Only need buffer events if the response didn't fit */
+		if (shi_params.sz_sending < shi_params.sz_response)
+			shi_buf_events_enable(1);
 		/* Enable SHI interrupt */
 		task_enable_irq(NPCX_IRQ_SHI);
 	}
@@ -358,6 +381,8 @@ void shi_handle_host_package(void)
 		/* Move to processing state immediately */
 		state = SHI_STATE_PROCESSING;
 		CPRINTF("PRC-");
+		/* Nothing to move while the host command is running */
+		shi_buf_events_enable(0);
 		/* Read remaining bytes from input buffer directly */
 		if (!shi_read_inbuf_wait(remain_bytes))
 			return shi_error(1);
@@ -457,17 +482,51 @@ static void shi_fill_out_status(uint8_t status)
 		NPCX_OBUF(i) = status;
 }
 
+/*
+ * This routine enables or disables the half/full input buffer events. Events
+ * latched while they were masked are left alone; shi_write_outbuf_wait()
+ * drops the stale ones before it fills the output buffer, so anything still
+ * pending here happened during the fill and needs its refill.
+ */
+static void shi_buf_events_enable(int enable)
+{
+	if (enable) {
+		NPCX_EVENABLE |= SHI_EVENABLE_BUF_MASK;
+	} else {
+		NPCX_EVENABLE &= ~SHI_EVENABLE_BUF_MASK;
+	}
+}
+
+/*
+ * This routine copies a run of bytes from msg buffer to SHI output buffer
+ */
+static void shi_copy_outbuf(uint16_t size)
+{
+	volatile uint8_t *dst = shi_params.tx_buf;
+	const uint8_t *src = shi_params.tx_msg;
+	const uint8_t *end = src + size;
+
+	while (src < end)
+		*dst++ = *src++;
+
+	shi_params.tx_buf = dst;
+	shi_params.tx_msg += size;
+	shi_params.sz_sending += size;
+}
+
 /*
  * This routine write SHI next half output buffer from msg buffer
  */
 static void shi_write_half_outbuf(void)
 {
-	uint16_t i;
 	uint16_t size = MIN(SHI_OBUF_HALF_SIZE,
 			shi_params.sz_response - shi_params.sz_sending);
 	/* Fill half output buffer */
-	for (i = 0; i < size; i++, shi_params.sz_sending++)
-		*(shi_params.tx_buf++) = *(shi_params.tx_msg++);
+	shi_copy_outbuf(size);
+
+	/* Whole response is in the output buffer; stop refill interrupts */
+	if (shi_params.sz_sending == shi_params.sz_response)
+		shi_buf_events_enable(0);
 }
 
 /*
@@ -476,16 +535,21 @@ static void shi_write_half_outbuf(void)
  */
 static void shi_write_outbuf_wait(uint16_t szbytes)
 {
-	uint16_t i;
-	static uint16_t offset, size;
+	uint16_t offset, size;
+
+	/*
+	 * Drop half/full events latched while processing before taking the
+	 * output pointer; the fill below starts from there anyway.
+	 */
+	NPCX_EVSTAT = SHI_EVSTAT_BUF_MASK;
+
 	offset = SHI_OBUF_VALID_OFFSET;
 	shi_params.tx_buf = SHI_OBUF_START_ADDR + offset;
 
 	/* Fill half output buffer */
 	size = MIN(SHI_OBUF_HALF_SIZE - (offset % SHI_OBUF_HALF_SIZE),
 					szbytes - shi_params.sz_sending);
-	for (i = 0; i < size; i++, shi_params.sz_sending++)
-		*(shi_params.tx_buf++) = *(shi_params.tx_msg++);
+	shi_copy_outbuf(size);
 
 	/* Write data from bottom address again */
 	if (shi_params.tx_buf == SHI_OBUF_FULL_ADDR)
@@ -493,8 +557,7 @@ static void shi_write_outbuf_wait(uint16_t szbytes)
 
 	/* Fill next half output buffer */
 	size = MIN(SHI_OBUF_HALF_SIZE, szbytes - shi_params.sz_sending);
-	for (i = 0; i < size; i++, shi_params.sz_sending++)
-		*(shi_params.tx_buf++) = *(shi_params.tx_msg++);
+	shi_copy_outbuf(size);
 }
 
 /* This routine copies SHI half input buffer data to msg buffer */
@@ -753,6 +816,9 @@ static void shi_reset_prepare(void)
 		NPCX_OBUF(i) = EC_SPI_RECEIVING;
 	NPCX_OBUF(0) = EC_SPI_OLD_READY;
 
+	/* Restore buffer events masked during the previous transaction */
+	NPCX_EVENABLE = SHI_EVENABLE_DEFAULT;
+
 	/* Enable SHI & WEN functionality */
 	NPCX_SHICFG1 = 0x85;
 
@@ -822,7 +888,7 @@ static void shi_init(void)
 	 * [1] - OBHEEN = 0: Output Buffer Half Empty Interrupt Enable
 	 * [0] - OBEEN  = 0: Output Buffer Empty Interrupt Enable
 	 */
-	NPCX_EVENABLE = 0x1C;
+	NPCX_EVENABLE = SHI_EVENABLE_DEFAULT;
 
 	/* Clear SHI events status register */
 	NPCX_EVSTAT = 0XFF;
@@ -18,11 +18,6 @@
 
 struct mutex adc_lock;
 
-static const struct dma_option dma_adc_option = {
-	STM32_DMAC_ADC, (void *)&STM32_ADC_DR,
-	STM32_DMA_CCR_MSIZE_32_BIT | STM32_DMA_CCR_PSIZE_32_BIT,
-};
-
 static void adc_configure(int ain_id)
 {
 	/* Select channel to convert */
@@ -32,39 +27,11 @@ static void adc_configure(int ain_id)
 	STM32_ADC_CFGR1 &= ~0x1;
 }
 
-#ifdef CONFIG_ADC_WATCHDOG
-
-static int watchdog_ain_id;
-static int watchdog_delay_ms;
+#if defined(CONFIG_ADC_WATCHDOG) || defined(CONFIG_ADC_SCAN)
 
-static void adc_continuous_read(int ain_id)
+/* Convert the selected channels every interval_ms, triggered by TIM_ADC */
+static void adc_timer_start(int interval_ms)
 {
-	adc_configure(ain_id);
-
-	/* CONT=1 -> continuous mode on */
-	STM32_ADC_CFGR1 |= 1 << 13;
-
-	/* Start continuous conversion */
-	STM32_ADC_CR |= 1 << 2; /* ADSTART */
-}
-
-static void adc_continuous_stop(void)
-{
-	/* Stop on-going conversion */
-	STM32_ADC_CR |= 1 << 4; /* ADSTP */
-
-	/* Wait for conversion to stop */
-	while (STM32_ADC_CR & (1 << 4))
-		;
-
-	/* CONT=0 -> continuous mode off */
-	STM32_ADC_CFGR1 &= ~(1 << 13);
-}
-
-static void adc_interval_read(int ain_id, int interval_ms)
-{
-	adc_configure(ain_id);
-
 	/* EXTEN=01 -> hardware trigger detection on rising edge */
 	STM32_ADC_CFGR1 = (STM32_ADC_CFGR1 & ~0xc00) | (1 << 10);
 
@@ -93,7 +60,7 @@ static void adc_interval_read(int ain_id, int interval_ms)
 	STM32_ADC_CR |= 1 << 2; /* ADSTART */
 }
 
-static void adc_interval_stop(void)
+static void adc_timer_stop(void)
 {
 	/* EXTEN=00 -> hardware trigger detection disabled */
 	STM32_ADC_CFGR1 &= ~0xc00;
@@ -109,6 +76,48 @@ static void adc_interval_stop(void)
 	STM32_TIM_CR1(TIM_ADC) &= ~0x1;
 }
 
+#endif
+
+#ifdef CONFIG_ADC_WATCHDOG
+
+static int watchdog_ain_id;
+static int watchdog_delay_ms;
+
+static void adc_continuous_read(int ain_id)
+{
+	adc_configure(ain_id);
+
+	/* CONT=1 -> continuous mode on */
+	STM32_ADC_CFGR1 |= 1 << 13;
+
+	/* Start continuous conversion */
+	STM32_ADC_CR |= 1 << 2; /* ADSTART */
+}
+
+static void adc_continuous_stop(void)
+{
+	/* Stop on-going conversion */
+	STM32_ADC_CR |= 1 << 4; /* ADSTP */
+
+	/* Wait for conversion to stop */
+	while (STM32_ADC_CR & (1 << 4))
+		;
+
+	/* CONT=0 -> continuous mode off */
+	STM32_ADC_CFGR1 &= ~(1 << 13);
+}
+
+static void adc_interval_read(int ain_id, int interval_ms)
+{
+	adc_configure(ain_id);
+	adc_timer_start(interval_ms);
+}
+
+static void adc_interval_stop(void)
+{
+	adc_timer_stop();
+}
+
 static int adc_watchdog_enabled(void)
 {
 	return STM32_ADC_CFGR1 & (1 << 23);
@@ -203,6 +212,116 @@ static int adc_disable_watchdog_no_lock(void) { return 0; }
 
 #endif /* CONFIG_ADC_WATCHDOG */
 
+#ifdef CONFIG_ADC_SCAN
+
+#ifdef CONFIG_ADC_WATCHDOG
+#error "CONFIG_ADC_SCAN needs the ADC to itself; undef CONFIG_ADC_WATCHDOG"
+#endif
+
+/*
+ * The last CONFIG_ADC_SCAN_OVERSAMPLE scans, oldest overwritten first.  Each
+ * scan holds scan_channels samples, in ascending AIN order.
+ */
+static uint16_t scan_ring[CONFIG_ADC_SCAN_OVERSAMPLE * ADC_CH_COUNT];
+static int scan_channels;
+
+/* Where each entry of adc_channels[] falls within a scan */
+static uint8_t scan_index[ADC_CH_COUNT];
+
+static const struct dma_option dma_adc_scan_option = {
+	STM32_DMAC_ADC, (void *)&STM32_ADC_DR,
+	STM32_DMA_CCR_MSIZE_16_BIT | STM32_DMA_CCR_PSIZE_16_BIT |
+	STM32_DMA_CCR_CIRC,
+};
+
+static void adc_scan_start(void)
+{
+	dma_chan_t *chan = dma_get_channel(STM32_DMAC_ADC);
+	int count = CONFIG_ADC_SCAN_OVERSAMPLE;
+	uint32_t channels = 0;
+	int i, j;
+
+	for (i = 0; i < ADC_CH_COUNT; i++)
+		channels |= 1 << adc_channels[i].channel;
+
+	for (i = 0; i < ADC_CH_COUNT; i++) {
+		scan_index[i] = 0;
+		for (j = 0; j < adc_channels[i].channel; j++)
+			if (channels & (1 << j))
+				scan_index[i]++;
+	}
+
+	scan_channels = 0;
+	for (j = 0; j < 32; j++)
+		if (channels & (1 << j))
+			scan_channels++;
+	count *= scan_channels;
+
+	STM32_ADC_CHSELR = channels;
+
+	/* DMAEN=1, DMACFG=1 -> DMA in circular mode */
+	STM32_ADC_CFGR1 |= 0x3;
+
+	dma_clear_isr(STM32_DMAC_ADC);
+	dma_start_rx(&dma_adc_scan_option, count, scan_ring);
+
+	/*
+	 * Take the first scan right away, and fill the whole ring with it,
+	 * so there's something sensible to read before the timer gets going.
+	 */
+	STM32_ADC_ISR = 0xe;
+	STM32_ADC_CR |= 1 << 2; /* ADSTART */
+	while (chan->cndtr > count - scan_channels)
+		;
+	for (i = 1; i < CONFIG_ADC_SCAN_OVERSAMPLE; i++)
+		memcpy(scan_ring + i * scan_channels, scan_ring,
+		       scan_channels * sizeof(scan_ring[0]));
+
+	adc_timer_start(CONFIG_ADC_SCAN_INTERVAL_MS);
+}
+
+static void adc_scan_stop(void)
+{
+	adc_timer_stop();
+	dma_disable(STM32_DMAC_ADC);
+	STM32_ADC_CFGR1 &= ~0x3;
+}
+/* The next image's ring will be somewhere else */
+DECLARE_HOOK(HOOK_SYSJUMP, adc_scan_stop, HOOK_PRIO_DEFAULT);
+
+/* Average of the samples of an adc_channels[] entry in the ring */
+static int adc_scan_read_raw(enum adc_channel ch)
+{
+	const uint16_t *p = scan_ring + scan_index[ch];
+	int sum = 0;
+	int i;
+
+	for (i = 0; i < CONFIG_ADC_SCAN_OVERSAMPLE; i++, p += scan_channels)
+		sum += *p;
+
+	return sum / CONFIG_ADC_SCAN_OVERSAMPLE;
+}
+
+int adc_read_channel(enum adc_channel ch)
+{
+	const struct adc_t *adc = adc_channels + ch;
+
+	return adc_scan_read_raw(ch) * adc->factor_mul / adc->factor_div +
+		adc->shift;
+}
+
+int adc_read_all_channels(int *data)
+{
+	int i;
+
+	for (i = 0; i < ADC_CH_COUNT; ++i)
+		data[i] = adc_read_channel(i);
+
+	return EC_SUCCESS;
+}
+
+#else /* !CONFIG_ADC_SCAN */
+
 int adc_read_channel(enum adc_channel ch)
 {
 	const struct adc_t *adc = adc_channels + ch;
@@ -236,6 +355,11 @@ int adc_read_channel(enum adc_channel ch)
 	return value * adc->factor_mul / adc->factor_div + adc->shift;
 }
 
+static const struct dma_option dma_adc_option = {
+	STM32_DMAC_ADC, (void *)&STM32_ADC_DR,
+	STM32_DMA_CCR_MSIZE_32_BIT | STM32_DMA_CCR_PSIZE_32_BIT,
+};
+
 int adc_read_all_channels(int *data)
 {
 	int i;
@@ -286,14 +410,20 @@ fail:
 	return ret;
 }
 
+#endif /* CONFIG_ADC_SCAN */
+
 static void adc_init(void)
 {
 	/*
 	 * If clock is already enabled, and ADC module is enabled
 	 * then this is a warm reboot and ADC is already initialized.
 	 */
-	if (STM32_RCC_APB2ENR & (1 << 9) && (STM32_ADC_CR & STM32_ADC_CR_ADEN))
+	if (STM32_RCC_APB2ENR & (1 << 9) && (STM32_ADC_CR & STM32_ADC_CR_ADEN)) {
+#ifdef CONFIG_ADC_SCAN
+		adc_scan_start();
+#endif
 		return;
+	}
 
 	/* Enable ADC clock */
 	STM32_RCC_APB2ENR |= (1 << 9);
@@ -319,5 +449,9 @@ static void adc_init(void)
 	STM32_ADC_CR = STM32_ADC_CR_ADEN;
 	while (!(STM32_ADC_ISR & STM32_ADC_ISR_ADRDY))
 		STM32_ADC_CR = STM32_ADC_CR_ADEN;
+
+#ifdef CONFIG_ADC_SCAN
+	adc_scan_start();
+#endif
 }
 DECLARE_HOOK(HOOK_INIT, adc_init, HOOK_PRIO_INIT_ADC);
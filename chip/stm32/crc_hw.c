@@ -0,0 +1,116 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Streaming CRC-32 on the hardware block.
+ *
+ * There is only one CRC unit, and the single-stream interface (crc_hw.h)
+ * may be part way through a CRC of its own, so each call loads the
+ * context's state into the unit, hashes its data, then puts back whatever
+ * was there. Interrupts are off meanwhile so nobody else sees the swap.
+ */
+
+#include "clock.h"
+#include "common.h"
+#include "crc.h"
+#include "registers.h"
+#include "task.h"
+
+/* Cortex-M0 has no RBIT, and this is only done twice per call */
+static uint32_t bitrev32(uint32_t v)
+{
+	v = ((v >> 1) & 0x55555555) | ((v & 0x55555555) << 1);
+	v = ((v >> 2) & 0x33333333) | ((v & 0x33333333) << 2);
+	v = ((v >> 4) & 0x0f0f0f0f) | ((v & 0x0f0f0f0f) << 4);
+	v = ((v >> 8) & 0x00ff00ff) | ((v & 0x00ff00ff) << 8);
+	return (v >> 16) | (v << 16);
+}
+
+/*
+ * With REV_OUT set, the data register reads back the bit-reversed state,
+ * which is the same as the reflected software CRC before its final XOR, so
+ * that's what contexts hold. Loading a state is INIT then reset.
+ */
+static void crc_hw_load(uint32_t state)
+{
+	STM32_CRC_INIT = bitrev32(state);
+	STM32_CRC_CR = STM32_CRC_CR_RESET | STM32_CRC_CR_REV_OUT
+		     | STM32_CRC_CR_REV_IN_WORD;
+	while (STM32_CRC_CR & STM32_CRC_CR_RESET)
+		;
+}
+
+/* Input reflection has to match the width of each write */
+static void crc_hw_rev_in(uint32_t rev_in)
+{
+	STM32_CRC_CR = STM32_CRC_CR_REV_OUT | rev_in;
+}
+
+static void crc_hw_update(uint32_t *ctx, const uint8_t *p, int size)
+{
+	uint32_t saved;
+
+	interrupt_disable();
+	saved = STM32_CRC_DR;
+	crc_hw_load(*ctx);
+
+	while (size && ((uintptr_t)p & 3)) {
+		crc_hw_rev_in(STM32_CRC_CR_REV_IN_BYTE);
+		STM32_CRC_DR8 = *p++;
+		size--;
+	}
+
+	crc_hw_rev_in(STM32_CRC_CR_REV_IN_WORD);
+	for (; size >= 4; size -= 4, p += 4)
+		STM32_CRC_DR32 = *(const uint32_t *)p;
+
+	if (size >= 2) {
+		crc_hw_rev_in(STM32_CRC_CR_REV_IN_HWORD);
+		STM32_CRC_DR16 = *(const uint16_t *)p;
+		p += 2;
+		size -= 2;
+	}
+
+	if (size) {
+		crc_hw_rev_in(STM32_CRC_CR_REV_IN_BYTE);
+		STM32_CRC_DR8 = *p;
+	}
+
+	*ctx = STM32_CRC_DR;
+	crc_hw_load(saved);
+	interrupt_enable();
+}
+
+void crc32_ctx_init(uint32_t *ctx)
+{
+	STM32_RCC_AHBENR |= 1 << 6; /* switch on CRC controller */
+	clock_wait_bus_cycles(BUS_AHB, 1);
+	*ctx = 0xFFFFFFFF;
+}
+
+void crc32_ctx_hash32(uint32_t *ctx, uint32_t val)
+{
+	crc_hw_update(ctx, (const uint8_t *)&val, sizeof(val));
+}
+
+void crc32_ctx_hash16(uint32_t *ctx, uint16_t val)
+{
+	crc_hw_update(ctx, (const uint8_t *)&val, sizeof(val));
+}
+
+void crc32_ctx_hash8(uint32_t *ctx, uint8_t val)
+{
+	crc_hw_update(ctx, &val, sizeof(val));
+}
+
+void crc32_ctx_hash(uint32_t *ctx, const void *buf, int size)
+{
+	crc_hw_update(ctx, buf, size);
+}
+
+uint32_t crc32_ctx_result(uint32_t *ctx)
+{
+	return *ctx ^ 0xFFFFFFFF;
+}
@@ -16,7 +16,8 @@ static inline void crc32_init(void)
 	STM32_RCC_AHBENR |= 1 << 6; /* switch on CRC controller */
 	/* Delay 1 AHB clock cycle after the clock is enabled */
 	clock_wait_bus_cycles(BUS_AHB, 1);
-	/* reset CRC state */
+	/* reset CRC state (the streaming interface may have changed INIT) */
+	STM32_CRC_INIT = 0xFFFFFFFF;
 	STM32_CRC_CR = STM32_CRC_CR_RESET | STM32_CRC_CR_REV_OUT
 		     | STM32_CRC_CR_REV_IN_WORD;
 	while (STM32_CRC_CR & 1)
@@ -15,35 +15,16 @@
 #include "usb.h"
 #include "usb-stream.h"
 
-static size_t rx_read(struct usb_stream_config const *config)
-{
-	uintptr_t address = btable_ep[config->endpoint].rx_addr;
-	size_t    count   = btable_ep[config->endpoint].rx_count & 0x3ff;
-
-	/*
-	 * Only read the received USB packet if there is enough space in the
-	 * receive queue.
-	 */
-	if (count >= queue_space(config->producer.queue))
-		return 0;
+#define NEXT_BUFFER(i) (((i) + 1) % USB_STREAM_BUFFERS)
 
-	return queue_add_memcpy(config->producer.queue,
-				(void *) address,
-				count,
-				memcpy_from_usbram);
+static usb_uint *tx_buffer(struct usb_stream_config const *config, int i)
+{
+	return config->tx_ram + i * config->tx_size / 2;
 }
 
-static size_t tx_write(struct usb_stream_config const *config)
+static usb_uint *rx_buffer(struct usb_stream_config const *config, int i)
 {
-	uintptr_t address = btable_ep[config->endpoint].tx_addr;
-	size_t    count   = queue_remove_memcpy(config->consumer.queue,
-						(void *) address,
-						config->tx_size,
-						memcpy_to_usbram);
-
-	btable_ep[config->endpoint].tx_count = count;
-
-	return count;
+	return config->rx_ram + i * config->rx_size / 2;
 }
 
 static int tx_valid(struct usb_stream_config const *config)
@@ -56,6 +37,112 @@ static int rx_valid(struct usb_stream_config const *config)
 	return (STM32_USB_EP(config->endpoint) & EP_RX_MASK) == EP_RX_VALID;
 }
 
+static usb_uint usb_ep_rx_size(size_t bytes)
+{
+	if (bytes < 64)
+		return bytes << 9;
+	else
+		return 0x8000 | ((bytes - 32) << 5);
+}
+
+/*
+ * Hand the next loaded TX buffer to the hardware, if it's idle.  Call from
+ * the endpoint interrupt, or with interrupts disabled.
+ */
+static void tx_start(struct usb_stream_config const *config)
+{
+	struct usb_stream_state volatile *state = config->state;
+	int i = state->tx_send;
+
+	if (state->tx_busy || !state->tx_count[i])
+		return;
+
+	btable_ep[config->endpoint].tx_addr =
+		usb_sram_addr(tx_buffer(config, i));
+	btable_ep[config->endpoint].tx_count = state->tx_count[i];
+	state->tx_busy = 1;
+
+	STM32_TOGGLE_EP(config->endpoint, EP_TX_MASK, EP_TX_VALID, 0);
+}
+
+/*
+ * Let the hardware receive into the next RX buffer, if it's free.  Call from
+ * the endpoint interrupt, or with interrupts disabled.
+ */
+static void rx_start(struct usb_stream_config const *config)
+{
+	struct usb_stream_state volatile *state = config->state;
+	int i = state->rx_recv;
+
+	if (rx_valid(config) || state->rx_count[i])
+		return;
+
+	btable_ep[config->endpoint].rx_addr =
+		usb_sram_addr(rx_buffer(config, i));
+	btable_ep[config->endpoint].rx_count =
+		usb_ep_rx_size(config->rx_size);
+
+	STM32_TOGGLE_EP(config->endpoint, EP_RX_MASK, EP_RX_VALID, 0);
+}
+
+/* Load free TX buffers from the queue, returning non-zero if any were */
+static int tx_write(struct usb_stream_config const *config)
+{
+	struct usb_stream_state volatile *state = config->state;
+	int loaded = 0;
+	size_t count;
+	int i;
+
+	while (!state->tx_count[state->tx_fill]) {
+		i = state->tx_fill;
+		count = queue_remove_memcpy(config->consumer.queue,
+					    (void *) usb_sram_addr(
+						    tx_buffer(config, i)),
+					    config->tx_size,
+					    memcpy_to_usbram);
+		if (!count)
+			break;
+
+		state->tx_count[i] = count;
+		state->tx_fill = NEXT_BUFFER(i);
+		loaded = 1;
+	}
+
+	return loaded;
+}
+
+/*
+ * Move received packets into the queue, as far as there's room, returning
+ * non-zero if any RX buffers were freed.
+ */
+static int rx_read(struct usb_stream_config const *config)
+{
+	struct usb_stream_state volatile *state = config->state;
+	int freed = 0;
+	size_t count;
+	int i;
+
+	while (state->rx_count[state->rx_drain]) {
+		i = state->rx_drain;
+		count = state->rx_count[i];
+		state->rx_offset += queue_add_memcpy(
+			config->producer.queue,
+			(void *) (usb_sram_addr(rx_buffer(config, i)) +
+				  state->rx_offset),
+			count - state->rx_offset,
+			memcpy_from_usbram);
+		if (state->rx_offset < count)
+			break;
+
+		state->rx_offset = 0;
+		state->rx_drain = NEXT_BUFFER(i);
+		state->rx_count[i] = 0;
+		freed = 1;
+	}
+
+	return freed;
+}
+
 static void usb_read(struct producer const *producer, size_t count)
 {
 	struct usb_stream_config const *config =
@@ -77,7 +164,8 @@ static void usb_flush(struct consumer const *consumer)
 	struct usb_stream_config const *config =
 		DOWNCAST(consumer, struct usb_stream_config, consumer);
 
-	while (tx_valid(config) || queue_count(consumer->queue))
+	while (tx_valid(config) || config->state->tx_busy ||
+	       queue_count(consumer->queue))
 		;
 }
 
@@ -92,47 +180,68 @@ struct consumer_ops const usb_stream_consumer_ops = {
 
 void usb_stream_deferred(struct usb_stream_config const *config)
 {
-	if (!tx_valid(config) && tx_write(config))
-		STM32_TOGGLE_EP(config->endpoint, EP_TX_MASK, EP_TX_VALID, 0);
-
-	if (!rx_valid(config) && rx_read(config))
-		STM32_TOGGLE_EP(config->endpoint, EP_RX_MASK, EP_RX_VALID, 0);
+	if (tx_write(config)) {
+		interrupt_disable();
+		tx_start(config);
+		interrupt_enable();
+	}
+
+	if (rx_read(config)) {
+		interrupt_disable();
+		rx_start(config);
+		interrupt_enable();
+	}
 }
 
 void usb_stream_tx(struct usb_stream_config const *config)
 {
+	struct usb_stream_state volatile *state = config->state;
+
 	STM32_TOGGLE_EP(config->endpoint, 0, 0, 0);
 
+	/* That buffer's sent; start on the next while we refill this one */
+	if (state->tx_busy) {
+		state->tx_count[state->tx_send] = 0;
+		state->tx_send = NEXT_BUFFER(state->tx_send);
+		state->tx_busy = 0;
+	}
+	tx_start(config);
+
 	hook_call_deferred(config->deferred, 0);
 }
 
 void usb_stream_rx(struct usb_stream_config const *config)
 {
+	struct usb_stream_state volatile *state = config->state;
+	int i = state->rx_recv;
+
 	STM32_TOGGLE_EP(config->endpoint, 0, 0, 0);
 
-	hook_call_deferred(config->deferred, 0);
-}
+	/*
+	 * Keep receiving into the next buffer while this one is emptied.  An
+	 * empty packet leaves nothing to empty, so reuse its buffer.
+	 */
+	state->rx_count[i] = btable_ep[config->endpoint].rx_count & 0x3ff;
+	if (state->rx_count[i])
+		state->rx_recv = NEXT_BUFFER(i);
+	rx_start(config);
 
-static usb_uint usb_ep_rx_size(size_t bytes)
-{
-	if (bytes < 64)
-		return bytes << 9;
-	else
-		return 0x8000 | ((bytes - 32) << 5);
+	hook_call_deferred(config->deferred, 0);
 }
 
 void usb_stream_reset(struct usb_stream_config const *config)
 {
+	struct usb_stream_state volatile *state = config->state;
 	int i = config->endpoint;
 
-	btable_ep[i].tx_addr  = usb_sram_addr(config->tx_ram);
+	memset((void *) state, 0, sizeof(*state));
+
+	btable_ep[i].tx_addr  = usb_sram_addr(tx_buffer(config, 0));
 	btable_ep[i].tx_count = 0;
 
-	btable_ep[i].rx_addr  = usb_sram_addr(config->rx_ram);
+	btable_ep[i].rx_addr  = usb_sram_addr(rx_buffer(config, 0));
 	btable_ep[i].rx_count = usb_ep_rx_size(config->rx_size);
 
-	config->state->rx_waiting = 0;
-
 	STM32_USB_EP(i) = ((i <<  0) | /* Endpoint Addr*/
 			   (2 <<  4) | /* TX NAK */
 			   (0 <<  9) | /* Bulk EP */
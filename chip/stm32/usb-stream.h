@@ -16,21 +16,47 @@
 
 #include <stdint.h>
 
+/*
+ * Number of USB packet RAM buffers per direction.  With two, the endpoint
+ * interrupt hands the hardware the next buffer as soon as a transfer
+ * completes, while the deferred function moves data between the other
+ * buffer and the queue, so the host isn't NAKed while we catch up.
+ */
+#ifdef CONFIG_STREAM_USB_DOUBLE_BUFFER
+#define USB_STREAM_BUFFERS 2
+#else
+#define USB_STREAM_BUFFERS 1
+#endif
+
 /*
  * Per-USB stream state stored in RAM.  Zero initialization of this structure
  * by the BSS initialization leaves it in a valid and correctly initialized
  * state, so there is no need currently for a usb_stream_init style function.
+ *
+ * The packet buffers in each direction are used in turn, as a ring.  The
+ * fill and drain indexes below are only changed by the deferred function,
+ * and the send and receive indexes only by the endpoint interrupt.
  */
 struct usb_stream_state {
 	/*
-	 * Flag indicating that there is a full RX buffer in the USB packet RAM
-	 * that we were not able to move into the RX queue because there was
-	 * not enough room when the packet was initially received.  The
-	 * producer read operation checks this flag so that once there is
-	 * room in the queue it can copy the RX buffer into the queue and
-	 * restart USB reception by marking the RX buffer as VALID.
+	 * Bytes loaded into each TX buffer, or 0 if it's free.  A buffer stays
+	 * loaded until the hardware has finished sending it.
 	 */
-	int rx_waiting;
+	uint16_t tx_count[USB_STREAM_BUFFERS];
+	uint8_t  tx_fill;     /* Next TX buffer to load from the queue */
+	uint8_t  tx_send;     /* Next TX buffer to hand to the hardware */
+	uint8_t  tx_busy;     /* The hardware is sending tx_send */
+
+	/*
+	 * Bytes received into each RX buffer, or 0 if it's free.  If the RX
+	 * queue doesn't have room for a whole packet, the rest waits in the
+	 * packet RAM until the producer's read operation says there's space,
+	 * and reception stays NAKed until a buffer is free again.
+	 */
+	uint16_t rx_count[USB_STREAM_BUFFERS];
+	uint16_t rx_offset;   /* Bytes of rx_drain already queued */
+	uint8_t  rx_drain;    /* Next RX buffer to move into the queue */
+	uint8_t  rx_recv;     /* RX buffer the hardware receives into next */
 };
 
 /*
@@ -46,7 +72,7 @@ struct usb_stream_config {
 	struct usb_stream_state volatile *state;
 
 	/*
-	 * Endpoint index, and pointers to the USB packet RAM buffers.
+	 * Endpoint index.
 	 */
 	int endpoint;
 
@@ -58,6 +84,10 @@ struct usb_stream_config {
 	size_t rx_size;
 	size_t tx_size;
 
+	/*
+	 * USB packet RAM buffers, USB_STREAM_BUFFERS of each size, back to
+	 * back.
+	 */
 	usb_uint *rx_ram;
 	usb_uint *tx_ram;
 
@@ -89,8 +119,8 @@ extern struct producer_ops const usb_stream_producer_ops;
  * transmitting bytes.
  *
  * RX_SIZE and TX_SIZE are the number of bytes of USB packet RAM to allocate
- * for the RX and TX packets respectively.  The valid values for these
- * parameters are dictated by the USB peripheral.
+ * for the RX and TX packets respectively, for each of USB_STREAM_BUFFERS.
+ * The valid values for these parameters are dictated by the USB peripheral.
  *
  * RX_QUEUE and TX_QUEUE are the names of the RX and TX queues that this driver
  * should write to and read from respectively.
@@ -122,8 +152,10 @@ extern struct producer_ops const usb_stream_producer_ops;
 	BUILD_ASSERT((TX_SIZE <   64 && (TX_SIZE & 0x01) == 0) ||	\
 		     (TX_SIZE < 1024 && (TX_SIZE & 0x1f) == 0));	\
 									\
-	static usb_uint CONCAT2(NAME, _ep_rx_buffer)[RX_SIZE / 2] __usb_ram; \
-	static usb_uint CONCAT2(NAME, _ep_tx_buffer)[TX_SIZE / 2] __usb_ram; \
+	static usb_uint CONCAT2(NAME, _ep_rx_buffer)			\
+		[USB_STREAM_BUFFERS * RX_SIZE / 2] __usb_ram;		\
+	static usb_uint CONCAT2(NAME, _ep_tx_buffer)			\
+		[USB_STREAM_BUFFERS * TX_SIZE / 2] __usb_ram;		\
 	static struct usb_stream_state CONCAT2(NAME, _state);		\
 	static void CONCAT2(NAME, _deferred_)(void);			\
 	struct usb_stream_config const NAME = {				\
@@ -21,6 +21,16 @@
 #define USB_CONSOLE_RX_BUF_SIZE 64
 #define RX_BUF_NEXT(i) (((i) + 1) & (USB_CONSOLE_RX_BUF_SIZE - 1))
 
+/*
+ * With two TX buffers, we fill one while the other is being sent, and long
+ * output is split across packets instead of being cut off.
+ */
+#ifdef CONFIG_USB_CONSOLE_DOUBLE_BUFFER
+#define USB_CONSOLE_TX_BUFFERS 2
+#else
+#define USB_CONSOLE_TX_BUFFERS 1
+#endif
+
 static volatile char rx_buf[USB_CONSOLE_RX_BUF_SIZE];
 static volatile int rx_buf_head;
 static volatile int rx_buf_tail;
@@ -59,9 +69,13 @@ const struct usb_endpoint_descriptor USB_EP_DESC(USB_IFACE_CONSOLE, 1) = {
 	.bInterval          = 0
 };
 
-static usb_uint ep_buf_tx[USB_MAX_PACKET_SIZE / 2] __usb_ram;
+static usb_uint ep_buf_tx[USB_CONSOLE_TX_BUFFERS][USB_MAX_PACKET_SIZE / 2]
+	__usb_ram;
 static usb_uint ep_buf_rx[USB_MAX_PACKET_SIZE / 2] __usb_ram;
 
+/* TX buffer being filled for the next packet */
+static int tx_fill;
+
 static void con_ep_tx(void)
 {
 	/* clear IT */
@@ -90,8 +104,9 @@ static void con_ep_rx(void)
 
 static void ep_reset(void)
 {
-	btable_ep[USB_EP_CONSOLE].tx_addr  = usb_sram_addr(ep_buf_tx);
+	btable_ep[USB_EP_CONSOLE].tx_addr  = usb_sram_addr(ep_buf_tx[0]);
 	btable_ep[USB_EP_CONSOLE].tx_count = 0;
+	tx_fill = 0;
 
 	btable_ep[USB_EP_CONSOLE].rx_addr  = usb_sram_addr(ep_buf_rx);
 	btable_ep[USB_EP_CONSOLE].rx_count =
@@ -107,17 +122,30 @@ static void ep_reset(void)
 
 USB_DECLARE_EP(USB_EP_CONSOLE, con_ep_tx, con_ep_rx, ep_reset);
 
+static int usb_tx_end(int len);
+
 static int __tx_char(void *context, int c)
 {
-	usb_uint *buf = (usb_uint *)ep_buf_tx;
+	usb_uint *buf;
 	int *tx_idx = context;
 
 	/* Do newline to CRLF translation */
 	if (c == '\n' && __tx_char(context, '\r'))
 		return 1;
 
-	if (*tx_idx > 63)
+	if (*tx_idx > 63) {
+#ifdef CONFIG_USB_CONSOLE_DOUBLE_BUFFER
+		/* Send this packet, and carry on in the other buffer */
+		if (usb_tx_end(*tx_idx))
+			return 1;
+		*tx_idx = 0;
+#else
 		return 1;
+#endif
+	}
+
+	/* Only now, since sending the '\r' above may have switched buffers */
+	buf = ep_buf_tx[tx_fill];
 	if (!(*tx_idx & 1))
 		buf[*tx_idx/2] = c;
 	else
@@ -127,18 +155,28 @@ static int __tx_char(void *context, int c)
 	return 0;
 }
 
+static inline int usb_console_tx_valid(void)
+{
+	return (STM32_USB_EP(USB_EP_CONSOLE) & EP_TX_MASK) == EP_TX_VALID;
+}
+
 static void usb_enable_tx(int len)
 {
 	if (!is_enabled)
 		return;
 
+	/*
+	 * If we gave up waiting for the host, don't swap buffers under a
+	 * packet it hasn't read yet; just drop this one.
+	 */
+	if (USB_CONSOLE_TX_BUFFERS > 1 && usb_console_tx_valid())
+		return;
+
+	btable_ep[USB_EP_CONSOLE].tx_addr  = usb_sram_addr(ep_buf_tx[tx_fill]);
 	btable_ep[USB_EP_CONSOLE].tx_count = len;
 	STM32_TOGGLE_EP(USB_EP_CONSOLE, EP_TX_MASK, EP_TX_VALID, 0);
-}
 
-static inline int usb_console_tx_valid(void)
-{
-	return (STM32_USB_EP(USB_EP_CONSOLE) & EP_TX_MASK) == EP_TX_VALID;
+	tx_fill = (tx_fill + 1) % USB_CONSOLE_TX_BUFFERS;
 }
 
 static int usb_wait_console(void)
@@ -179,6 +217,36 @@ static int usb_wait_console(void)
 	}
 }
 
+/*
+ * Start filling a packet.  With a single TX buffer, we have to wait for the
+ * last packet to go before we can touch it.
+ */
+static int usb_tx_begin(void)
+{
+	if (USB_CONSOLE_TX_BUFFERS > 1)
+		return EC_SUCCESS;
+
+	return usb_wait_console();
+}
+
+/*
+ * Send the packet we've filled.  With two TX buffers, this is where we wait
+ * for the last packet to go.
+ */
+static int usb_tx_end(int len)
+{
+	int ret;
+
+	if (USB_CONSOLE_TX_BUFFERS > 1) {
+		ret = usb_wait_console();
+		if (ret)
+			return ret;
+	}
+
+	usb_enable_tx(len);
+	return EC_SUCCESS;
+}
+
 /*
  * Public USB console implementation below.
  */
@@ -202,12 +270,13 @@ int usb_putc(int c)
 	int ret;
 	int tx_idx = 0;
 
-	ret = usb_wait_console();
+	ret = usb_tx_begin();
 	if (ret)
 		return ret;
 
 	ret = __tx_char(&tx_idx, c);
-	usb_enable_tx(tx_idx);
+	if (usb_tx_end(tx_idx))
+		return EC_ERROR_TIMEOUT;
 
 	return ret;
 }
@@ -217,7 +286,7 @@ int usb_puts(const char *outstr)
 	int ret;
 	int tx_idx = 0;
 
-	ret = usb_wait_console();
+	ret = usb_tx_begin();
 	if (ret)
 		return ret;
 
@@ -227,7 +296,8 @@ int usb_puts(const char *outstr)
 			break;
 	}
 
-	usb_enable_tx(tx_idx);
+	if (usb_tx_end(tx_idx))
+		return EC_ERROR_TIMEOUT;
 
 	/* Successful if we consumed all output */
 	return *outstr ? EC_ERROR_OVERFLOW : EC_SUCCESS;
@@ -238,13 +308,14 @@ int usb_vprintf(const char *format, va_list args)
 	int ret;
 	int tx_idx = 0;
 
-	ret = usb_wait_console();
+	ret = usb_tx_begin();
 	if (ret)
 		return ret;
 
 	ret = vfnprintf(__tx_char, &tx_idx, format, args);
 
-	usb_enable_tx(tx_idx);
+	if (usb_tx_end(tx_idx))
+		return EC_ERROR_TIMEOUT;
 	return ret;
 }
 
@@ -7,8 +7,13 @@
 #include "link_defs.h"
 #include "registers.h"
 #include "spi.h"
+#include "spi_flash.h"
+#include "spi_flash_reg.h"
+#include "task.h"
+#include "timer.h"
 #include "usb.h"
 #include "usb_spi.h"
+#include "util.h"
 
 static int16_t usb_spi_map_error(int error)
 {
@@ -20,6 +25,360 @@ static int16_t usb_spi_map_error(int error)
 	}
 }
 
+static void usb_spi_update_enabled(struct usb_spi_config const *config)
+{
+	/*
+	 * If our overall enabled state has changed we call the board specific
+	 * enable or disable routines and save our new state.
+	 */
+	int enabled = (config->state->enabled_host &&
+		       config->state->enabled_device);
+
+	if (enabled ^ config->state->enabled) {
+		if (enabled) usb_spi_board_enable(config);
+		else         usb_spi_board_disable(config);
+
+		config->state->enabled = enabled;
+	}
+}
+
+#ifdef CONFIG_USB_SPI_PIPELINE
+#define NEXT_CMD(i)      (((i) + 1) % CONFIG_USB_SPI_PIPELINE_DEPTH)
+#define NEXT_RESPONSE(i) (((i) + 1) % USB_SPI_RESPONSES)
+
+static uint8_t *cmd_packet(struct usb_spi_config const *config, int i)
+{
+	return config->cmd + i * USB_MAX_PACKET_SIZE;
+}
+
+static uint8_t *response(struct usb_spi_config const *config, int i)
+{
+	return (uint8_t *)(config->buffer + i * USB_SPI_RESPONSE_SIZE / 2);
+}
+
+/*
+ * Send the next packet of the response being sent, if the endpoint is idle.
+ * Call from the endpoint interrupt, or with interrupts disabled.
+ */
+static void tx_start(struct usb_spi_config const *config)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int i = state->rsp_send;
+	int count;
+
+	if (state->tx_busy || !state->rsp_count[i])
+		return;
+
+	count = MIN(state->rsp_count[i] - state->rsp_offset,
+		    USB_MAX_PACKET_SIZE);
+	memcpy_to_usbram((void *) usb_sram_addr(config->tx_ram),
+			 response(config, i) + state->rsp_offset, count);
+
+	btable_ep[config->endpoint].tx_count = count;
+	state->tx_busy = 1;
+
+	STM32_TOGGLE_EP(config->endpoint, EP_TX_MASK, EP_TX_VALID, 0);
+}
+
+/*
+ * Hand a finished response of count bytes, status included, to the TX
+ * interrupt, and move on to the next response buffer.
+ */
+static void usb_spi_respond(struct usb_spi_config const *config,
+			    uint16_t status, int count)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int i = state->rsp_fill;
+
+	config->buffer[i * USB_SPI_RESPONSE_SIZE / 2] = status;
+
+	state->op = USB_SPI_OP_NONE;
+	state->rsp_fill = NEXT_RESPONSE(i);
+
+	interrupt_disable();
+	state->rsp_count[i] = count;
+	tx_start(config);
+	interrupt_enable();
+}
+
+/*
+ * Read the flash status for USB_SPI_OP_PROGRAM, returning non-zero if we're
+ * still waiting for the flash, in which case we'll be called again.
+ */
+static int usb_spi_poll(struct usb_spi_config const *config)
+{
+	static const uint8_t cmd = SPI_FLASH_READ_SR1;
+	struct usb_spi_state volatile *state = config->state;
+	uint8_t sr1;
+	int rv;
+
+	if (!state->enabled) {
+		rv = USB_SPI_DISABLED;
+	} else {
+		rv = usb_spi_map_error(spi_transaction(SPI_FLASH_DEVICE,
+						       &cmd, 1, &sr1, 1));
+		if (rv == USB_SPI_SUCCESS && (sr1 & SPI_FLASH_SR1_BUSY)) {
+			if (!timestamp_expired(state->deadline, NULL)) {
+				hook_call_deferred(config->deferred,
+						   USB_SPI_POLL_INTERVAL_US);
+				return 1;
+			}
+			rv = USB_SPI_TIMEOUT;
+		}
+	}
+
+	state->polling = 0;
+	usb_spi_respond(config, rv, 2);
+	return 0;
+}
+
+/*
+ * Run an extended command once its whole payload is in the response buffer.
+ */
+static void usb_spi_execute(struct usb_spi_config const *config)
+{
+	static const uint8_t wren = SPI_FLASH_WRITE_ENABLE;
+	struct usb_spi_state volatile *state = config->state;
+	uint8_t *buf = response(config, state->rsp_fill) + 2;
+	int rv;
+
+	if (state->status != USB_SPI_SUCCESS) {
+		usb_spi_respond(config, state->status, 2);
+		return;
+	}
+
+	if (state->op == USB_SPI_OP_TRANSFER) {
+		/*
+		 * The payload is all sent before anything is read, so the read
+		 * can land on top of it.
+		 */
+		rv = usb_spi_map_error(spi_transaction(SPI_FLASH_DEVICE,
+						       buf, state->write_count,
+						       buf, state->arg));
+		usb_spi_respond(config, rv,
+				rv == USB_SPI_SUCCESS ? 2 + state->arg : 2);
+		return;
+	}
+
+	rv = spi_transaction(SPI_FLASH_DEVICE, &wren, 1, NULL, 0);
+	if (rv == EC_SUCCESS)
+		rv = spi_transaction(SPI_FLASH_DEVICE, buf,
+				     state->write_count, NULL, 0);
+	if (rv != EC_SUCCESS) {
+		usb_spi_respond(config, usb_spi_map_error(rv), 2);
+		return;
+	}
+
+	state->deadline.val = get_time().val +
+		(state->arg ? state->arg : USB_SPI_PROGRAM_TIMEOUT_MS) * MSEC;
+	state->polling = 1;
+	usb_spi_poll(config);
+}
+
+/*
+ * Handle a command in the original format, straight from the packet.
+ */
+static void usb_spi_simple(struct usb_spi_config const *config,
+			   uint8_t *packet, int count)
+{
+	struct usb_spi_state volatile *state = config->state;
+	uint8_t write_count = packet[0];
+	uint8_t read_count  = count > 1 ? packet[1] : 0;
+	uint16_t status;
+
+	if (!state->enabled) {
+		status = USB_SPI_DISABLED;
+	} else if (write_count > USB_SPI_MAX_WRITE_COUNT ||
+		   write_count != (count - 2)) {
+		status = USB_SPI_WRITE_COUNT_INVALID;
+	} else if (read_count > USB_SPI_MAX_READ_COUNT) {
+		status = USB_SPI_READ_COUNT_INVALID;
+	} else {
+		status = usb_spi_map_error(
+			spi_transaction(SPI_FLASH_DEVICE,
+					packet + 2, write_count,
+					response(config, state->rsp_fill) + 2,
+					read_count));
+	}
+
+	/*
+	 * Hosts using this format always expect read_count + 2 bytes back,
+	 * whatever the status, in a single packet.
+	 */
+	usb_spi_respond(config, status,
+			MIN(read_count + 2, USB_MAX_PACKET_SIZE));
+}
+
+/*
+ * Handle one received packet: a command, or more of an extended command's
+ * payload.
+ */
+static void usb_spi_packet(struct usb_spi_config const *config,
+			   uint8_t *packet, int count)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int n;
+
+	if (state->op == USB_SPI_OP_NONE) {
+		if (packet[0] != USB_SPI_EXT_MARKER) {
+			usb_spi_simple(config, packet, count);
+			return;
+		}
+
+		if (count < USB_SPI_EXT_HEADER_SIZE) {
+			usb_spi_respond(config, USB_SPI_COMMAND_INVALID, 2);
+			return;
+		}
+
+		state->op           = packet[1];
+		state->write_count  = packet[2] | (packet[3] << 8);
+		state->arg          = packet[4] | (packet[5] << 8);
+		state->write_offset = 0;
+
+		/*
+		 * A bad command still has its payload collected (and dropped),
+		 * so we stay in step with the host.
+		 */
+		if (!state->enabled)
+			state->status = USB_SPI_DISABLED;
+		else if (state->op != USB_SPI_OP_TRANSFER &&
+			 state->op != USB_SPI_OP_PROGRAM)
+			state->status = USB_SPI_COMMAND_INVALID;
+		else if (state->write_count > CONFIG_USB_SPI_BUFFER_SIZE ||
+			 (state->op == USB_SPI_OP_PROGRAM &&
+			  !state->write_count))
+			state->status = USB_SPI_WRITE_COUNT_INVALID;
+		else if (state->op == USB_SPI_OP_TRANSFER &&
+			 state->arg > CONFIG_USB_SPI_BUFFER_SIZE)
+			state->status = USB_SPI_READ_COUNT_INVALID;
+		else
+			state->status = USB_SPI_SUCCESS;
+
+		packet += USB_SPI_EXT_HEADER_SIZE;
+		count  -= USB_SPI_EXT_HEADER_SIZE;
+	}
+
+	n = MIN(count, state->write_count - state->write_offset);
+	if (state->status == USB_SPI_SUCCESS)
+		memcpy(response(config, state->rsp_fill) + 2 +
+		       state->write_offset, packet, n);
+	state->write_offset += n;
+
+	if (state->write_offset == state->write_count)
+		usb_spi_execute(config);
+}
+
+void usb_spi_deferred(struct usb_spi_config const *config)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int i;
+
+	usb_spi_update_enabled(config);
+
+	if (state->polling && usb_spi_poll(config))
+		return;
+
+	/*
+	 * Work through the received packets while there's a response buffer
+	 * to put the results in.  SPI transfers into one buffer overlap with
+	 * the TX interrupt sending the other.
+	 */
+	while (!state->polling &&
+	       !state->rsp_count[state->rsp_fill] &&
+	       state->cmd_count[state->cmd_tail]) {
+		i = state->cmd_tail;
+
+		usb_spi_packet(config, cmd_packet(config, i),
+			       state->cmd_count[i]);
+
+		state->cmd_tail = NEXT_CMD(i);
+
+		interrupt_disable();
+		state->cmd_count[i] = 0;
+		if (state->rx_nak) {
+			state->rx_nak = 0;
+			STM32_TOGGLE_EP(config->endpoint, EP_RX_MASK,
+					EP_RX_VALID, 0);
+		}
+		interrupt_enable();
+	}
+}
+
+void usb_spi_tx(struct usb_spi_config const *config)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int i = state->rsp_send;
+
+	STM32_TOGGLE_EP(config->endpoint, EP_TX_MASK, EP_TX_NAK, 0);
+
+	if (!state->tx_busy)
+		return;
+
+	state->tx_busy = 0;
+	state->rsp_offset += btable_ep[config->endpoint].tx_count & 0x3ff;
+
+	if (state->rsp_offset >= state->rsp_count[i]) {
+		state->rsp_count[i] = 0;
+		state->rsp_offset = 0;
+		state->rsp_send = NEXT_RESPONSE(i);
+
+		/* A response buffer is free, more commands can run */
+		hook_call_deferred(config->deferred, 0);
+	}
+
+	tx_start(config);
+}
+
+void usb_spi_rx(struct usb_spi_config const *config)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int i = state->cmd_head;
+	int count = btable_ep[config->endpoint].rx_count & 0x3ff;
+
+	/* Zero length packets carry nothing, just drop them */
+	if (count) {
+		memcpy_from_usbram(cmd_packet(config, i),
+				   (void *) usb_sram_addr(config->rx_ram),
+				   count);
+		state->cmd_count[i] = count;
+		state->cmd_head = NEXT_CMD(i);
+
+		hook_call_deferred(config->deferred, 0);
+	}
+
+	/*
+	 * Take the next packet right away if there's room for it, otherwise
+	 * NAK the host until the deferred callback frees a slot.
+	 */
+	if (state->cmd_count[state->cmd_head]) {
+		state->rx_nak = 1;
+		STM32_TOGGLE_EP(config->endpoint, EP_RX_MASK, EP_RX_NAK, 0);
+	} else {
+		STM32_TOGGLE_EP(config->endpoint, EP_RX_MASK, EP_RX_VALID, 0);
+	}
+}
+
+static void usb_spi_reset_pipeline(struct usb_spi_config const *config)
+{
+	struct usb_spi_state volatile *state = config->state;
+	int i;
+
+	for (i = 0; i < CONFIG_USB_SPI_PIPELINE_DEPTH; i++)
+		state->cmd_count[i] = 0;
+	for (i = 0; i < USB_SPI_RESPONSES; i++)
+		state->rsp_count[i] = 0;
+
+	state->cmd_head   = 0;
+	state->cmd_tail   = 0;
+	state->rx_nak     = 0;
+	state->rsp_fill   = 0;
+	state->rsp_send   = 0;
+	state->rsp_offset = 0;
+	state->tx_busy    = 0;
+	state->op         = USB_SPI_OP_NONE;
+	state->polling    = 0;
+}
+#else
 static uint8_t usb_spi_read_packet(struct usb_spi_config const *config)
 {
 	size_t  i;
@@ -66,19 +425,7 @@ static int rx_valid(struct usb_spi_config const *config)
 
 void usb_spi_deferred(struct usb_spi_config const *config)
 {
-	/*
-	 * If our overall enabled state has changed we call the board specific
-	 * enable or disable routines and save our new state.
-	 */
-	int enabled = (config->state->enabled_host &&
-		       config->state->enabled_device);
-
-	if (enabled ^ config->state->enabled) {
-		if (enabled) usb_spi_board_enable(config);
-		else         usb_spi_board_disable(config);
-
-		config->state->enabled = enabled;
-	}
+	usb_spi_update_enabled(config);
 
 	/*
 	 * And if there is a USB packet waiting we process it and generate a
@@ -120,6 +467,7 @@ void usb_spi_rx(struct usb_spi_config const *config)
 
 	hook_call_deferred(config->deferred, 0);
 }
+#endif
 
 void usb_spi_reset(struct usb_spi_config const *config)
 {
@@ -136,6 +484,10 @@ void usb_spi_reset(struct usb_spi_config const *config)
 				  (2        <<  4) | /* TX NAK */
 				  (0        <<  9) | /* Bulk EP */
 				  (3        << 12)); /* RX Valid */
+
+#ifdef CONFIG_USB_SPI_PIPELINE
+	usb_spi_reset_pipeline(config);
+#endif
 }
 
 int usb_spi_interface(struct usb_spi_config const *config,
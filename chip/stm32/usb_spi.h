@@ -9,6 +9,7 @@
 
 #include "compile_time_macros.h"
 #include "hooks.h"
+#include "timer.h"
 #include "usb.h"
 
 /*
@@ -38,12 +39,53 @@
  *         0x0003: Write count invalid (> 62 bytes, or mismatch with payload)
  *         0x0004: Read count invalid (> 62 bytes)
  *         0x0005: The SPI bridge is disabled.
+ *         0x0006: Extended command invalid (unknown op, or too short)
  *         0x8000: Unknown error mask
  *             The bottom 15 bits will contain the bottom 15 bits from the EC
  *             error code.
  *
  *     read payload: up to 62 bytes of data read from SPI, length will match
  *                   requested read count
+ *
+ * With CONFIG_USB_SPI_PIPELINE the bridge also accepts extended commands,
+ * which start with a write count of USB_SPI_EXT_MARKER (an invalid write
+ * count in the command above):
+ *     +-----------+---------+------------------+---------------+---------+
+ *     | 0xff : 1B | op : 1B | write count : 2B | argument : 2B | payload |
+ *     +-----------+---------+------------------+---------------+---------+
+ *
+ *     op:          USB_SPI_OP_TRANSFER or USB_SPI_OP_PROGRAM
+ *
+ *     write count: little endian count of payload bytes, up to
+ *                  CONFIG_USB_SPI_BUFFER_SIZE.  A payload which doesn't fit
+ *                  in the first packet continues in the packets that follow,
+ *                  which carry nothing but payload.
+ *
+ *     argument:    USB_SPI_OP_TRANSFER: little endian count of bytes to read
+ *                  after writing the payload, up to CONFIG_USB_SPI_BUFFER_SIZE.
+ *                  USB_SPI_OP_PROGRAM: how long to wait for the flash to
+ *                  finish, in ms, or 0 for USB_SPI_PROGRAM_TIMEOUT_MS.
+ *
+ *     USB_SPI_OP_PROGRAM sends a write enable, then the payload (a page
+ *     program, erase or status register write), then reads the flash status
+ *     register on the device until the write in progress bit clears.
+ *
+ * Response:
+ *     +-------------+----------------------------------------------+
+ *     | status : 2B | read payload : argument bytes, TRANSFER only |
+ *     +-------------+----------------------------------------------+
+ *
+ *     A response longer than one packet continues in the packets that
+ *     follow, so the host should read until it has the whole response.  If
+ *     the status isn't USB_SPI_SUCCESS, the response to an extended command
+ *     is just the status.  The response to a command in the original format
+ *     is always read count + 2 bytes, as before.
+ *
+ * Commands of either kind may be sent without waiting for the response to
+ * the one before; the bridge queues up to CONFIG_USB_SPI_PIPELINE_DEPTH
+ * packets, and NAKs the host beyond that.  Responses come back in order.
+ * A bridge without CONFIG_USB_SPI_PIPELINE answers an extended command with
+ * USB_SPI_WRITE_COUNT_INVALID.
  */
 
 enum usb_spi_error {
@@ -53,6 +95,7 @@ enum usb_spi_error {
 	USB_SPI_WRITE_COUNT_INVALID = 0x0003,
 	USB_SPI_READ_COUNT_INVALID  = 0x0004,
 	USB_SPI_DISABLED            = 0x0005,
+	USB_SPI_COMMAND_INVALID     = 0x0006,
 	USB_SPI_UNKNOWN_ERROR       = 0x8000,
 };
 
@@ -61,9 +104,47 @@ enum usb_spi_request {
 	USB_SPI_REQ_DISABLE = 0x0001,
 };
 
+enum usb_spi_op {
+	USB_SPI_OP_NONE     = 0x00,
+	USB_SPI_OP_TRANSFER = 0x01,
+	USB_SPI_OP_PROGRAM  = 0x02,
+};
+
 #define USB_SPI_MAX_WRITE_COUNT 62
 #define USB_SPI_MAX_READ_COUNT  62
 
+#define USB_SPI_EXT_MARKER      0xff
+#define USB_SPI_EXT_HEADER_SIZE 6
+
+/* Default time allowed for USB_SPI_OP_PROGRAM, long enough for a 64KB erase */
+#define USB_SPI_PROGRAM_TIMEOUT_MS 3000
+
+/* How often to read the flash status while USB_SPI_OP_PROGRAM waits */
+#define USB_SPI_POLL_INTERVAL_US 100
+
+/*
+ * Extended commands collect their payload in, and SPI reads land in, one of
+ * two response buffers, so one response can be sent while the next command
+ * runs.
+ */
+#define USB_SPI_RESPONSES     2
+#define USB_SPI_RESPONSE_SIZE (2 + CONFIG_USB_SPI_BUFFER_SIZE)
+
+#ifdef CONFIG_USB_SPI_PIPELINE
+BUILD_ASSERT(CONFIG_USB_SPI_BUFFER_SIZE >= USB_SPI_MAX_READ_COUNT);
+BUILD_ASSERT((CONFIG_USB_SPI_BUFFER_SIZE & 1) == 0);
+BUILD_ASSERT(CONFIG_USB_SPI_PIPELINE_DEPTH >= 2);
+#define USB_SPI_BUFFER_WORDS (USB_SPI_RESPONSES * USB_SPI_RESPONSE_SIZE / 2)
+#define USB_SPI_CMD_RING(NAME)						\
+	static uint8_t CONCAT2(NAME, _cmd_)				\
+		[CONFIG_USB_SPI_PIPELINE_DEPTH * USB_MAX_PACKET_SIZE];
+#define USB_SPI_CMD_RING_PTR(NAME) CONCAT2(NAME, _cmd_)
+#else
+#define USB_SPI_BUFFER_WORDS (USB_MAX_PACKET_SIZE / 2)
+#define USB_SPI_CMD_RING(NAME)
+#define USB_SPI_CMD_RING_PTR(NAME) NULL
+#endif
+
 BUILD_ASSERT(USB_MAX_PACKET_SIZE == (1 + 1 + USB_SPI_MAX_WRITE_COUNT));
 BUILD_ASSERT(USB_MAX_PACKET_SIZE == (2 + USB_SPI_MAX_READ_COUNT));
 
@@ -89,6 +170,43 @@ struct usb_spi_state {
 	 * callback.
 	 */
 	int enabled;
+
+#ifdef CONFIG_USB_SPI_PIPELINE
+	/*
+	 * Received packets, filled in order by the RX interrupt and consumed
+	 * in order by the deferred callback.  A slot is free when its count is
+	 * zero.  When the ring is full the RX interrupt leaves the endpoint
+	 * NAKing and sets rx_nak, and the deferred callback re-arms it once a
+	 * slot is freed.
+	 */
+	uint8_t cmd_count[CONFIG_USB_SPI_PIPELINE_DEPTH];
+	int cmd_head;
+	int cmd_tail;
+	int rx_nak;
+
+	/*
+	 * Responses, filled in order by the deferred callback and sent in
+	 * order by the TX interrupt, one packet at a time.  A buffer is free
+	 * when its count is zero.
+	 */
+	uint16_t rsp_count[USB_SPI_RESPONSES];
+	int rsp_fill;
+	int rsp_send;
+	int rsp_offset;
+	int tx_busy;
+
+	/*
+	 * Extended command being collected into, or run from, the rsp_fill
+	 * buffer.  op is USB_SPI_OP_NONE between commands.
+	 */
+	int op;
+	int status;
+	int write_count;
+	int write_offset;
+	int arg;
+	int polling;
+	timestamp_t deadline;
+#endif
 };
 
 /*
@@ -114,9 +232,12 @@ struct usb_spi_config {
 	void (*deferred)(void);
 
 	/*
-	 * Pointers to USB packet RAM and bounce buffer.
+	 * Pointers to USB packet RAM and bounce buffer.  With
+	 * CONFIG_USB_SPI_PIPELINE the bounce buffer holds the response
+	 * buffers, and cmd holds the ring of received packets.
 	 */
 	uint16_t *buffer;
+	uint8_t  *cmd;
 	usb_uint *rx_ram;
 	usb_uint *tx_ram;
 };
@@ -136,7 +257,8 @@ struct usb_spi_config {
 #define USB_SPI_CONFIG(NAME,						\
 		       INTERFACE,					\
 		       ENDPOINT)					\
-	static uint16_t CONCAT2(NAME, _buffer_)[USB_MAX_PACKET_SIZE / 2]; \
+	static uint16_t CONCAT2(NAME, _buffer_)[USB_SPI_BUFFER_WORDS];	\
+	USB_SPI_CMD_RING(NAME)						\
 	static usb_uint CONCAT2(NAME, _ep_rx_buffer_)[USB_MAX_PACKET_SIZE / 2] __usb_ram; \
 	static usb_uint CONCAT2(NAME, _ep_tx_buffer_)[USB_MAX_PACKET_SIZE / 2] __usb_ram; \
 	static void CONCAT2(NAME, _deferred_)(void);			\
@@ -151,6 +273,7 @@ struct usb_spi_config {
 		.endpoint  = ENDPOINT,					\
 		.deferred  = CONCAT2(NAME, _deferred_),			\
 		.buffer    = CONCAT2(NAME, _buffer_),			\
+		.cmd       = USB_SPI_CMD_RING_PTR(NAME),		\
 		.rx_ram    = CONCAT2(NAME, _ep_rx_buffer_),		\
 		.tx_ram    = CONCAT2(NAME, _ep_tx_buffer_),		\
 	};								\
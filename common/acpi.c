@@ -4,6 +4,7 @@
  */
 
 #include "acpi.h"
+#include "atomic.h"
 #include "common.h"
 #include "console.h"
 #include "dptf.h"
@@ -31,30 +32,75 @@ static int dptf_temp_threshold;			/* last threshold written */
 #endif
 
 /*
- * Keep a read cache of four bytes when burst mode is enabled, which is the
- * size of the largest non-string memmap data type.
+ * In burst mode, reads of memmap data come from a few cached windows, each
+ * copied from the memmap in one go the first time it's needed.  This ensures
+ * the continuity of multi-byte reads, which is important when dealing with
+ * data types > 8 bits, and lets a burst use several values at once (e.g. the
+ * battery's voltage, rate and capacity for _BST).
  */
-#define ACPI_READ_CACHE_SIZE 4
+#define ACPI_READ_CACHE_WINDOWS 4
 
-/* Start address that indicates read cache is flushed. */
-#define ACPI_READ_CACHE_FLUSHED (EC_ACPI_MEM_MAPPED_BEGIN - 1)
+/* Window size; the size of a memmap string, the largest memmap data type. */
+#define ACPI_READ_CACHE_SIZE EC_MEMMAP_TEXT_MAX
 
 /* Calculate size of valid cache based upon end of memmap data. */
 #define ACPI_VALID_CACHE_SIZE(addr) (MIN( \
 	EC_ACPI_MEM_MAPPED_SIZE + EC_ACPI_MEM_MAPPED_BEGIN - (addr), \
 	ACPI_READ_CACHE_SIZE))
 
+static struct acpi_read_window {
+	uint8_t start_addr;
+	uint8_t size;			/* 0 if the window is empty */
+	uint8_t data[ACPI_READ_CACHE_SIZE];
+} acpi_read_cache[ACPI_READ_CACHE_WINDOWS];
+static int acpi_read_cache_enabled;
+static int acpi_read_cache_next;	/* Window to fill next */
+static int acpi_last_read;		/* Last address read in burst mode */
+
 /*
- * In burst mode, read the requested memmap data and the data immediately
- * following it into a cache. For future reads in burst mode, try to grab
- * data from the cache. This ensures the continuity of multi-byte reads,
- * which is important when dealing with data types > 8 bits.
+ * Writes whose effect can wait are applied from a deferred function instead
+ * of the LPC interrupt.  The host only writes one byte at a time, so there's
+ * nothing to batch within an interrupt, but consecutive writes to the same
+ * address (e.g. while the host fades the keyboard backlight) combine into one
+ * update, and their console output stays out of interrupt context.
  */
+enum acpi_deferred_write {
+	ACPI_DEFER_KBLIGHT,
+	ACPI_DEFER_FAN_DUTY,
+	ACPI_DEFER_CHARGING_LIMIT,
+
+	ACPI_DEFER_COUNT
+};
+static uint8_t acpi_deferred_data[ACPI_DEFER_COUNT];
+static uint32_t acpi_deferred_pending;
+
+enum acpi_op {
+	ACPI_OP_READ,
+	ACPI_OP_WRITE,
+	ACPI_OP_QUERY,
+	ACPI_OP_BURST,
+
+	ACPI_OP_COUNT
+};
+
+#ifdef CONFIG_CMD_ACPISTATS
+/* Transaction counts and time spent handling them, for 'acpistats' */
+static const char * const acpi_op_names[ACPI_OP_COUNT] = {
+	"read", "write", "query", "burst"};
 static struct {
-	int enabled;
-	uint8_t start_addr;
-	uint8_t data[ACPI_READ_CACHE_SIZE];
-} acpi_read_cache;
+	uint32_t count;
+	uint32_t total_us;
+	uint32_t max_us;
+} acpi_op_stats[ACPI_OP_COUNT];
+static uint32_t acpi_op_us;		/* Time so far in the current command */
+static uint32_t acpi_cache_hits;
+static uint32_t acpi_cache_misses;
+static uint32_t acpi_cache_prefetches;
+static uint32_t acpi_writes_combined;
+#define ACPI_STAT_INC(stat) ((stat)++)
+#else
+#define ACPI_STAT_INC(stat)
+#endif
 
 /*
  * Deferred function to ensure that ACPI burst mode doesn't remain enabled
@@ -62,17 +108,57 @@ static struct {
  */
 static void acpi_disable_burst_deferred(void)
 {
-	acpi_read_cache.enabled = 0;
+	acpi_read_cache_enabled = 0;
 	lpc_clear_acpi_status_mask(EC_LPC_STATUS_BURST_MODE);
 	CPUTS("ACPI missed burst disable?");
 }
 DECLARE_DEFERRED(acpi_disable_burst_deferred);
 
+static void acpi_read_cache_flush(void)
+{
+	int i;
+
+	for (i = 0; i < ACPI_READ_CACHE_WINDOWS; i++)
+		acpi_read_cache[i].size = 0;
+	acpi_last_read = -1;
+}
+
+/* Copy memmap data starting at addr into the least recently filled window. */
+static struct acpi_read_window *acpi_read_cache_fill(int addr)
+{
+	struct acpi_read_window *w = acpi_read_cache + acpi_read_cache_next;
+
+	acpi_read_cache_next = (acpi_read_cache_next + 1) %
+		ACPI_READ_CACHE_WINDOWS;
+
+	w->start_addr = addr;
+	w->size = ACPI_VALID_CACHE_SIZE(addr);
+	memcpy(w->data,
+	       lpc_get_memmap_range() + addr - EC_ACPI_MEM_MAPPED_BEGIN,
+	       w->size);
+
+	return w;
+}
+
+static struct acpi_read_window *acpi_read_cache_find(int addr)
+{
+	struct acpi_read_window *w;
+
+	for (w = acpi_read_cache;
+	     w < acpi_read_cache + ACPI_READ_CACHE_WINDOWS; w++) {
+		if (w->size && addr >= w->start_addr &&
+		    addr - w->start_addr < w->size)
+			return w;
+	}
+
+	return NULL;
+}
+
 /* Read memmapped data, returns read data or 0xff on error. */
 static int acpi_read(uint8_t addr)
 {
-	uint8_t *memmap_addr = (uint8_t *)(lpc_get_memmap_range() + addr -
-					   EC_ACPI_MEM_MAPPED_BEGIN);
+	struct acpi_read_window *w;
+	int next;
 
 	/* Check for out-of-range read. */
 	if (addr < EC_ACPI_MEM_MAPPED_BEGIN ||
@@ -82,26 +168,112 @@ static int acpi_read(uint8_t addr)
 		return 0xff;
 	}
 
-	/* Read from cache if enabled (burst mode). */
-	if (acpi_read_cache.enabled) {
-		/* Fetch to cache on miss. */
-		if (acpi_read_cache.start_addr == ACPI_READ_CACHE_FLUSHED ||
-		    acpi_read_cache.start_addr > addr ||
-		    addr - acpi_read_cache.start_addr >=
-		    ACPI_READ_CACHE_SIZE) {
-			memcpy(acpi_read_cache.data,
-			       memmap_addr,
-			       ACPI_VALID_CACHE_SIZE(addr));
-			acpi_read_cache.start_addr = addr;
-		}
-		/* Return data from cache. */
-		return acpi_read_cache.data[addr - acpi_read_cache.start_addr];
+	/* Read directly from memmap data unless in burst mode. */
+	if (!acpi_read_cache_enabled)
+		return *(lpc_get_memmap_range() + addr -
+			 EC_ACPI_MEM_MAPPED_BEGIN);
+
+	w = acpi_read_cache_find(addr);
+	if (w) {
+		ACPI_STAT_INC(acpi_cache_hits);
 	} else {
-		/* Read directly from memmap data. */
-		return *memmap_addr;
+		ACPI_STAT_INC(acpi_cache_misses);
+		w = acpi_read_cache_fill(addr);
+
+		/*
+		 * A sequential read running off the end of one window will
+		 * likely keep going, so fetch the window after this one too,
+		 * from the same moment.
+		 */
+		next = addr + w->size;
+		if (addr == acpi_last_read + 1 &&
+		    next < EC_ACPI_MEM_MAPPED_BEGIN + EC_ACPI_MEM_MAPPED_SIZE &&
+		    !acpi_read_cache_find(next)) {
+			acpi_read_cache_fill(next);
+			ACPI_STAT_INC(acpi_cache_prefetches);
+		}
+	}
+	acpi_last_read = addr;
+
+	/* Return data from cache. */
+	return w->data[addr - w->start_addr];
+}
+
+/* Return which deferred write handles addr, or -1 if it's done right away. */
+static int acpi_deferred_write_index(uint8_t addr)
+{
+	switch (addr) {
+#ifdef CONFIG_PWM_KBLIGHT
+	case EC_ACPI_MEM_KEYBOARD_BACKLIGHT:
+		return ACPI_DEFER_KBLIGHT;
+#endif
+#ifdef CONFIG_FANS
+	case EC_ACPI_MEM_FAN_DUTY:
+		return ACPI_DEFER_FAN_DUTY;
+#endif
+#ifdef CONFIG_CHARGER
+	case EC_ACPI_MEM_CHARGING_LIMIT:
+		return ACPI_DEFER_CHARGING_LIMIT;
+#endif
+	default:
+		return -1;
 	}
 }
 
+static void acpi_apply_deferred_writes(void)
+{
+	uint32_t pending = atomic_read_clear(&acpi_deferred_pending);
+	int data;
+
+#ifdef CONFIG_PWM_KBLIGHT
+	if (pending & (1 << ACPI_DEFER_KBLIGHT)) {
+		data = acpi_deferred_data[ACPI_DEFER_KBLIGHT];
+		/*
+		 * Debug output with CR not newline, because the host does a
+		 * lot of keyboard backlights and it scrolls the debug console.
+		 */
+		CPRINTF("\r[%T ACPI kblight %d]", data);
+		pwm_set_duty(PWM_CH_KBLIGHT, data);
+	}
+#endif
+#ifdef CONFIG_FANS
+	if (pending & (1 << ACPI_DEFER_FAN_DUTY))
+		dptf_set_fan_duty_target(acpi_deferred_data[ACPI_DEFER_FAN_DUTY]);
+#endif
+#ifdef CONFIG_CHARGER
+	if (pending & (1 << ACPI_DEFER_CHARGING_LIMIT)) {
+		data = acpi_deferred_data[ACPI_DEFER_CHARGING_LIMIT];
+		if (data == EC_ACPI_MEM_CHARGING_LIMIT_DISABLED) {
+			dptf_set_charging_current_limit(-1);
+		} else {
+			data *= EC_ACPI_MEM_CHARGING_LIMIT_STEP_MA;
+			dptf_set_charging_current_limit(data);
+		}
+	}
+#endif
+	(void)data;
+}
+DECLARE_DEFERRED(acpi_apply_deferred_writes);
+
+/* Charge the time spent on this byte to the operation it's part of. */
+static void acpi_account(enum acpi_op op, uint32_t start, int done)
+{
+#ifdef CONFIG_CMD_ACPISTATS
+	uint32_t us;
+
+	acpi_op_us += get_time().le.lo - start;
+	if (!done)
+		return;
+
+	us = acpi_op_us;
+	acpi_op_us = 0;
+	acpi_op_stats[op].count++;
+	acpi_op_stats[op].total_us += us;
+	if (acpi_op_stats[op].max_us < us)
+		acpi_op_stats[op].max_us = us;
+#endif
+}
+
 /*
  * This handles AP writes to the EC via the ACPI I/O port. There are only a few
  * ACPI commands (EC_CMD_ACPI_*), but they are all handled here.
@@ -111,11 +283,17 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 	int data = 0;
 	int retval = 0;
 	int result = 0xff;			/* value for bogus read */
+	uint32_t start = get_time().le.lo;
+	int op = -1, done = 0;
+	int i;
 
 	/* Read command/data; this clears the FRMH status bit. */
 	if (is_cmd) {
 		acpi_cmd = value;
 		acpi_data_count = 0;
+#ifdef CONFIG_CMD_ACPISTATS
+		acpi_op_us = 0;
+#endif
 	} else {
 		data = value;
 		/*
@@ -126,9 +304,33 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 			acpi_addr = data;
 	}
 
+	switch (acpi_cmd) {
+	case EC_CMD_ACPI_READ:
+		op = ACPI_OP_READ;
+		break;
+	case EC_CMD_ACPI_WRITE:
+		op = ACPI_OP_WRITE;
+		break;
+	case EC_CMD_ACPI_QUERY_EVENT:
+		op = ACPI_OP_QUERY;
+		break;
+	case EC_CMD_ACPI_BURST_ENABLE:
+	case EC_CMD_ACPI_BURST_DISABLE:
+		op = ACPI_OP_BURST;
+		break;
+	}
+
 	/* Process complete commands */
 	if (acpi_cmd == EC_CMD_ACPI_READ && acpi_data_count == 1) {
 		/* ACPI read cmd + addr */
+		i = acpi_deferred_write_index(acpi_addr);
+		if (i >= 0 && (acpi_deferred_pending & (1 << i))) {
+			/* Read back what was written, even if not applied yet */
+			*resultptr = acpi_deferred_data[i];
+			retval = done = 1;
+			goto out;
+		}
+
 		switch (acpi_addr) {
 		case EC_ACPI_MEM_VERSION:
 			result = EC_ACPI_MEM_VERSION_CURRENT;
@@ -170,30 +372,26 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 
 		/* Send the result byte */
 		*resultptr = result;
-		retval = 1;
+		retval = done = 1;
 
 	} else if (acpi_cmd == EC_CMD_ACPI_WRITE && acpi_data_count == 2) {
 		/* ACPI write cmd + addr + data */
+		done = 1;
+
+		i = acpi_deferred_write_index(acpi_addr);
+		if (i >= 0) {
+			if (acpi_deferred_pending & (1 << i))
+				ACPI_STAT_INC(acpi_writes_combined);
+			acpi_deferred_data[i] = data;
+			atomic_or(&acpi_deferred_pending, 1 << i);
+			hook_call_deferred(acpi_apply_deferred_writes, 0);
+			goto out;
+		}
+
 		switch (acpi_addr) {
 		case EC_ACPI_MEM_TEST:
 			acpi_mem_test = data;
 			break;
-#ifdef CONFIG_PWM_KBLIGHT
-		case EC_ACPI_MEM_KEYBOARD_BACKLIGHT:
-			/*
-			 * Debug output with CR not newline, because the host
-			 * does a lot of keyboard backlights and it scrolls the
-			 * debug console.
-			 */
-			CPRINTF("\r[%T ACPI kblight %d]", data);
-			pwm_set_duty(PWM_CH_KBLIGHT, data);
-			break;
-#endif
-#ifdef CONFIG_FANS
-		case EC_ACPI_MEM_FAN_DUTY:
-			dptf_set_fan_duty_target(data);
-			break;
-#endif
 #ifdef CONFIG_TEMP_SENSOR
 		case EC_ACPI_MEM_TEMP_ID:
 			dptf_temp_sensor_id = data;
@@ -210,16 +408,6 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 						idx, enable);
 			break;
 		}
-#endif
-#ifdef CONFIG_CHARGER
-		case EC_ACPI_MEM_CHARGING_LIMIT:
-			if (data == EC_ACPI_MEM_CHARGING_LIMIT_DISABLED) {
-				dptf_set_charging_current_limit(-1);
-			} else {
-				data *= EC_ACPI_MEM_CHARGING_LIMIT_STEP_MA;
-				dptf_set_charging_current_limit(data);
-			}
-			break;
 #endif
 		default:
 			CPRINTS("ACPI write 0x%02x = 0x%02x (ignored)",
@@ -231,7 +419,7 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 		int evt_index = lpc_query_host_event_state();
 		CPRINTS("ACPI query = %d", evt_index);
 		*resultptr = evt_index;
-		retval = 1;
+		retval = done = 1;
 	} else if (acpi_cmd == EC_CMD_ACPI_BURST_ENABLE && !acpi_data_count) {
 		/*
 		 * TODO: The kernel only enables BURST when doing multi-byte
@@ -240,8 +428,8 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 		 * so on LM4, for example, this is dead code. We might want
 		 * to add a config to skip this code for certain chips.
 		 */
-		acpi_read_cache.enabled = 1;
-		acpi_read_cache.start_addr = ACPI_READ_CACHE_FLUSHED;
+		acpi_read_cache_enabled = 1;
+		acpi_read_cache_flush();
 
 		/* Enter burst mode */
 		lpc_set_acpi_status_mask(EC_LPC_STATUS_BURST_MODE);
@@ -254,14 +442,52 @@ int acpi_ap_to_ec(int is_cmd, uint8_t value, uint8_t *resultptr)
 
 		/* ACPI 5.0-12.3.3: Burst ACK */
 		*resultptr = 0x90;
-		retval = 1;
+		retval = done = 1;
 	} else if (acpi_cmd == EC_CMD_ACPI_BURST_DISABLE && !acpi_data_count) {
-		acpi_read_cache.enabled = 0;
+		acpi_read_cache_enabled = 0;
 
 		/* Leave burst mode */
 		hook_call_deferred(acpi_disable_burst_deferred, -1);
 		lpc_clear_acpi_status_mask(EC_LPC_STATUS_BURST_MODE);
+		done = 1;
 	}
 
+out:
+	if (op >= 0)
+		acpi_account(op, start, done);
+
 	return retval;
 }
+
+#ifdef CONFIG_CMD_ACPISTATS
+static int command_acpistats(int argc, char **argv)
+{
+	int i;
+
+	if (argc > 1) {
+		if (strcasecmp(argv[1], "clear"))
+			return EC_ERROR_PARAM1;
+
+		memset(acpi_op_stats, 0, sizeof(acpi_op_stats));
+		acpi_cache_hits = acpi_cache_misses = 0;
+		acpi_cache_prefetches = acpi_writes_combined = 0;
+		return EC_SUCCESS;
+	}
+
+	ccprintf("op        count   total_us  max_us\n");
+	for (i = 0; i < ACPI_OP_COUNT; i++)
+		ccprintf("%-6s %8d %10d %7d\n", acpi_op_names[i],
+			 acpi_op_stats[i].count, acpi_op_stats[i].total_us,
+			 acpi_op_stats[i].max_us);
+
+	ccprintf("Burst cache: %d hits, %d misses, %d prefetched\n",
+		 acpi_cache_hits, acpi_cache_misses, acpi_cache_prefetches);
+	ccprintf("Writes combined: %d\n", acpi_writes_combined);
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(acpistats, command_acpistats,
+			"[clear]",
+			"Print ACPI transaction stats",
+			NULL);
+#endif
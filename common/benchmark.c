@@ -0,0 +1,304 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Microbenchmarks for common code. The same suite runs on the emulator (see
+ * test/benchmark.c) and on real hardware (the "benchmark" console command),
+ * and both print their results in the same JSON format so they can be
+ * compared and tracked over time.
+ */
+
+#ifdef BOARD_HOST
+#include <time.h>
+#endif
+
+#include "benchmark.h"
+#include "common.h"
+#include "console.h"
+#include "crc.h"
+#include "hooks.h"
+#include "host_command.h"
+#include "printf.h"
+#include "queue.h"
+#include "rsa.h"
+#include "sha256.h"
+#include "task.h"
+#include "timer.h"
+#include "util.h"
+#include "watchdog.h"
+
+/* Number of timed samples per benchmark; odd, so there's a true median */
+#define BENCHMARK_SAMPLES 15
+
+/* Make each sample at least this long, so the clock's resolution is lost */
+#define BENCHMARK_SAMPLE_NS (5 * MSEC * 1000)
+
+/* Don't let a trivial operation grow the batch forever */
+#define BENCHMARK_MAX_ITERATIONS (1 << 24)
+
+/*
+ * On the emulator, the EC clock is scaled and may not even be real time, so
+ * go straight to the host's clock.
+ */
+static uint64_t benchmark_now_ns(void)
+{
+#ifdef BOARD_HOST
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	return get_time().val * 1000;
+#endif
+}
+
+static uint64_t benchmark_batch(const struct benchmark_t *b,
+				uint32_t iterations)
+{
+	uint64_t start = benchmark_now_ns();
+	uint32_t i;
+
+	for (i = 0; i < iterations; i++)
+		b->run();
+
+	return benchmark_now_ns() - start;
+}
+
+int benchmark_run(const struct benchmark_t *b, struct benchmark_result *r)
+{
+	uint32_t ns[BENCHMARK_SAMPLES];
+	uint64_t total = 0;
+	uint32_t t;
+	int i, j;
+
+	if (b->setup)
+		b->setup();
+
+	/*
+	 * Double the batch until it's long enough to time. This warms up the
+	 * caches and whatever else along the way; run one more batch once
+	 * we're there, just to be sure.
+	 */
+	r->iterations = 1;
+	while (benchmark_batch(b, r->iterations) < BENCHMARK_SAMPLE_NS &&
+	       r->iterations < BENCHMARK_MAX_ITERATIONS)
+		r->iterations <<= 1;
+	benchmark_batch(b, r->iterations);
+	watchdog_reload();
+
+	for (i = 0; i < BENCHMARK_SAMPLES; i++) {
+		t = benchmark_batch(b, r->iterations) / r->iterations;
+		watchdog_reload();
+		total += t;
+
+		/* Keep the samples sorted, to find the median */
+		for (j = i; j > 0 && ns[j - 1] > t; j--)
+			ns[j] = ns[j - 1];
+		ns[j] = t;
+	}
+
+	r->samples = BENCHMARK_SAMPLES;
+	r->min_ns = ns[0];
+	r->median_ns = ns[BENCHMARK_SAMPLES / 2];
+	r->mean_ns = total / BENCHMARK_SAMPLES;
+	r->max_ns = ns[BENCHMARK_SAMPLES - 1];
+
+	return EC_SUCCESS;
+}
+
+void benchmark_print(const struct benchmark_t *b,
+		     const struct benchmark_result *r)
+{
+	ccprintf("{\"benchmark\": \"%s\", \"iterations\": %d, "
+		 "\"samples\": %d, \"min_ns\": %d, \"median_ns\": %d, "
+		 "\"mean_ns\": %d, \"max_ns\": %d}\n",
+		 b->name, r->iterations, r->samples, r->min_ns, r->median_ns,
+		 r->mean_ns, r->max_ns);
+	cflush();
+}
+
+/*****************************************************************************/
+/* Benchmarks */
+
+static uint8_t bench_data[1024];
+
+static void bench_data_setup(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(bench_data); i++)
+		bench_data[i] = i * 7 + 3;
+}
+
+static struct queue const bench_queue = QUEUE_NULL(64, uint8_t);
+
+static void bench_queue_setup(void)
+{
+	queue_init(&bench_queue);
+}
+
+/* Fill the queue with a typical UART-sized chunk, then drain it */
+static void bench_queue_units(void)
+{
+	uint8_t buf[16];
+
+	queue_add_units(&bench_queue, bench_data, sizeof(buf));
+	queue_remove_units(&bench_queue, buf, sizeof(buf));
+}
+
+/* A representative console message */
+static void bench_vfnprintf(void)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof(buf), "[%d.%06d %s 0x%08x %c]", 12, 345678,
+		 "hello", 0xdeadbeef, 'x');
+}
+
+#ifdef CONFIG_SHA256
+static void bench_sha256(void)
+{
+	struct sha256_ctx ctx;
+
+	SHA256_init(&ctx);
+	SHA256_update(&ctx, bench_data, sizeof(bench_data));
+	SHA256_final(&ctx);
+}
+#endif
+
+#ifdef CONFIG_RSA
+static struct rsa_public_key bench_key;
+static uint8_t bench_signature[RSANUMBYTES];
+static uint32_t bench_rsa_workbuf[3 * RSANUMWORDS];
+
+/*
+ * The signature won't verify, but all the arithmetic happens before we can
+ * tell that, so it costs the same as one that does.
+ */
+static void bench_rsa_setup(void)
+{
+	uint32_t inv = 1;
+	uint32_t x = 0x12345678;
+	int i;
+
+	/* Any odd modulus of the right size will do */
+	for (i = 0; i < RSANUMWORDS; i++) {
+		x = x * 1664525 + 1013904223;
+		bench_key.n[i] = x;
+		bench_key.rr[i] = x ^ 0x5a5a5a5a;
+	}
+	bench_key.n[0] |= 1;
+	bench_key.n[RSANUMWORDS - 1] |= 0x80000000;
+
+	/* Newton's method for 1 / n[0] mod 2^32, doubling the bits each time */
+	for (i = 0; i < 5; i++)
+		inv *= 2 - bench_key.n[0] * inv;
+	bench_key.n0inv = -inv;
+
+	for (i = 0; i < RSANUMBYTES; i++)
+		bench_signature[i] = bench_data[i % sizeof(bench_data)];
+	bench_signature[RSANUMBYTES - 1] = 0;
+}
+
+static void bench_rsa_verify(void)
+{
+	rsa_verify(&bench_key, bench_signature, bench_data, bench_rsa_workbuf);
+}
+#endif
+
+#if defined(CONFIG_SW_CRC) || defined(CONFIG_HW_CRC)
+static void bench_crc32(void)
+{
+	const uint32_t *p = (const uint32_t *)bench_data;
+	int i;
+
+	crc32_init();
+	for (i = 0; i < 64; i++)
+		crc32_hash32(p[i]);
+	crc32_result();
+}
+
+static void bench_crc32_ctx(void)
+{
+	uint32_t ctx;
+
+	crc32_ctx_init(&ctx);
+	crc32_ctx_hash(&ctx, bench_data, sizeof(bench_data));
+	crc32_ctx_result(&ctx);
+}
+#endif
+
+#ifdef HAS_TASK_HOSTCMD
+/* A command nobody implements, so we have to look through the whole table */
+static void bench_find_host_command(void)
+{
+	find_host_command(-1);
+}
+#endif
+
+static void bench_deferred(void)
+{
+}
+DECLARE_DEFERRED(bench_deferred);
+
+/* Schedule a deferred call, then cancel it so it never runs */
+static void bench_hook_call_deferred(void)
+{
+	hook_call_deferred(bench_deferred, SECOND);
+	hook_call_deferred(bench_deferred, -1);
+}
+
+static struct mutex bench_mtx;
+
+static void bench_mutex(void)
+{
+	mutex_lock(&bench_mtx);
+	mutex_unlock(&bench_mtx);
+}
+
+const struct benchmark_t benchmarks[] = {
+	{"queue_units", bench_queue_setup, bench_queue_units},
+	{"vfnprintf", NULL, bench_vfnprintf},
+#ifdef CONFIG_SHA256
+	{"sha256_1k", bench_data_setup, bench_sha256},
+#endif
+#ifdef CONFIG_RSA
+	{"rsa_verify", bench_rsa_setup, bench_rsa_verify},
+#endif
+#if defined(CONFIG_SW_CRC) || defined(CONFIG_HW_CRC)
+	{"crc32_256b", bench_data_setup, bench_crc32},
+	{"crc32_ctx_1k", bench_data_setup, bench_crc32_ctx},
+#endif
+#ifdef HAS_TASK_HOSTCMD
+	{"find_host_command", NULL, bench_find_host_command},
+#endif
+	{"hook_call_deferred", NULL, bench_hook_call_deferred},
+	{"mutex_lock", NULL, bench_mutex},
+};
+const int benchmark_count = ARRAY_SIZE(benchmarks);
+
+/*****************************************************************************/
+/* Console commands */
+
+static int command_benchmark(int argc, char **argv)
+{
+	struct benchmark_result r;
+	int i, found = 0;
+
+	for (i = 0; i < benchmark_count; i++) {
+		if (argc > 1 && strcasecmp(argv[1], benchmarks[i].name))
+			continue;
+
+		found = 1;
+		benchmark_run(benchmarks + i, &r);
+		benchmark_print(benchmarks + i, &r);
+	}
+
+	return found ? EC_SUCCESS : EC_ERROR_PARAM1;
+}
+DECLARE_CONSOLE_COMMAND(benchmark, command_benchmark,
+			"[name]",
+			"Time common code, printing JSON results",
+			NULL);
@@ -23,6 +23,7 @@ common-$(CONFIG_BACKLIGHT_LID)+=backlight_lid.o
 common-$(CONFIG_BATTERY_BQ27541)+=battery.o
 common-$(CONFIG_BATTERY_BQ27621)+=battery.o
 common-$(CONFIG_BATTERY_SMART)+=battery.o
+common-$(CONFIG_BENCHMARK)+=benchmark.o
 common-$(CONFIG_BUTTON_COUNT)+=button.o
 common-$(CONFIG_CAPSENSE)+=capsense.o
 common-$(CONFIG_CASE_CLOSED_DEBUG)+=case_closed_debug.o
@@ -53,6 +54,7 @@ common-$(CONFIG_HOSTCMD_PD)+=host_command_master.o
 common-$(CONFIG_I2C)+=i2c.o
 common-$(CONFIG_I2C_ARBITRATION)+=i2c_arbitration.o
 common-$(CONFIG_INDUCTIVE_CHARGING)+=inductive_charging.o
+common-$(CONFIG_KEYBOARD_LATENCY)+=keyboard_latency.o
 common-$(CONFIG_KEYBOARD_PROTOCOL_8042)+=keyboard_8042.o \
 	keyboard_8042_sharedlib.o
 common-$(CONFIG_KEYBOARD_PROTOCOL_MKBP)+=keyboard_mkbp.o
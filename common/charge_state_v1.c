@@ -67,6 +67,8 @@ static void update_battery_info(void)
 	char *batt_str;
 	int batt_serial;
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+
 	/* Design Capacity of Full */
 	battery_design_capacity((int *)host_get_memmap(EC_MEMMAP_BATT_DCAP));
 
@@ -102,6 +104,8 @@ static void update_battery_info(void)
 
 	/* Battery data is now present */
 	*host_get_memmap(EC_MEMMAP_BATTERY_VERSION) = 1;
+
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
 }
 
 /**
@@ -227,8 +231,14 @@ static int state_common(struct charge_state_context *ctx)
 		}
 	}
 
-	if (curr->ac) {
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+	if (curr->ac)
 		*batt_flags |= EC_BATT_FLAG_AC_PRESENT;
+	else
+		*batt_flags &= ~EC_BATT_FLAG_AC_PRESENT;
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+
+	if (curr->ac) {
 		if (charger_get_voltage(&curr->charging_voltage)) {
 			charge_request(0, 0);
 			curr->error |= F_CHARGER_VOLTAGE;
@@ -244,7 +254,6 @@ static int state_common(struct charge_state_context *ctx)
 		}
 #endif
 	} else {
-		*batt_flags &= ~EC_BATT_FLAG_AC_PRESENT;
 		/* AC disconnected should get us out of force idle mode. */
 		state_machine_force_idle = 0;
 	}
@@ -298,6 +307,8 @@ static int state_common(struct charge_state_context *ctx)
 	if (batt->flags & BATT_FLAG_BAD_STATE_OF_CHARGE)
 		curr->error |= F_BATTERY_STATE_OF_CHARGE;
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+
 	*ctx->memmap_batt_volt = batt->voltage;
 
 	/* Memory mapped value: discharge rate */
@@ -319,6 +330,8 @@ static int state_common(struct charge_state_context *ctx)
 		}
 	}
 
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+
 	/* Prevent deep discharging */
 	if (!curr->ac) {
 		if ((batt->state_of_charge < BATTERY_LEVEL_SHUTDOWN &&
@@ -328,9 +341,12 @@ static int state_common(struct charge_state_context *ctx)
 			low_battery_shutdown(ctx);
 	}
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+
 	/* Check battery presence */
 	if (curr->error & F_BATTERY_MASK) {
 		*ctx->memmap_batt_flags &= ~EC_BATT_FLAG_BATT_PRESENT;
+		host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
 		return curr->error;
 	}
 
@@ -351,6 +367,8 @@ static int state_common(struct charge_state_context *ctx)
 		*ctx->memmap_batt_flags &= ~EC_BATT_FLAG_LEVEL_CRITICAL;
 	}
 
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+
 #ifdef CONFIG_BATTERY_OVERRIDE_PARAMS
 	/* Apply battery pack vendor charging method */
 	battery_override_params(batt);
@@ -363,6 +381,7 @@ static int state_common(struct charge_state_context *ctx)
 	if (batt->desired_current > user_current_limit)
 		batt->desired_current = user_current_limit;
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
 	if (fake_state_of_charge >= 0)
 		*ctx->memmap_batt_cap =
 			fake_state_of_charge *
@@ -371,6 +390,7 @@ static int state_common(struct charge_state_context *ctx)
 		ctx->curr.error |= F_BATTERY_CAPACITY;
 	else
 		*ctx->memmap_batt_cap = d;
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
 
 	return ctx->curr.error;
 }
@@ -809,6 +829,7 @@ void charger_task(void)
 			hook_notify(HOOK_CHARGE_STATE_CHANGE);
 		}
 
+		host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
 		switch (new_state) {
 		case PWR_STATE_IDLE0:
 			/*
@@ -864,6 +885,7 @@ void charger_task(void)
 			/* Other state; poll quickly and hope it goes away */
 			sleep_usec = CHARGE_POLL_PERIOD_SHORT;
 		}
+		host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
 
 		/* Show charging progress in console */
 		charging_progress(ctx);
@@ -920,10 +942,12 @@ static void ac_change_hook(void)
 	 * state is correct prior to the host being notified of the AC
 	 * change event.
 	 */
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
 	if (extpower_is_present())
 		*task_ctx.memmap_batt_flags |= EC_BATT_FLAG_AC_PRESENT;
 	else
 		*task_ctx.memmap_batt_flags &= ~EC_BATT_FLAG_AC_PRESENT;
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
 
 	/* Wake up the task now */
 	task_wake(TASK_ID_CHARGER);
@@ -7,6 +7,7 @@
 
 #include "battery.h"
 #include "battery_smart.h"
+#include "charge_ramp.h"
 #include "charge_state.h"
 #include "charger.h"
 #include "chipset.h"
@@ -124,6 +125,8 @@ static int update_static_battery_info(void)
 	 */
 	int rv;
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+
 	/* Smart battery serial number is 16 bits */
 	batt_str = (char *)host_get_memmap(EC_MEMMAP_BATT_SERIAL);
 	memset(batt_str, 0, EC_MEMMAP_TEXT_MAX);
@@ -173,6 +176,8 @@ static int update_static_battery_info(void)
 		/* No errors seen. Battery data is now present */
 		*host_get_memmap(EC_MEMMAP_BATTERY_VERSION) = 1;
 
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+
 	return rv;
 }
 
@@ -211,6 +216,8 @@ static void update_dynamic_battery_info(void)
 		batt_present = 0;
 	}
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+
 	if (!(curr.batt.flags & BATT_FLAG_BAD_VOLTAGE))
 		*memmap_volt = curr.batt.voltage;
 
@@ -252,6 +259,8 @@ static void update_dynamic_battery_info(void)
 	/* Update flags before sending host events. */
 	*memmap_flags = tmp;
 
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+
 	if (send_batt_info_event)
 		host_set_single_event(EC_HOST_EVENT_BATTERY);
 	if (send_batt_status_event)
@@ -543,6 +552,100 @@ void charger_init(void)
 }
 DECLARE_HOOK(HOOK_INIT, charger_init, HOOK_PRIO_DEFAULT);
 
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+/*
+ * Number of polls in a row which found the battery full or idle, with nothing
+ * changed since the poll before. Each one doubles the poll period.
+ */
+static int settled_polls;
+static struct {
+	enum charge_state_v2 state;
+	int ac;
+	int soc;
+	int voltage;
+	int current;
+} last_poll;
+
+/* Has anything changed that we'd want to keep an eye on? */
+static int poll_state_changed(void)
+{
+	int changed = last_poll.state != curr.state ||
+		last_poll.ac != curr.ac ||
+		last_poll.soc != curr.batt.state_of_charge ||
+		last_poll.voltage != curr.requested_voltage ||
+		last_poll.current != curr.requested_current;
+
+	last_poll.state = curr.state;
+	last_poll.ac = curr.ac;
+	last_poll.soc = curr.batt.state_of_charge;
+	last_poll.voltage = curr.requested_voltage;
+	last_poll.current = curr.requested_current;
+	return changed;
+}
+
+/*
+ * Pick the poll period when the profile doesn't have an opinion. Transitions
+ * (precharge, the constant-voltage taper, input current ramping) are watched
+ * closely. Bulk charging less so. Once the battery is full, or idle, with the
+ * AP off or suspended, we back off exponentially until something wakes us.
+ */
+static int adaptive_poll_period(void)
+{
+	int changed = poll_state_changed();
+	int settled;
+
+	if (curr.state == ST_PRECHARGE)
+		return CHARGE_POLL_PERIOD_SHORT;
+
+#ifdef CONFIG_CHARGE_RAMP
+	if (curr.ac && chg_ramp_is_detected() && !chg_ramp_is_stable())
+		return CHARGE_POLL_PERIOD_SHORT;
+#endif
+
+	if (curr.state == ST_CHARGE && !is_full) {
+		/* Within about 3% of the target voltage means we're tapering */
+		if (curr.batt.voltage >=
+		    curr.requested_voltage - curr.requested_voltage / 32)
+			return CHARGE_POLL_PERIOD_CHARGE;
+		return CHARGE_POLL_PERIOD_LONG;
+	}
+
+	settled = (curr.state == ST_CHARGE && is_full) ||
+		((curr.state == ST_IDLE || curr.state == ST_DISCHARGE) &&
+		 chipset_in_state(CHIPSET_STATE_ANY_OFF |
+				  CHIPSET_STATE_SUSPEND) &&
+		 curr.batt.state_of_charge > BATTERY_LEVEL_LOW);
+
+	if (changed || !settled) {
+		settled_polls = 0;
+		return curr.state == ST_CHARGE ? CHARGE_POLL_PERIOD_CHARGE :
+			CHARGE_POLL_PERIOD_LONG;
+	}
+
+	/*
+	 * With the AP running, the battery safety checks and the battery data
+	 * in the host memory map mustn't go stale, so don't back off at all.
+	 */
+	if (!chipset_in_state(CHIPSET_STATE_ANY_OFF | CHIPSET_STATE_SUSPEND)) {
+		settled_polls = 0;
+		return CHARGE_POLL_PERIOD_LONG;
+	}
+
+	if ((CHARGE_MAX_SLEEP_USEC << settled_polls) <
+	    CHARGE_POLL_PERIOD_VERY_LONG)
+		settled_polls++;
+
+	return MIN(CHARGE_MAX_SLEEP_USEC << settled_polls,
+		   CHARGE_POLL_PERIOD_VERY_LONG);
+}
+
+/* Wake up the task right away when the charger or battery needs attention */
+void charger_alert_interrupt(enum gpio_signal signal)
+{
+	task_wake(TASK_ID_CHARGER);
+}
+#endif
+
 /* Main loop */
 void charger_task(void)
 {
@@ -851,6 +954,9 @@ wait_for_it:
 			/* If there are errors, don't wait very long. */
 			sleep_usec = CHARGE_POLL_PERIOD_SHORT;
 		else if (sleep_usec <= 0) {
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+			sleep_usec = adaptive_poll_period();
+#else
 			/* default values depend on the state */
 			if (curr.state == ST_IDLE ||
 			    curr.state == ST_DISCHARGE) {
@@ -866,16 +972,29 @@ wait_for_it:
 				/* Charging, so pay closer attention */
 				sleep_usec = CHARGE_POLL_PERIOD_CHARGE;
 			}
+#endif
 		}
 
 		/* Adjust for time spent in this loop */
 		sleep_usec -= (int)(get_time().val - curr.ts.val);
 		if (sleep_usec < CHARGE_MIN_SLEEP_USEC)
 			sleep_usec = CHARGE_MIN_SLEEP_USEC;
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+		else if (settled_polls) {
+			if (sleep_usec > CHARGE_POLL_PERIOD_VERY_LONG)
+				sleep_usec = CHARGE_POLL_PERIOD_VERY_LONG;
+		}
+#endif
 		else if (sleep_usec > CHARGE_MAX_SLEEP_USEC)
 			sleep_usec = CHARGE_MAX_SLEEP_USEC;
 
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+		/* Anything other than a timeout means something happened */
+		if (task_wait_event(sleep_usec) & ~TASK_EVENT_TIMER)
+			settled_polls = 0;
+#else
 		task_wait_event(sleep_usec);
+#endif
 	}
 }
 
@@ -992,6 +1111,10 @@ int charge_set_input_current_limit(int ma)
 	ma = MIN(ma, CONFIG_CHARGER_MAX_INPUT_CURRENT);
 #endif
 	curr.desired_input_current = ma;
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+	/* Let the task catch up with the new supplier */
+	task_wake(TASK_ID_CHARGER);
+#endif
 	return charger_set_input_current(ma);
 }
 
@@ -55,10 +55,12 @@ static void extpower_init(void)
 	debounced_extpower_presence = gpio_get_level(GPIO_AC_PRESENT);
 
 	/* Initialize the memory-mapped AC_PRESENT flag */
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
 	if (debounced_extpower_presence)
 		*memmap_batt_flags |= EC_BATT_FLAG_AC_PRESENT;
 	else
 		*memmap_batt_flags &= ~EC_BATT_FLAG_AC_PRESENT;
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
 
 	/* Enable interrupts, now that we've initialized */
 	gpio_enable_interrupt(GPIO_AC_PRESENT);
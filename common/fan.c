@@ -11,6 +11,7 @@
 #include "gpio.h"
 #include "hooks.h"
 #include "host_command.h"
+#include "math_util.h"
 #include "printf.h"
 #include "system.h"
 #include "util.h"
@@ -24,6 +25,43 @@ static int thermal_control_enabled[CONFIG_FANS];
 static int fan_update_counter[CONFIG_FANS];
 #endif
 
+#ifdef CONFIG_FAN_PID
+/*
+ * Default gains.  Each term's output is in per-mille duty, and is the gain
+ * times the error in rpm (summed over ticks for ki, difference from the last
+ * tick for kd) divided by 1024.
+ */
+#define FAN_PID_KP 64
+#define FAN_PID_KI 16
+#define FAN_PID_KD 0
+
+/* Weight of the newest tach reading in the filter, as 1/N */
+#define FAN_PID_FILTER 4
+
+/* Setpoint change per tick allowed by CONFIG_FAN_PID_SLEW_RPM */
+#define FAN_PID_SLEW_STEP \
+	(CONFIG_FAN_PID_SLEW_RPM * (HOOK_TICK_INTERVAL / MSEC) / 1000)
+
+/* Ticks below a quarter of rpm_min before calling it a stall, and kick time */
+#define FAN_PID_STALL_TICKS ((SECOND + HOOK_TICK_INTERVAL - 1) / \
+			     HOOK_TICK_INTERVAL)
+#define FAN_PID_RESTART_TICKS FAN_PID_STALL_TICKS
+
+static struct fan_pid {
+	int target;		/* rpm asked for by the thermal engine */
+	int setpoint;		/* rpm we're steering for right now */
+	int filtered;		/* Filtered tach reading, in rpm */
+	int integral;		/* Sum of errors, in rpm * ticks */
+	int last_err;
+	int duty;		/* Output, in per-mille */
+	int ff, p, i, d;	/* Last output terms, in per-mille */
+	int kp, ki, kd;
+	int stall_ticks;	/* Ticks the fan has looked stalled */
+	int restart_ticks;	/* Ticks left at full duty to restart it */
+	uint32_t stalls;
+} fan_pid[CONFIG_FANS];
+#endif
+
 #ifndef CONFIG_FAN_RPM_CUSTOM
 /* This is the default implementation. It's only called over [0,100].
  * Convert the percentage to a target RPM. We can't simply scale all
@@ -62,6 +100,19 @@ test_mockable void fan_set_percent_needed(int fan, int pct)
 #endif
 
 	new_rpm = fan_percent_to_rpm(fan, pct);
+
+#ifdef CONFIG_FAN_PID
+	/*
+	 * Don't chase small changes; the controller spins up from a stop and
+	 * ramps between speeds by itself.
+	 */
+	if (!new_rpm || !fan_pid[fan].target ||
+	    ABS(new_rpm - fan_pid[fan].target) >=
+	    CONFIG_FAN_PID_HYSTERESIS_RPM)
+		fan_pid[fan].target = new_rpm;
+	return;
+#endif
+
 	actual_rpm = fan_get_rpm_actual(fans[fan].ch);
 
 	/* If we want to turn and the fans are currently significantly below
@@ -83,13 +134,129 @@ static void set_enabled(int fan, int enable)
 		gpio_set_level(fans[fan].enable_gpio, enable);
 }
 
+#ifdef CONFIG_FAN_PID
+/* Start the controller over, from whatever speed the fan is doing now. */
+static void fan_pid_reset(int fan, int target)
+{
+	struct fan_pid *c = fan_pid + fan;
+
+	c->target = target;
+	c->filtered = fan_get_rpm_actual(fans[fan].ch);
+	c->setpoint = c->filtered;
+	c->integral = c->last_err = 0;
+	c->stall_ticks = c->restart_ticks = 0;
+}
+
+test_export_static void fan_pid_update(int fan)
+{
+	const struct fan_t *f = fans + fan;
+	struct fan_pid *c = fan_pid + fan;
+	int rpm = fan_get_rpm_actual(f->ch);
+	int err, duty, limit;
+
+	c->filtered += (rpm - c->filtered) / FAN_PID_FILTER;
+
+	if (!c->target) {
+		c->setpoint = c->integral = c->last_err = 0;
+		c->stall_ticks = c->restart_ticks = 0;
+		c->ff = c->p = c->i = c->d = c->duty = 0;
+		fan_set_duty(f->ch, 0);
+		return;
+	}
+
+	/* Kick a stalled fan at full duty, then ramp from the start speed */
+	if (c->restart_ticks) {
+		if (!--c->restart_ticks) {
+			c->filtered = rpm;
+			c->setpoint = f->rpm_start;
+		}
+		c->duty = 1000;
+		fan_set_duty(f->ch, 100);
+		return;
+	}
+
+	/* Move the setpoint toward the target no faster than the slew rate */
+	if (!c->setpoint)
+		c->setpoint = f->rpm_start;
+	else if (c->target > c->setpoint)
+		c->setpoint = MIN(c->setpoint + FAN_PID_SLEW_STEP, c->target);
+	else
+		c->setpoint = MAX(c->setpoint - FAN_PID_SLEW_STEP, c->target);
+
+	err = c->setpoint - c->filtered;
+
+	/*
+	 * Don't let the integral term wind up past full scale.  With no
+	 * integral gain there's no term, so don't keep a sum that would only
+	 * grow until it overflowed.
+	 */
+	if (c->ki) {
+		c->integral += err;
+		limit = 1000 * 1024 / ABS(c->ki);
+		c->integral = MIN(MAX(c->integral, -limit), limit);
+	} else {
+		c->integral = 0;
+	}
+
+	/* Fans are close enough to linear for duty ~ rpm to get us most of the
+	 * way there; the PID terms take care of the rest. */
+	c->ff = c->setpoint * 1000 / f->rpm_max;
+	c->p = c->kp * err / 1024;
+	c->i = c->ki * c->integral / 1024;
+	c->d = c->kd * (err - c->last_err) / 1024;
+	c->last_err = err;
+
+	duty = c->ff + c->p + c->i + c->d;
+	c->duty = MIN(MAX(duty, 0), 1000);
+	fan_set_duty(f->ch, (c->duty + 5) / 10);
+
+	if (fan_is_stalled(f->ch) || c->filtered < f->rpm_min / 4) {
+		if (++c->stall_ticks >= FAN_PID_STALL_TICKS) {
+			cprints(CC_PWM, "Fan %d stalled; restarting", fan);
+			c->stalls++;
+			c->stall_ticks = 0;
+			c->integral = 0;
+			c->restart_ticks = FAN_PID_RESTART_TICKS;
+		}
+	} else {
+		c->stall_ticks = 0;
+	}
+}
+#endif
+
 static void set_thermal_control_enabled(int fan, int enable)
 {
 	thermal_control_enabled[fan] = enable;
 
+#ifdef CONFIG_FAN_PID
+	/* We drive the duty cycle ourselves */
+	if (enable) {
+		fan_set_rpm_mode(fans[fan].ch, 0);
+		fan_pid_reset(fan, fan_pid[fan].target);
+	}
+#else
 	/* If controlling the fan, need it in RPM-control mode */
 	if (enable)
 		fan_set_rpm_mode(fans[fan].ch, 1);
+#endif
+}
+
+/* Set the target while under thermal control */
+static void set_thermal_rpm_target(int fan, int rpm)
+{
+#ifdef CONFIG_FAN_PID
+	fan_pid[fan].target = rpm;
+#endif
+	fan_set_rpm_target(fans[fan].ch, rpm);
+}
+
+static int get_rpm_target(int fan)
+{
+#ifdef CONFIG_FAN_PID
+	if (thermal_control_enabled[fan])
+		return fan_pid[fan].target;
+#endif
+	return fan_get_rpm_target(fans[fan].ch);
 }
 
 static void set_duty_cycle(int fan, int percent)
@@ -166,7 +333,7 @@ static int cc_faninfo(int argc, char **argv)
 		ccprintf("%sActual: %4d rpm\n", leader,
 			 fan_get_rpm_actual(fans[fan].ch));
 		ccprintf("%sTarget: %4d rpm\n", leader,
-			 fan_get_rpm_target(fans[fan].ch));
+			 get_rpm_target(fan));
 		ccprintf("%sDuty:   %d%%\n", leader,
 			 fan_get_duty(fans[fan].ch));
 		tmp = fan_get_status(fans[fan].ch);
@@ -182,6 +349,13 @@ static int cc_faninfo(int argc, char **argv)
 		if (is_pgood >= 0)
 			ccprintf("%sPower:  %s\n", leader,
 				 is_pgood ? "yes" : "no");
+#ifdef CONFIG_FAN_PID
+		ccprintf("%sPID:    setpoint %d rpm, filtered %d rpm, "
+			 "duty %d.%d%%, %d stalls\n", leader,
+			 fan_pid[fan].setpoint, fan_pid[fan].filtered,
+			 fan_pid[fan].duty / 10, fan_pid[fan].duty % 10,
+			 fan_pid[fan].stalls);
+#endif
 	}
 
 	return EC_SUCCESS;
@@ -318,7 +492,7 @@ static int hc_pwm_get_fan_target_rpm(struct host_cmd_handler_args *args)
 	int fan = 0;
 
 	/* TODO(crosbug.com/p/23803) */
-	r->rpm = fan_get_rpm_target(fans[fan].ch);
+	r->rpm = get_rpm_target(fan);
 	args->response_size = sizeof(*r);
 
 	return EC_RES_SUCCESS;
@@ -412,6 +586,45 @@ DECLARE_HOST_COMMAND(EC_CMD_THERMAL_AUTO_FAN_CTRL,
 		     hc_thermal_auto_fan_ctrl,
 		     EC_VER_MASK(0)|EC_VER_MASK(1));
 
+#ifdef CONFIG_FAN_PID
+static int hc_pwm_fan_pid(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_pwm_fan_pid *p = args->params;
+	struct ec_response_pwm_fan_pid *r = args->response;
+	struct fan_pid *c;
+
+	if (p->fan_idx >= CONFIG_FANS)
+		return EC_RES_INVALID_PARAM;
+	c = fan_pid + p->fan_idx;
+
+	if (p->flags & EC_FAN_PID_SET_GAINS) {
+		c->kp = p->kp;
+		c->ki = p->ki;
+		c->kd = p->kd;
+		c->integral = 0;
+	}
+
+	r->target_rpm = c->target;
+	r->setpoint_rpm = c->setpoint;
+	r->filtered_rpm = c->filtered;
+	r->duty = c->duty;
+	r->ff = c->ff;
+	r->p = c->p;
+	r->i = c->i;
+	r->d = c->d;
+	r->kp = c->kp;
+	r->ki = c->ki;
+	r->kd = c->kd;
+	r->stalls = c->stalls;
+
+	args->response_size = sizeof(*r);
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_PWM_FAN_PID,
+		     hc_pwm_fan_pid,
+		     EC_VER_MASK(0));
+#endif
+
 
 /*****************************************************************************/
 /* Hooks */
@@ -444,18 +657,26 @@ static void pwm_fan_init(void)
 	for (fan = 0; fan < CONFIG_FANS; fan++)
 		fan_channel_setup(fans[fan].ch, fans[fan].flags);
 
+#ifdef CONFIG_FAN_PID
+	for (fan = 0; fan < CONFIG_FANS; fan++) {
+		fan_pid[fan].kp = FAN_PID_KP;
+		fan_pid[fan].ki = FAN_PID_KI;
+		fan_pid[fan].kd = FAN_PID_KD;
+	}
+#endif
+
 	prev = (const struct pwm_fan_state *)
 		system_get_jump_tag(PWMFAN_SYSJUMP_TAG, &version, &size);
 	if (prev && version == PWM_HOOK_VERSION && size == sizeof(*prev)) {
 		/* Restore previous state. */
 		for (fan = 0; fan < CONFIG_FANS; fan++) {
 			fan_set_enabled(fans[fan].ch, prev->fan_en);
-			fan_set_rpm_target(fans[fan].ch, prev->fan_rpm);
+			set_thermal_rpm_target(fan, prev->fan_rpm);
 		}
 	} else {
 		/* Set initial fan speed to maximum */
 		for (fan = 0; fan < CONFIG_FANS; fan++)
-			fan_set_rpm_target(fans[fan].ch, fans[fan].rpm_max);
+			set_thermal_rpm_target(fan, fans[fan].rpm_max);
 	}
 
 	for (fan = 0; fan < CONFIG_FANS; fan++)
@@ -463,8 +684,10 @@ static void pwm_fan_init(void)
 
 	/* Initialize memory-mapped data */
 	mapped = (uint16_t *)host_get_memmap(EC_MEMMAP_FAN);
+	host_memmap_begin_update(EC_MEMMAP_SEQ_THERMAL);
 	for (i = 0; i < EC_FAN_SPEED_ENTRIES; i++)
 		mapped[i] = EC_FAN_SPEED_NOT_PRESENT;
+	host_memmap_end_update(EC_MEMMAP_SEQ_THERMAL);
 }
 DECLARE_HOOK(HOOK_INIT, pwm_fan_init, HOOK_PRIO_DEFAULT);
 
@@ -475,6 +698,7 @@ static void pwm_fan_second(void)
 	int stalled = 0;
 	int fan;
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_THERMAL);
 	for (fan = 0; fan < CONFIG_FANS; fan++) {
 		if (fan_is_stalled(fans[fan].ch)) {
 			rpm = EC_FAN_SPEED_STALLED;
@@ -486,6 +710,7 @@ static void pwm_fan_second(void)
 
 		mapped[fan] = rpm;
 	}
+	host_memmap_end_update(EC_MEMMAP_SEQ_THERMAL);
 
 	/*
 	 * Issue warning.  As we have thermal shutdown
@@ -496,6 +721,18 @@ static void pwm_fan_second(void)
 }
 DECLARE_HOOK(HOOK_SECOND, pwm_fan_second, HOOK_PRIO_DEFAULT);
 
+#ifdef CONFIG_FAN_PID
+static void pwm_fan_tick(void)
+{
+	int fan;
+
+	for (fan = 0; fan < CONFIG_FANS; fan++)
+		if (thermal_control_enabled[fan])
+			fan_pid_update(fan);
+}
+DECLARE_HOOK(HOOK_TICK, pwm_fan_tick, HOOK_PRIO_DEFAULT);
+#endif
+
 static void pwm_fan_preserve_state(void)
 {
 	struct pwm_fan_state state;
@@ -503,7 +740,7 @@ static void pwm_fan_preserve_state(void)
 
 	/* TODO(crosbug.com/p/23530): Still treating all fans as one. */
 	state.fan_en = fan_get_enabled(fans[fan].ch);
-	state.fan_rpm = fan_get_rpm_target(fans[fan].ch);
+	state.fan_rpm = get_rpm_target(fan);
 
 	system_add_jump_tag(PWMFAN_SYSJUMP_TAG, PWM_HOOK_VERSION,
 			    sizeof(state), &state);
@@ -530,7 +767,7 @@ static void pwm_fan_S3_S5(void)
 		 * again if we need active cooling during heavy battery
 		 * charging or something.
 		 */
-		fan_set_rpm_target(fans[fan].ch, 0);
+		set_thermal_rpm_target(fan, 0);
 		fan_set_enabled(fans[fan].ch, 0); /* crosbug.com/p/8097 */
 	}
 }
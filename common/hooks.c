@@ -39,6 +39,7 @@ static const struct hook_ptrs hook_list[] = {
 	{__hooks_chipset_pre_init, __hooks_chipset_pre_init_end},
 	{__hooks_chipset_startup, __hooks_chipset_startup_end},
 	{__hooks_chipset_resume, __hooks_chipset_resume_end},
+	{__hooks_chipset_resume_deferred, __hooks_chipset_resume_deferred_end},
 	{__hooks_chipset_suspend, __hooks_chipset_suspend_end},
 	{__hooks_chipset_shutdown, __hooks_chipset_shutdown_end},
 	{__hooks_ac_change, __hooks_ac_change_end},
@@ -55,12 +56,19 @@ static uint64_t defer_until[DEFERRABLE_MAX_COUNT];
 static int defer_new_call;
 static int hook_task_started;
 
+/* HOOK_CHIPSET_RESUME is done; the hook task should finish resuming */
+static uint32_t resume_deferred_pending;
+
 #ifdef CONFIG_HOOK_DEBUG
 /* Stats for hooks */
 static uint64_t max_hook_tick_delay;
 static uint64_t max_hook_second_delay;
 static uint64_t max_hook_run_time[ARRAY_SIZE(hook_list)];
 
+/* Slowest single hook routine of each type */
+static void (*slowest_hook[ARRAY_SIZE(hook_list)])(void);
+static uint32_t slowest_hook_time[ARRAY_SIZE(hook_list)];
+
 static uint64_t avg_hook_tick_delay;
 static uint64_t avg_hook_second_delay;
 static uint64_t avg_hook_run_time[ARRAY_SIZE(hook_list)];
@@ -97,10 +105,19 @@ void hook_notify(enum hook_type type)
 #ifdef CONFIG_HOOK_DEBUG
 	uint64_t start_time = get_time().val;
 	uint64_t run_time;
+	uint32_t t;
 #endif
 
 	CPRINTS("hook notify %d", type);
 
+	/*
+	 * Suspending cancels any resume work the hook task hasn't started.
+	 * Do that first, since the hook task can run while the suspend hooks
+	 * below wait on I2C.
+	 */
+	if (type == HOOK_CHIPSET_SUSPEND)
+		atomic_clear(&resume_deferred_pending, 1);
+
 	start = hook_list[type].start;
 	end = hook_list[type].end;
 	count = end - start;
@@ -116,13 +133,39 @@ void hook_notify(enum hook_type type)
 
 		/* Call all the hooks with that priority */
 		for (p = start; p < end; p++) {
-			if (p->priority == prio) {
-				called++;
-				p->routine();
+			if (p->priority != prio)
+				continue;
+
+			called++;
+#ifdef CONFIG_HOOK_DEBUG
+			t = get_time().le.lo;
+#endif
+			p->routine();
+#ifdef CONFIG_HOOK_DEBUG
+			t = get_time().le.lo - t;
+			if (t > slowest_hook_time[type]) {
+				slowest_hook_time[type] = t;
+				slowest_hook[type] = p->routine;
 			}
+
+			/* Resume latency matters, so show where it goes */
+			if (type == HOOK_CHIPSET_RESUME ||
+			    type == HOOK_CHIPSET_RESUME_DEFERRED)
+				CPRINTS("hook 0x%p took %d us", p->routine, t);
+#endif
 		}
 	}
 
+	/*
+	 * Leave the rest of resuming to the hook task, unless we suspend
+	 * again before it gets to it.
+	 */
+	if (type == HOOK_CHIPSET_RESUME) {
+		atomic_or(&resume_deferred_pending, 1);
+		if (hook_task_started)
+			task_wake(TASK_ID_HOOKS);
+	}
+
 #ifdef CONFIG_HOOK_DEBUG
 	run_time = get_time().val - start_time;
 	if (run_time > max_hook_run_time[type])
@@ -186,6 +229,9 @@ void hook_task(void)
 		int next = 0;
 		int i;
 
+		if (atomic_read_clear(&resume_deferred_pending))
+			hook_notify(HOOK_CHIPSET_RESUME_DEFERRED);
+
 		/* Handle deferred routines */
 		for (i = 0; i < DEFERRED_FUNCS_COUNT; i++) {
 			if (defer_until[i] && defer_until[i] < t) {
@@ -274,9 +320,10 @@ static int command_stats(int argc, char **argv)
 
 	ccprintf("Max run time for each hook:\n");
 	for (i = 0; i < ARRAY_SIZE(hook_list); ++i)
-		ccprintf("%3d:%6d us (Avg: %5d us)\n", i,
+		ccprintf("%3d:%6d us (Avg: %5d us, slowest 0x%p %d us)\n", i,
 			 (uint32_t)max_hook_run_time[i],
-			 (uint32_t)avg_hook_run_time[i]);
+			 (uint32_t)avg_hook_run_time[i],
+			 slowest_hook[i], slowest_hook_time[i]);
 
 	return EC_SUCCESS;
 }
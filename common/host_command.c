@@ -39,6 +39,9 @@ static int g_vboot_mode;
 static uint8_t host_memmap[EC_MEMMAP_SIZE] __aligned(4);
 #endif
 
+/* Updates in progress to each memmap region; see host_memmap_begin_update() */
+static uint8_t memmap_writers[EC_MEMMAP_SEQ_COUNT];
+
 static enum {
 	HCDEBUG_OFF,     /* No host command debug output */
 	HCDEBUG_NORMAL,  /* Normal output mode; skips repeated commands */
@@ -81,6 +84,30 @@ uint8_t *host_get_memmap(int offset)
 #endif
 }
 
+void host_memmap_begin_update(int region)
+{
+	uint8_t *seq = host_get_memmap(EC_MEMMAP_SEQ) + region;
+
+	/*
+	 * Always leave the count odd, even if it was odd already because a
+	 * previous image jumped away in the middle of an update.
+	 */
+	interrupt_disable();
+	if (!memmap_writers[region]++)
+		*seq = (*seq + 1) | 1;
+	interrupt_enable();
+}
+
+void host_memmap_end_update(int region)
+{
+	uint8_t *seq = host_get_memmap(EC_MEMMAP_SEQ) + region;
+
+	interrupt_disable();
+	if (!--memmap_writers[region])
+		(*seq)++;
+	interrupt_enable();
+}
+
 int host_get_vboot_mode(void)
 {
 	return g_vboot_mode;
@@ -353,13 +380,7 @@ host_packet_bad:
 	host_packet_respond(&args0);
 }
 
-/**
- * Find a command by command number.
- *
- * @param command	Command number to find
- * @return The command structure, or NULL if no match found.
- */
-static const struct host_command *find_host_command(int command)
+const struct host_command *find_host_command(int command)
 {
 	const struct host_command *cmd;
 
@@ -376,7 +397,7 @@ static void host_command_init(void)
 	/* Initialize memory map ID area */
 	host_get_memmap(EC_MEMMAP_ID)[0] = 'E';
 	host_get_memmap(EC_MEMMAP_ID)[1] = 'C';
-	*host_get_memmap(EC_MEMMAP_ID_VERSION) = 1;
+	*host_get_memmap(EC_MEMMAP_ID_VERSION) = 2;
 	*host_get_memmap(EC_MEMMAP_EVENTS_VERSION) = 1;
 
 #ifdef CONFIG_HOSTCMD_EVENTS
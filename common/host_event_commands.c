@@ -6,11 +6,15 @@
 /* Host event commands for Chrome EC */
 
 #include "atomic.h"
+#include "chipset.h"
 #include "common.h"
 #include "console.h"
+#include "hooks.h"
 #include "host_command.h"
 #include "lpc.h"
 #include "mkbp_event.h"
+#include "task.h"
+#include "timer.h"
 #include "util.h"
 
 /* Console output macros */
@@ -38,24 +42,240 @@ uint32_t host_get_events(void)
 	return events;
 }
 
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+
+enum host_event_class {
+	HOST_EVENT_CLASS_BATTERY = 0,
+	HOST_EVENT_CLASS_THERMAL,
+	HOST_EVENT_CLASS_USB,
+
+	HOST_EVENT_CLASS_COUNT
+};
+
+/* Events which may be held back, by class */
+static const struct {
+	const char *name;
+	uint32_t mask;
+} event_classes[HOST_EVENT_CLASS_COUNT] = {
+	[HOST_EVENT_CLASS_BATTERY] = {"battery",
+		EC_HOST_EVENT_MASK(EC_HOST_EVENT_BATTERY) |
+		EC_HOST_EVENT_MASK(EC_HOST_EVENT_BATTERY_STATUS)},
+	[HOST_EVENT_CLASS_THERMAL] = {"thermal",
+		EC_HOST_EVENT_MASK(EC_HOST_EVENT_THERMAL_THRESHOLD) |
+		EC_HOST_EVENT_MASK(EC_HOST_EVENT_THERMAL)},
+	[HOST_EVENT_CLASS_USB] = {"usb",
+		EC_HOST_EVENT_MASK(EC_HOST_EVENT_USB_CHARGER) |
+		EC_HOST_EVENT_MASK(EC_HOST_EVENT_PD_MCU)},
+};
+
+/* Minimum time between signals for each class, in us */
+static uint32_t class_interval[HOST_EVENT_CLASS_COUNT] = {
+	[HOST_EVENT_CLASS_BATTERY] = CONFIG_HOSTCMD_EVENT_COALESCE_BATTERY,
+	[HOST_EVENT_CLASS_THERMAL] = CONFIG_HOSTCMD_EVENT_COALESCE_THERMAL,
+	[HOST_EVENT_CLASS_USB] = CONFIG_HOSTCMD_EVENT_COALESCE_USB,
+};
+static uint32_t coalesce_window = CONFIG_HOSTCMD_EVENT_COALESCE_WINDOW;
+
+/* When each class was last signaled, and when its held events are due */
+static uint64_t class_last[HOST_EVENT_CLASS_COUNT];
+static uint64_t class_due[HOST_EVENT_CLASS_COUNT];
+
+/* Events which are set, but which the host hasn't been told about yet */
+static uint32_t events_held;
+
+/* Events last passed on to the host */
+static uint32_t events_published;
+
+static struct {
+	/* Signals which told the host about new events */
+	uint32_t generated;
+	/* Events which joined a signal already being held */
+	uint32_t coalesced;
+	/* Events cleared again before the host was told about them */
+	uint32_t dropped;
+} coalesce_stats;
+
+static void host_events_flush(void);
+DECLARE_DEFERRED(host_events_flush);
+
+/*
+ * Return how long until the next held class is due, or -1 if nothing is
+ * held. Call with interrupts disabled.
+ */
+static int host_events_next_due(uint64_t now)
+{
+	uint64_t next = 0;
+	int i;
+
+	for (i = 0; i < HOST_EVENT_CLASS_COUNT; i++) {
+		if (!(events_held & event_classes[i].mask))
+			continue;
+		if (!next || class_due[i] < next)
+			next = class_due[i];
+	}
+
+	if (!next)
+		return -1;
+	return next > now ? next - now : 0;
+}
+
+/**
+ * Set events, holding back new ones in a coalesced class.
+ *
+ * @param mask		Events to set
+ * @return non-zero if every new event was held, so the host doesn't need to
+ * hear about this yet.
+ */
+static int host_events_coalesce(uint32_t mask)
+{
+	uint64_t now = get_time().val;
+	uint64_t due;
+	uint32_t fresh, immediate;
+	int delay;
+	int i;
+
+	if (!chipset_in_state(CHIPSET_STATE_ON)) {
+		atomic_or(&events, mask);
+		return 0;
+	}
+
+	interrupt_disable();
+
+	/* Events the host can already see don't need telling again */
+	fresh = mask & ~(events & ~events_held);
+	immediate = fresh;
+	events |= mask;
+
+	for (i = 0; i < HOST_EVENT_CLASS_COUNT; i++) {
+		uint32_t m = fresh & event_classes[i].mask;
+
+		if (!m)
+			continue;
+
+		if (events_held & event_classes[i].mask) {
+			/* Ride along with the signal that's already held */
+			coalesce_stats.coalesced++;
+		} else {
+			due = now + coalesce_window;
+			if (class_last[i] &&
+			    class_last[i] + class_interval[i] > due)
+				due = class_last[i] + class_interval[i];
+			if (due <= now) {
+				class_last[i] = now;
+				continue;
+			}
+			class_due[i] = due;
+		}
+
+		events_held |= m;
+		immediate &= ~m;
+	}
+
+	delay = host_events_next_due(now);
+
+	interrupt_enable();
+
+	if (delay >= 0)
+		hook_call_deferred(host_events_flush, delay);
+
+	return fresh && !immediate;
+}
+
+/* Drop held events which have been cleared again */
+static void host_events_unhold(uint32_t mask)
+{
+	interrupt_disable();
+	if (events_held & mask) {
+		coalesce_stats.dropped++;
+		events_held &= ~mask;
+	}
+	interrupt_enable();
+}
+#endif  /* CONFIG_HOSTCMD_EVENT_COALESCE */
+
+/* Pass the events the host is allowed to see on to it */
+static void host_events_publish(void)
+{
+	uint32_t visible = events;
+
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+	visible &= ~events_held;
+	if (visible & ~events_published)
+		coalesce_stats.generated++;
+	events_published = visible;
+#endif
+
+#ifdef CONFIG_LPC
+	lpc_set_host_event_state(visible);
+#else
+	*(uint32_t *)host_get_memmap(EC_MEMMAP_HOST_EVENTS) = visible;
+#endif
+
+#ifdef CONFIG_MKBP_EVENT
+	mkbp_send_event(EC_MKBP_EVENT_HOST_EVENT);
+#endif
+}
+
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+/* Signal the classes which are due, or everything if the AP has left S0 */
+static void host_events_flush(void)
+{
+	uint64_t now = get_time().val;
+	int all = !chipset_in_state(CHIPSET_STATE_ON);
+	int released = 0;
+	int delay;
+	int i;
+
+	interrupt_disable();
+
+	for (i = 0; i < HOST_EVENT_CLASS_COUNT; i++) {
+		if (!(events_held & event_classes[i].mask))
+			continue;
+		if (!all && class_due[i] > now)
+			continue;
+
+		events_held &= ~event_classes[i].mask;
+		class_last[i] = now;
+		released = 1;
+	}
+
+	delay = host_events_next_due(now);
+
+	interrupt_enable();
+
+	if (delay >= 0)
+		hook_call_deferred(host_events_flush, delay);
+	if (released)
+		host_events_publish();
+}
+
+/* Don't hold wake events back while the AP sleeps */
+static void host_events_chipset_suspend(void)
+{
+	hook_call_deferred(host_events_flush, 0);
+}
+DECLARE_HOOK(HOOK_CHIPSET_SUSPEND, host_events_chipset_suspend,
+	     HOOK_PRIO_DEFAULT);
+DECLARE_HOOK(HOOK_CHIPSET_SHUTDOWN, host_events_chipset_suspend,
+	     HOOK_PRIO_DEFAULT);
+#endif
+
 void host_set_events(uint32_t mask)
 {
 	/* Only print if something's about to change */
 	if ((events & mask) != mask || (events_copy_b & mask) != mask)
 		CPRINTS("event set 0x%08x", mask);
 
-	atomic_or(&events, mask);
 	atomic_or(&events_copy_b, mask);
 
-#ifdef CONFIG_LPC
-	lpc_set_host_event_state(events);
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+	if (host_events_coalesce(mask))
+		return;
 #else
-	*(uint32_t *)host_get_memmap(EC_MEMMAP_HOST_EVENTS) = events;
+	atomic_or(&events, mask);
 #endif
 
-#ifdef CONFIG_MKBP_EVENT
-	mkbp_send_event(EC_MKBP_EVENT_HOST_EVENT);
-#endif
+	host_events_publish();
 }
 
 void host_clear_events(uint32_t mask)
@@ -66,20 +286,20 @@ void host_clear_events(uint32_t mask)
 
 	atomic_clear(&events, mask);
 
-#ifdef CONFIG_LPC
-	lpc_set_host_event_state(events);
-#else
-	*(uint32_t *)host_get_memmap(EC_MEMMAP_HOST_EVENTS) = events;
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+	host_events_unhold(mask);
 #endif
 
-#ifdef CONFIG_MKBP_EVENT
-	mkbp_send_event(EC_MKBP_EVENT_HOST_EVENT);
-#endif
+	host_events_publish();
 }
 
 static int host_get_next_event(uint8_t *out)
 {
 	uint32_t event_out = events;
+
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+	event_out &= ~events_held;
+#endif
 	memcpy(out, &event_out, sizeof(event_out));
 	atomic_clear(&events, event_out);
 	return sizeof(event_out);
@@ -162,6 +382,49 @@ DECLARE_CONSOLE_COMMAND(hostevent, command_host_event,
 			"Print / set host event state",
 			NULL);
 
+#ifdef CONFIG_HOSTCMD_EVENT_COALESCE
+static int command_host_event_coalesce(int argc, char **argv)
+{
+	char *e;
+	int i, ms;
+
+	if (argc == 2 && !strcasecmp(argv[1], "clear")) {
+		memset(&coalesce_stats, 0, sizeof(coalesce_stats));
+	} else if (argc == 3) {
+		ms = strtoi(argv[2], &e, 0);
+		if (*e || ms < 0)
+			return EC_ERROR_PARAM2;
+
+		if (!strcasecmp(argv[1], "window")) {
+			coalesce_window = ms * MSEC;
+		} else {
+			for (i = 0; i < HOST_EVENT_CLASS_COUNT; i++)
+				if (!strcasecmp(argv[1], event_classes[i].name))
+					break;
+			if (i == HOST_EVENT_CLASS_COUNT)
+				return EC_ERROR_PARAM1;
+			class_interval[i] = ms * MSEC;
+		}
+	} else if (argc != 1) {
+		return EC_ERROR_PARAM_COUNT;
+	}
+
+	ccprintf("Window:    %d ms\n", coalesce_window / MSEC);
+	for (i = 0; i < HOST_EVENT_CLASS_COUNT; i++)
+		ccprintf("%-10s 0x%08x %5d ms%s\n", event_classes[i].name,
+			 event_classes[i].mask, class_interval[i] / MSEC,
+			 events_held & event_classes[i].mask ? " held" : "");
+	ccprintf("Generated: %d\n", coalesce_stats.generated);
+	ccprintf("Coalesced: %d\n", coalesce_stats.coalesced);
+	ccprintf("Dropped:   %d\n", coalesce_stats.dropped);
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(hostcoalesce, command_host_event_coalesce,
+			"[clear | window <ms> | <class> <ms>]",
+			"Print / set host event coalescing",
+			NULL);
+#endif
+
 /*****************************************************************************/
 /* Host commands */
 
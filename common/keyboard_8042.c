@@ -14,6 +14,7 @@
 #include "i8042_protocol.h"
 #include "keyboard_8042_sharedlib.h"
 #include "keyboard_config.h"
+#include "keyboard_latency.h"
 #include "keyboard_protocol.h"
 #include "lightbar.h"
 #include "lpc.h"
@@ -235,6 +236,7 @@ static void i8042_send_to_host(int len, const uint8_t *bytes)
 	if (queue_space(&to_host) >= len) {
 		kblog_put('t', to_host.state->tail);
 		queue_add_units(&to_host, bytes, len);
+		keyboard_latency_queued();
 	}
 	mutex_unlock(&to_host_mutex);
 
@@ -367,6 +369,7 @@ void keyboard_clear_buffer(void)
 	mutex_lock(&to_host_mutex);
 	queue_init(&to_host);
 	mutex_unlock(&to_host_mutex);
+	keyboard_latency_clear_pending();
 	lpc_keyboard_clear_buffer();
 }
 
@@ -904,6 +907,10 @@ void keyboard_protocol_task(void)
 			/* Write to host. */
 			lpc_keyboard_put_char(chr, i8042_irq_enabled);
 			retries = 0;
+
+			/* Everything queued so far is on its way to the host */
+			if (queue_is_empty(&to_host))
+				keyboard_latency_host_read(1);
 		}
 	}
 }
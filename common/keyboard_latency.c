@@ -0,0 +1,176 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Keyboard input latency tracking for Chrome EC */
+
+#include "common.h"
+#include "console.h"
+#include "host_command.h"
+#include "keyboard_latency.h"
+#include "task.h"
+#include "timer.h"
+#include "util.h"
+
+/* Max number of key events tracked between debounce and host read */
+#define KB_LATENCY_DEPTH 8
+
+struct kb_latency_event {
+	uint32_t sampled;
+	uint32_t debounced;
+	uint32_t queued;
+};
+
+static struct kb_latency_event events[KB_LATENCY_DEPTH];
+static int head;	/* Oldest event */
+static int count;	/* Events in flight */
+static int num_queued;	/* Events from head which have been queued */
+static struct mutex latency_mutex;
+
+static struct ec_response_keyboard_latency stats;
+
+static void add_sample(enum ec_kb_latency_stage stage, uint32_t us)
+{
+	int bucket = 0;
+
+	if (us >> EC_KB_LATENCY_BUCKET_SHIFT)
+		bucket = 31 - __builtin_clz(us) - EC_KB_LATENCY_BUCKET_SHIFT;
+	if (bucket >= EC_KB_LATENCY_BUCKETS)
+		bucket = EC_KB_LATENCY_BUCKETS - 1;
+
+	if (stats.histogram[stage][bucket] != 0xffff)
+		stats.histogram[stage][bucket]++;
+	if (us > stats.max_us[stage])
+		stats.max_us[stage] = us;
+}
+
+/* Drop the oldest event.  Must be called with latency_mutex held. */
+static void drop_oldest(void)
+{
+	head = (head + 1) % KB_LATENCY_DEPTH;
+	count--;
+	if (num_queued)
+		num_queued--;
+	stats.dropped++;
+}
+
+void keyboard_latency_debounced(uint32_t sampled, uint32_t debounced)
+{
+	struct kb_latency_event *e;
+
+	mutex_lock(&latency_mutex);
+
+	/* Anything debounced but never queued isn't going to the host */
+	while (count > num_queued) {
+		count--;
+		stats.dropped++;
+	}
+
+	if (count == KB_LATENCY_DEPTH)
+		drop_oldest();
+
+	e = events + (head + count) % KB_LATENCY_DEPTH;
+	e->sampled = sampled;
+	e->debounced = debounced;
+	count++;
+
+	mutex_unlock(&latency_mutex);
+}
+
+void keyboard_latency_queued(void)
+{
+	uint32_t now = get_time().le.lo;
+
+	mutex_lock(&latency_mutex);
+	while (num_queued < count) {
+		events[(head + num_queued) % KB_LATENCY_DEPTH].queued = now;
+		num_queued++;
+	}
+	mutex_unlock(&latency_mutex);
+}
+
+void keyboard_latency_host_read(int all)
+{
+	uint32_t now = get_time().le.lo;
+	struct kb_latency_event *e;
+
+	mutex_lock(&latency_mutex);
+	while (num_queued) {
+		e = events + head;
+		add_sample(EC_KB_LATENCY_DEBOUNCE, e->debounced - e->sampled);
+		add_sample(EC_KB_LATENCY_QUEUE, e->queued - e->debounced);
+		add_sample(EC_KB_LATENCY_HOST, now - e->queued);
+		add_sample(EC_KB_LATENCY_TOTAL, now - e->sampled);
+		stats.events++;
+
+		head = (head + 1) % KB_LATENCY_DEPTH;
+		count--;
+		num_queued--;
+
+		if (!all)
+			break;
+	}
+	mutex_unlock(&latency_mutex);
+}
+
+void keyboard_latency_clear_pending(void)
+{
+	mutex_lock(&latency_mutex);
+	stats.dropped += count;
+	head = count = num_queued = 0;
+	mutex_unlock(&latency_mutex);
+}
+
+/*****************************************************************************/
+/* Host commands */
+
+static int keyboard_latency_get(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_keyboard_latency *p = args->params;
+
+	mutex_lock(&latency_mutex);
+	memcpy(args->response, &stats, sizeof(stats));
+	if (p->flags & EC_KB_LATENCY_FLAG_RESET)
+		memset(&stats, 0, sizeof(stats));
+	mutex_unlock(&latency_mutex);
+
+	args->response_size = sizeof(stats);
+
+	return EC_RES_SUCCESS;
+}
+DECLARE_HOST_COMMAND(EC_CMD_KEYBOARD_LATENCY,
+		     keyboard_latency_get,
+		     EC_VER_MASK(0));
+
+/*****************************************************************************/
+/* Console commands */
+
+static const char * const stage_names[EC_KB_LATENCY_STAGE_COUNT] = {
+	"debounce", "queue", "host", "total"
+};
+
+static int command_kblatency(int argc, char **argv)
+{
+	int s, b;
+
+	ccprintf("events %d  dropped %d\n", stats.events, stats.dropped);
+	for (s = 0; s < EC_KB_LATENCY_STAGE_COUNT; s++) {
+		ccprintf("%-8s max %7d us:", stage_names[s], stats.max_us[s]);
+		for (b = 0; b < EC_KB_LATENCY_BUCKETS; b++)
+			ccprintf(" %d", stats.histogram[s][b]);
+		ccputs("\n");
+	}
+
+	if (argc > 1 && !strcasecmp(argv[1], "reset")) {
+		mutex_lock(&latency_mutex);
+		memset(&stats, 0, sizeof(stats));
+		mutex_unlock(&latency_mutex);
+	}
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(kblatency, command_kblatency,
+			"[reset]",
+			"Print keyboard latency histograms",
+			NULL);
@@ -11,6 +11,7 @@
 #include "gpio.h"
 #include "host_command.h"
 #include "keyboard_config.h"
+#include "keyboard_latency.h"
 #include "keyboard_protocol.h"
 #include "keyboard_raw.h"
 #include "keyboard_scan.h"
@@ -93,6 +94,8 @@ static int kb_fifo_remove(uint8_t *buffp)
 
 	atomic_sub(&kb_fifo_entries, 1);
 
+	keyboard_latency_host_read(0);
+
 	return EC_SUCCESS;
 }
 
@@ -119,6 +122,8 @@ void keyboard_clear_buffer(void)
 	kb_fifo_entries = 0;
 	for (i = 0; i < KB_FIFO_DEPTH; i++)
 		memset(kb_fifo[i], 0, KEYBOARD_COLS);
+
+	keyboard_latency_clear_pending();
 }
 
 test_mockable int keyboard_fifo_add(const uint8_t *buffp)
@@ -145,6 +150,8 @@ test_mockable int keyboard_fifo_add(const uint8_t *buffp)
 	atomic_add(&kb_fifo_entries, 1);
 	mutex_unlock(&fifo_mutex);
 
+	keyboard_latency_queued();
+
 kb_fifo_push_done:
 
 	if (ret == EC_SUCCESS) {
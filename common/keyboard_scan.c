@@ -12,6 +12,7 @@
 #include "hooks.h"
 #include "host_command.h"
 #include "keyboard_config.h"
+#include "keyboard_latency.h"
 #include "keyboard_protocol.h"
 #include "keyboard_raw.h"
 #include "keyboard_scan.h"
@@ -48,6 +49,7 @@ struct keyboard_scan_config keyscan_config = {
 	.debounce_down_us = 9 * MSEC,
 	.debounce_up_us = 30 * MSEC,
 	.scan_period_us = 3 * MSEC,
+	.idle_scan_period_us = 0,
 	.min_post_scan_delay_us = 1000,
 	.poll_timeout_us = 100 * MSEC,
 	.actual_key_mask = {
@@ -92,7 +94,10 @@ static int print_state_changes;
 static int disable_scanning_mask;  /* Must init to 0 for scanning at boot */
 
 /* Constantly incrementing counter of the number of times we polled */
-static volatile int kbd_polls;
+test_export_static volatile int kbd_polls;
+
+/* Number of back-to-back scans which saw no keys down or debouncing */
+static int idle_scans;
 
 static int keyboard_scan_is_enabled(void)
 {
@@ -216,6 +221,26 @@ static int read_matrix(uint8_t *state)
 	uint8_t r;
 	int pressed = 0;
 
+#ifndef CONFIG_KEYBOARD_TEST
+	/*
+	 * If the previous scan saw nothing, drive all the columns at once and
+	 * check for any key before paying the settle time of every column.
+	 * This is the common case while waiting out the poll timeout.
+	 */
+	if (idle_scans && keyboard_scan_is_enabled()) {
+		keyboard_raw_drive_column(KEYBOARD_COLUMN_ALL);
+		udelay(keyscan_config.output_settle_us);
+		r = keyboard_raw_read_rows();
+		for (c = 0; c < KEYBOARD_COLS; c++)
+			r |= simulated_key[c];
+		if (!r) {
+			keyboard_raw_drive_column(KEYBOARD_COLUMN_NONE);
+			memset(state, 0, KEYBOARD_COLS);
+			return 0;
+		}
+	}
+#endif
+
 	for (c = 0; c < KEYBOARD_COLS; c++) {
 		/*
 		 * Stop if scanning becomes disabled. Note, scanning is enabled
@@ -365,21 +390,24 @@ static int check_runtime_keys(const uint8_t *state)
  */
 static int has_ghosting(const uint8_t *state)
 {
-	int c, c2;
+	uint8_t multi[KEYBOARD_COLS];
+	int c, c2, n = 0;
 
+	/*
+	 * A little bit of cleverness here.  Ghosting happens if 2 columns
+	 * share at least 2 keys, so only columns with more than one key down
+	 * can take part.  x&(x-1) is non-zero only if x has more than one bit
+	 * set.  Collect those first; usually there are fewer than two and we
+	 * can skip the pairwise check entirely.
+	 */
 	for (c = 0; c < KEYBOARD_COLS; c++) {
-		if (!state[c])
-			continue;
+		if (state[c] & (state[c] - 1))
+			multi[n++] = state[c];
+	}
 
-		for (c2 = c + 1; c2 < KEYBOARD_COLS; c2++) {
-			/*
-			 * A little bit of cleverness here.  Ghosting happens
-			 * if 2 columns share at least 2 keys.  So we OR the
-			 * columns together and then see if more than one bit
-			 * is set.  x&(x-1) is non-zero only if x has more than
-			 * one bit set.
-			 */
-			uint8_t common = state[c] & state[c2];
+	for (c = 0; c < n; c++) {
+		for (c2 = c + 1; c2 < n; c2++) {
+			uint8_t common = multi[c] & multi[c2];
 
 			if (common & (common - 1))
 				return 1;
@@ -399,6 +427,7 @@ static int has_ghosting(const uint8_t *state)
 static int check_keys_changed(uint8_t *state)
 {
 	int any_pressed = 0;
+	int any_debouncing = 0;
 	int c, i;
 	int any_change = 0;
 	static uint8_t new_state[KEYBOARD_COLS];
@@ -413,8 +442,10 @@ static int check_keys_changed(uint8_t *state)
 	any_pressed = read_matrix(new_state);
 
 	/* Ignore if so many keys are pressed that we're ghosting. */
-	if (has_ghosting(new_state))
+	if (has_ghosting(new_state)) {
+		idle_scans = 0;
 		return any_pressed;
+	}
 
 	/* Check for changes between previous scan and this one */
 	for (c = 0; c < KEYBOARD_COLS; c++) {
@@ -423,29 +454,30 @@ static int check_keys_changed(uint8_t *state)
 		if (!diff)
 			continue;
 
-		for (i = 0; i < KEYBOARD_ROWS; i++) {
-			if (diff & (1 << i))
-				scan_edge_index[c][i] = scan_time_index;
-		}
-
+		/* Only visit the rows which changed */
 		debouncing[c] |= diff;
 		prev_state[c] = new_state[c];
+		while (diff) {
+			i = __builtin_ffs(diff) - 1;
+			diff &= diff - 1;
+			scan_edge_index[c][i] = scan_time_index;
+		}
 	}
 
 	/* Check for keys which are done debouncing */
 	for (c = 0; c < KEYBOARD_COLS; c++) {
 		int debc = debouncing[c];
 
-		if (!debc)
-			continue;
+		/* Only visit the rows still being debounced */
+		while (debc) {
+			int mask, new_mask;
 
-		for (i = 0; i < KEYBOARD_ROWS; i++) {
-			int mask = 1 << i;
-			int new_mask = new_state[c] & mask;
+			i = __builtin_ffs(debc) - 1;
+			mask = 1 << i;
+			new_mask = new_state[c] & mask;
+			debc &= ~mask;
 
 			/* Are we done debouncing this key? */
-			if (!(debc & mask))
-				continue;  /* Not debouncing this key */
 			if (tnow - scan_time[scan_edge_index[c][i]] <
 			    (new_mask ? keyscan_config.debounce_down_us :
 					keyscan_config.debounce_up_us))
@@ -458,6 +490,11 @@ static int check_keys_changed(uint8_t *state)
 				continue;  /* No */
 
 			state[c] ^= mask;
+
+			/* Timestamp the event from its first key change */
+			if (!any_change)
+				keyboard_latency_debounced(
+					scan_time[scan_edge_index[c][i]], tnow);
 			any_change = 1;
 
 #ifdef CONFIG_KEYBOARD_PROTOCOL_8042
@@ -491,8 +528,10 @@ static int check_keys_changed(uint8_t *state)
 #endif
 
 		/* Swallow special keys */
-		if (check_runtime_keys(state))
+		if (check_runtime_keys(state)) {
+			idle_scans = 0;
 			return 0;
+		}
 
 #ifdef CONFIG_KEYBOARD_PROTOCOL_MKBP
 		keyboard_fifo_add(state);
@@ -501,6 +540,13 @@ static int check_keys_changed(uint8_t *state)
 
 	kbd_polls++;
 
+	for (c = 0; c < KEYBOARD_COLS; c++)
+		any_debouncing |= debouncing[c];
+	if (any_pressed || any_debouncing)
+		idle_scans = 0;
+	else
+		idle_scans++;
+
 	return any_pressed;
 }
 
@@ -566,6 +612,51 @@ static enum boot_key check_boot_key(const uint8_t *state)
 	return BOOT_KEY_OTHER;
 }
 
+/**
+ * Return the time between the start of scans while polling.
+ *
+ * While no keys are down or debouncing, back off exponentially from the
+ * normal scan period towards the idle scan period, if one is configured.
+ */
+static int get_scan_period(void)
+{
+	int period = keyscan_config.scan_period_us;
+
+	if (!keyscan_config.idle_scan_period_us || !idle_scans)
+		return period;
+
+	if (idle_scans < 8)
+		period <<= idle_scans;
+	else
+		period = keyscan_config.idle_scan_period_us;
+
+	return MIN(period, keyscan_config.idle_scan_period_us);
+}
+
+/**
+ * Wait between scans while polling.
+ *
+ * When backed off, the rows are left armed with all columns driven, so that a
+ * new key press ends the wait right away instead of at the next scan.
+ *
+ * @param wait_time	Time to wait in us
+ */
+static void scan_wait(int wait_time)
+{
+	if (get_scan_period() <= keyscan_config.scan_period_us ||
+	    !keyboard_scan_is_enabled()) {
+		usleep(wait_time);
+		return;
+	}
+
+	keyboard_raw_drive_column(KEYBOARD_COLUMN_ALL);
+	keyboard_raw_enable_interrupt(1);
+	if (!keyboard_raw_read_rows())
+		task_wait_event(wait_time);
+	keyboard_raw_enable_interrupt(0);
+	keyboard_raw_drive_column(KEYBOARD_COLUMN_NONE);
+}
+
 static void keyboard_freq_change(void)
 {
 	post_scan_clock_us = (CONFIG_KEYBOARD_POST_SCAN_CLOCKS * 1000) /
@@ -649,6 +740,7 @@ void keyboard_scan_task(void)
 		keyboard_raw_drive_column(KEYBOARD_COLUMN_NONE);
 
 		/* Busy polling keyboard state. */
+		idle_scans = 0;
 		while (keyboard_scan_is_enabled()) {
 			start = get_time();
 
@@ -661,7 +753,7 @@ void keyboard_scan_task(void)
 			}
 
 			/* Delay between scans */
-			wait_time = keyscan_config.scan_period_us -
+			wait_time = get_scan_period() -
 				(get_time().val - start.val);
 
 			if (wait_time < keyscan_config.min_post_scan_delay_us)
@@ -671,7 +763,7 @@ void keyboard_scan_task(void)
 			if (wait_time < post_scan_clock_us)
 				wait_time = post_scan_clock_us;
 
-			usleep(wait_time);
+			scan_wait(wait_time);
 		}
 	}
 }
@@ -725,6 +817,8 @@ static int command_ksstate(int argc, char **argv)
 
 	ccprintf("Keyboard scan disable mask: 0x%08x\n",
 		 disable_scanning_mask);
+	ccprintf("Keyboard idle scans: %d, scan period: %d us\n",
+		 idle_scans, get_scan_period());
 	ccprintf("Keyboard scan state printing %s\n",
 		 print_state_changes ? "on" : "off");
 	return EC_SUCCESS;
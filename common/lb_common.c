@@ -5,12 +5,16 @@
  * Lightbar IC interface
  */
 
+#ifdef LIGHTBAR_SIMULATION
+#include "simulation.h"
+#else
 #include "common.h"
 #include "console.h"
 #include "ec_commands.h"
 #include "i2c.h"
 #include "lb_common.h"
 #include "util.h"
+#endif
 
 /* Console output macros */
 #define CPUTS(outstr) cputs(CC_LIGHTBAR, outstr)
@@ -21,7 +25,8 @@
 /******************************************************************************/
 
 /* Since there's absolutely nothing we can do about it if an I2C access
- * isn't working, we're completely ignoring any failures. */
+ * isn't working, we're mostly ignoring any failures. The only exception is
+ * the shadowed LED currents below, which are sent again after a failure. */
 
 static const uint8_t i2c_addr[] = { 0x54, 0x56 };
 
@@ -39,6 +44,26 @@ static inline uint8_t controller_read(int ctrl_num, uint8_t reg)
 	return val;
 }
 
+/* Write consecutive registers in one transaction. The ADP886x auto-increments
+ * the register address for multi-byte writes. */
+static int controller_write_block(int ctrl_num, uint8_t reg,
+				  const uint8_t *vals, int count)
+{
+	uint8_t buf[8];
+	int rv;
+
+	if (count <= 0 || count >= sizeof(buf))
+		return EC_ERROR_INVAL;
+	ctrl_num = ctrl_num % ARRAY_SIZE(i2c_addr);
+	buf[0] = reg;
+	memcpy(buf + 1, vals, count);
+	i2c_lock(I2C_PORT_LIGHTBAR, 1);
+	rv = i2c_xfer(I2C_PORT_LIGHTBAR, i2c_addr[ctrl_num], buf, count + 1,
+		      NULL, 0, I2C_XFER_SINGLE);
+	i2c_lock(I2C_PORT_LIGHTBAR, 0);
+	return rv;
+}
+
 /******************************************************************************/
 /* Controller details. We have an ADP8861 and and ADP8863, but we can treat
  * them identically for our purposes */
@@ -65,8 +90,8 @@ static inline uint8_t controller_read(int ctrl_num, uint8_t reg)
 #define MAX_GREEN 0x2c
 #define MAX_BLUE  0x40
 #endif
-#ifdef BOARD_HOST
-/* For testing only */
+#ifndef MAX_RED
+/* Nothing to protect elsewhere (e.g. the emulator), so use the full range */
 #define MAX_RED   0xff
 #define MAX_GREEN 0xff
 #define MAX_BLUE  0xff
@@ -108,17 +133,10 @@ static void set_from_array(const struct initdata_s *data, int count)
 
 /* Controller register lookup tables. */
 static const uint8_t led_to_ctrl[] = { 1, 1, 0, 0 };
-#ifdef BOARD_BDS
+#if defined(BOARD_BDS) || defined(BOARD_RYU)
 static const uint8_t led_to_isc[] = { 0x18, 0x15, 0x18, 0x15 };
-#endif
-#ifdef BOARD_SAMUS
-static const uint8_t led_to_isc[] = { 0x15, 0x18, 0x15, 0x18 };
-#endif
-#if defined(BOARD_RYU)
-static const uint8_t led_to_isc[] = { 0x18, 0x15, 0x18, 0x15 };
-#endif
-#ifdef BOARD_HOST
-/* For testing only */
+#else
+/* Samus, and anything else (e.g. the emulator) */
 static const uint8_t led_to_isc[] = { 0x15, 0x18, 0x15, 0x18 };
 #endif
 
@@ -141,6 +159,49 @@ static inline uint8_t scale(int val, int max)
 	return scale_abs((val * brightness)/255, max);
 }
 
+/* Both controllers keep the LED currents in registers 0x15-0x1a. We shadow
+ * them so that unchanged values aren't written again, and so that whatever
+ * did change can go out as a single burst per controller. The shadow starts
+ * out dirty since we don't know what the controllers hold after a sysjump. */
+#define ISC_FIRST 0x15
+#define ISC_COUNT 6
+static uint8_t isc_regs[ARRAY_SIZE(i2c_addr)][ISC_COUNT];
+static uint8_t isc_dirty[ARRAY_SIZE(i2c_addr)] = {
+	(1 << ISC_COUNT) - 1, (1 << ISC_COUNT) - 1 };
+
+/* Nonzero while updates are being collected by lb_batch_begin() */
+static int batch_depth;
+
+static void set_isc(int ctrl, int reg, uint8_t val)
+{
+	int i = reg - ISC_FIRST;
+	if (isc_regs[ctrl][i] == val && !(isc_dirty[ctrl] & (1 << i)))
+		return;
+	isc_regs[ctrl][i] = val;
+	isc_dirty[ctrl] |= 1 << i;
+}
+
+/* Send the changed span of each controller's ISC registers. If the write
+ * fails, the span stays dirty so that the next flush tries it again. */
+static void flush_isc(void)
+{
+	int ctrl, first, last;
+	uint8_t dirty;
+
+	for (ctrl = 0; ctrl < ARRAY_SIZE(i2c_addr); ctrl++) {
+		dirty = isc_dirty[ctrl];
+		if (!dirty)
+			continue;
+		first = __builtin_ffs(dirty) - 1;
+		last = 31 - __builtin_clz(dirty);
+		isc_dirty[ctrl] = 0;
+		if (controller_write_block(ctrl, ISC_FIRST + first,
+					   &isc_regs[ctrl][first],
+					   last - first + 1))
+			isc_dirty[ctrl] |= dirty;
+	}
+}
+
 /* Helper function to set one LED color and remember it for later */
 static void setrgb(int led, int red, int green, int blue)
 {
@@ -150,9 +211,9 @@ static void setrgb(int led, int red, int green, int blue)
 	current[led][2] = blue;
 	ctrl = led_to_ctrl[led];
 	bank = led_to_isc[led];
-	controller_write(ctrl, bank, scale(blue, MAX_BLUE));
-	controller_write(ctrl, bank+1, scale(red, MAX_RED));
-	controller_write(ctrl, bank+2, scale(green, MAX_GREEN));
+	set_isc(ctrl, bank, scale(blue, MAX_BLUE));
+	set_isc(ctrl, bank+1, scale(red, MAX_RED));
+	set_isc(ctrl, bank+2, scale(green, MAX_GREEN));
 }
 
 /* LEDs are numbered 0-3, RGB values should be in 0-255.
@@ -165,6 +226,21 @@ void lb_set_rgb(unsigned int led, int red, int green, int blue)
 			setrgb(i, red, green, blue);
 	else
 		setrgb(led, red, green, blue);
+	if (!batch_depth)
+		flush_isc();
+}
+
+/* Hold LED writes until the matching lb_batch_end(), so that a whole frame
+ * goes out in (at most) one transaction per controller. */
+void lb_batch_begin(void)
+{
+	batch_depth++;
+}
+
+void lb_batch_end(void)
+{
+	if (batch_depth && !--batch_depth)
+		flush_isc();
 }
 
 /* Get current LED values, if the LED number is in range. */
@@ -188,6 +264,8 @@ void lb_set_brightness(unsigned int newval)
 	brightness = newval;
 	for (i = 0; i < NUM_LEDS; i++)
 		setrgb(i, current[i][0], current[i][1], current[i][2]);
+	if (!batch_depth)
+		flush_isc();
 }
 
 /* Get current display brightness (0-255) */
@@ -202,6 +280,9 @@ void lb_init(void)
 	CPRINTS("LB_init_vals");
 	set_from_array(init_vals, ARRAY_SIZE(init_vals));
 	memset(current, 0, sizeof(current));
+	/* init_vals just zeroed all the LED currents */
+	memset(isc_regs, 0, sizeof(isc_regs));
+	memset(isc_dirty, 0, sizeof(isc_dirty));
 }
 
 /* Just go into standby mode. No register values should change. */
@@ -247,5 +328,12 @@ void lb_hc_cmd_dump(struct ec_response_lightbar *out)
 /* Helper for host command to write controller registers directly */
 void lb_hc_cmd_reg(const struct ec_params_lightbar *in)
 {
-	controller_write(in->reg.ctrl, in->reg.reg, in->reg.value);
+	int ctrl = in->reg.ctrl % ARRAY_SIZE(i2c_addr);
+	int i = in->reg.reg - ISC_FIRST;
+
+	controller_write(ctrl, in->reg.reg, in->reg.value);
+	if (i >= 0 && i < ISC_COUNT) {
+		isc_regs[ctrl][i] = in->reg.value;
+		isc_dirty[ctrl] &= ~(1 << i);
+	}
 }
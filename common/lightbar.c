@@ -37,7 +37,7 @@
 #define CPUTS(outstr) cputs(CC_LIGHTBAR, outstr)
 #define CPRINTS(format, args...) cprints(CC_LIGHTBAR, format, ## args)
 
-#define FP_SCALE 10000
+#define FP_SCALE (1 << 14)
 
 /******************************************************************************/
 /* Here's some state that we might want to maintain across sysjumps, just to
@@ -1343,12 +1343,14 @@ static inline int get_interp_value(int led, int color, int interp)
 static void set_all_leds(int color)
 {
 	int i, r, g, b;
+	lb_batch_begin();
 	for (i = 0; i < NUM_LEDS; i++) {
 		r = led_desc[i][color][LB_COL_RED];
 		g = led_desc[i][color][LB_COL_GREEN];
 		b = led_desc[i][color][LB_COL_BLUE];
 		lb_set_rgb(i, r, g, b);
 	}
+	lb_batch_end();
 }
 
 static uint32_t ramp_all_leds(int stop_at)
@@ -1356,12 +1358,14 @@ static uint32_t ramp_all_leds(int stop_at)
 	int w, i, r, g, b, f;
 	for (w = 0; w < stop_at; w++) {
 		f = cycle_010(w);
+		lb_batch_begin();
 		for (i = 0; i < NUM_LEDS; i++) {
 			r = get_interp_value(i, LB_COL_RED, f);
 			g = get_interp_value(i, LB_COL_GREEN, f);
 			b = get_interp_value(i, LB_COL_BLUE, f);
 			lb_set_rgb(i, r, g, b);
 		}
+		lb_batch_end();
 		WAIT_OR_RET(lb_ramp_delay);
 	}
 	return EC_SUCCESS;
@@ -1421,6 +1425,7 @@ static uint32_t lightbyte_CYCLE(void)
 		return EC_RES_INVALID_PARAM;
 
 	for (w = 0;; w++) {
+		lb_batch_begin();
 		for (i = 0; i < NUM_LEDS; i++) {
 			r = get_interp_value(i, LB_COL_RED,
 				cycle_010((w & 0xff) +
@@ -1433,6 +1438,7 @@ static uint32_t lightbyte_CYCLE(void)
 				led_desc[i][LB_CONT_PHASE][LB_COL_BLUE]));
 			lb_set_rgb(i, r, g, b);
 		}
+		lb_batch_end();
 		WAIT_OR_RET(lb_ramp_delay);
 	}
 	return EC_SUCCESS;
@@ -1463,12 +1469,14 @@ static uint32_t (*lightbyte_dispatch[])(void) = {
 };
 #undef OP
 
+#ifdef LIGHTBYTE_TRACE
 #define OP(NAME, BYTES, MNEMONIC) MNEMONIC,
 #include "lightbar_opcode_list.h"
 static const char * const lightbyte_names[] = {
 	LIGHTBAR_OPCODE_TABLE
 };
 #undef OP
+#endif
 
 static uint32_t sequence_PROGRAM(void)
 {
@@ -1503,8 +1511,13 @@ static uint32_t sequence_PROGRAM(void)
 			lb_set_brightness(saved_brightness);
 			return EC_RES_INVALID_PARAM;
 		} else {
+#ifdef LIGHTBYTE_TRACE
 			CPRINTS("LB PROGRAM pc: 0x%02x, opcode 0x%02x -> %s",
 				 old_pc, next_inst, lightbyte_names[next_inst]);
+#endif
+#ifdef LIGHTBAR_SIMULATION
+			lb_sim_opcode(next_inst);
+#endif
 			rc = lightbyte_dispatch[next_inst]();
 			if (rc) {
 				lb_set_brightness(saved_brightness);
@@ -1512,8 +1525,13 @@ static uint32_t sequence_PROGRAM(void)
 			}
 		}
 
-		/* yield processor in case we are stuck in a tight loop */
-		WAIT_OR_RET(100);
+		/*
+		 * A program can only get stuck in a tight loop by branching
+		 * backwards, so that's the only time we need to yield. Straight
+		 * line code runs without a task switch per instruction.
+		 */
+		if (pc <= old_pc)
+			WAIT_OR_RET(100);
 	}
 }
 
@@ -112,6 +112,10 @@ test_mockable __keep int main(void)
 	uart_init();
 
 	if (system_jumped_to_this_image()) {
+#ifdef CONFIG_SYSJUMP_WARM
+		uart_restore_output();
+#endif
+		system_mark_jump_phase(JUMP_PHASE_UART_INIT);
 		CPRINTS("UART initialized after sysjump");
 	} else {
 		CPUTS("\n\n--- UART initialized after reboot ---\n");
@@ -166,6 +170,7 @@ test_mockable __keep int main(void)
 	 * the majority of the time.
 	 */
 	CPRINTS("Inits done");
+	system_mark_jump_phase(JUMP_PHASE_INITS_DONE);
 
 	/* Launch task scheduling (never returns) */
 	return task_start();
@@ -287,7 +287,9 @@ DECLARE_HOOK(HOOK_INIT, motion_sense_startup,
 /* Write to LPC status byte to represent that accelerometers are present. */
 static inline void set_present(uint8_t *lpc_status)
 {
+	host_memmap_begin_update(EC_MEMMAP_SEQ_ACC);
 	*lpc_status |= EC_MEMMAP_ACC_STATUS_PRESENCE_BIT;
+	host_memmap_end_update(EC_MEMMAP_SEQ_ACC);
 }
 
 #ifdef CONFIG_LPC
@@ -302,8 +304,10 @@ static inline void update_sense_data(uint8_t *lpc_status,
 	 * the counter and clear the busy bit after writing the sensor
 	 * data. On the host side, the host needs to make sure the busy
 	 * bit is not set and that the counter remains the same before
-	 * and after reading the data.
+	 * and after reading the data. Newer hosts use the region's
+	 * update count instead, which works the same way.
 	 */
+	host_memmap_begin_update(EC_MEMMAP_SEQ_ACC);
 	*lpc_status |= EC_MEMMAP_ACC_STATUS_BUSY_BIT;
 
 	/*
@@ -334,6 +338,7 @@ static inline void update_sense_data(uint8_t *lpc_status,
 	*psample_id = (*psample_id + 1) &
 			EC_MEMMAP_ACC_STATUS_SAMPLE_ID_MASK;
 	*lpc_status = EC_MEMMAP_ACC_STATUS_PRESENCE_BIT | *psample_id;
+	host_memmap_end_update(EC_MEMMAP_SEQ_ACC);
 }
 #endif
 
@@ -20,6 +20,11 @@
 #define PORT80_POLL_PERIOD MSEC
 
 static uint16_t history[HISTORY_LEN];
+#ifdef CONFIG_PORT80_TIMESTAMPS
+static uint32_t history_time[HISTORY_LEN];  /* When each code arrived */
+static uint8_t history_repeats[HISTORY_LEN];  /* Repeats folded into it */
+static int dedup;     /* Fold repeats of the same code into one entry */
+#endif
 static int writes;    /* Number of port 80 writes so far */
 static int last_boot; /* Last code from previous boot */
 static int scroll;
@@ -31,6 +36,19 @@ static int task_timeout = -1;
 
 void port_80_write(int data)
 {
+#ifdef CONFIG_PORT80_TIMESTAMPS
+	/* Count a repeat of the last code, rather than filling up history */
+	if (dedup && data < 0x100 && writes) {
+		int i = (writes - 1) % ARRAY_SIZE(history);
+
+		if (history[i] == data) {
+			if (history_repeats[i] < 0xff)
+				history_repeats[i]++;
+			return;
+		}
+	}
+#endif
+
 	/*
 	 * Note that this currently prints from inside the LPC interrupt
 	 * itself.  If you're dropping events, turn print_in_int off.
@@ -48,6 +66,10 @@ void port_80_write(int data)
 	}
 
 	history[writes % ARRAY_SIZE(history)] = data;
+#ifdef CONFIG_PORT80_TIMESTAMPS
+	history_time[writes % ARRAY_SIZE(history)] = get_time().le.lo;
+	history_repeats[writes % ARRAY_SIZE(history)] = 0;
+#endif
 	writes++;
 }
 
@@ -94,6 +116,41 @@ DECLARE_HOOK(HOOK_CHIPSET_SUSPEND, port_80_task_disable, HOOK_PRIO_DEFAULT);
 /*****************************************************************************/
 /* Console commands */
 
+#ifdef CONFIG_PORT80_TIMESTAMPS
+/*
+ * Print when each code arrived, relative to the reset or resume which
+ * started its boot, and how long it was the last code written.
+ */
+static void print_timing(int tail, int head)
+{
+	uint32_t start = history_time[tail % ARRAY_SIZE(history)];
+	int i;
+
+	ccputs("code      at us    took us  repeats\n");
+	for (i = tail; i < head; i++) {
+		int j = i % ARRAY_SIZE(history);
+		int e = history[j];
+
+		if (e == PORT_80_EVENT_RESUME || e == PORT_80_EVENT_RESET) {
+			ccputs(e == PORT_80_EVENT_RESUME ?
+			       "(S3->S0)\n" : "(RESET)\n");
+			start = history_time[j];
+			continue;
+		}
+
+		ccprintf("  %02x %10d ", e, history_time[j] - start);
+		if (i + 1 < head)
+			ccprintf("%10d", history_time[(i + 1) %
+						      ARRAY_SIZE(history)] -
+				 history_time[j]);
+		else
+			ccputs("         -");
+		ccprintf(" %8d\n", history_repeats[j]);
+		cflush();
+	}
+}
+#endif
+
 static int command_port80(int argc, char **argv)
 {
 	int head, tail;
@@ -117,6 +174,14 @@ static int command_port80(int argc, char **argv)
 		} else if (!strcasecmp(argv[1], "flush")) {
 			writes = 0;
 			return EC_SUCCESS;
+#ifdef CONFIG_PORT80_TIMESTAMPS
+		} else if (!strcasecmp(argv[1], "dedup")) {
+			dedup = !dedup;
+			ccprintf("dedup %sabled\n", dedup ? "en" : "dis");
+			return EC_SUCCESS;
+		} else if (!strcasecmp(argv[1], "time")) {
+			/* print the timing of the history below */
+#endif
 #ifdef HAS_TASK_PORT80
 		} else if (!strcasecmp(argv[1], "task")) {
 			task_en = !task_en;
@@ -150,6 +215,13 @@ static int command_port80(int argc, char **argv)
 	else
 		tail = 0;
 
+#ifdef CONFIG_PORT80_TIMESTAMPS
+	if (argc > 1 && !strcasecmp(argv[1], "time")) {
+		print_timing(tail, head);
+		return EC_SUCCESS;
+	}
+#endif
+
 	ccputs("Port 80 writes:");
 	for (i = tail; i < head; i++) {
 		int e = history[i % ARRAY_SIZE(history)];
@@ -174,7 +246,7 @@ static int command_port80(int argc, char **argv)
 	return EC_SUCCESS;
 }
 DECLARE_CONSOLE_COMMAND(port80, command_port80,
-			"[scroll | intprint | flush]",
+			"[scroll | intprint | flush | dedup | time]",
 			"Print port80 writes or toggle port80 scrolling",
 			NULL);
 
@@ -202,6 +274,13 @@ int port80_command_read(struct host_cmd_handler_args *args)
 	if (p->subcmd == EC_PORT80_GET_INFO) {
 		rsp->get_info.writes = writes;
 		rsp->get_info.history_size = ARRAY_SIZE(history);
+		rsp->get_info.last_boot = last_boot;
+		rsp->get_info.flags = 0;
+#ifdef CONFIG_PORT80_TIMESTAMPS
+		rsp->get_info.flags |= EC_PORT80_FLAG_TIMESTAMPS;
+		if (dedup)
+			rsp->get_info.flags |= EC_PORT80_FLAG_DEDUP;
+#endif
 		args->response_size = sizeof(rsp->get_info);
 		return EC_RES_SUCCESS;
 	} else if (p->subcmd == EC_PORT80_READ_BUFFER) {
@@ -218,6 +297,28 @@ int port80_command_read(struct host_cmd_handler_args *args)
 
 		args->response_size = entries*sizeof(uint16_t);
 		return EC_RES_SUCCESS;
+#ifdef CONFIG_PORT80_TIMESTAMPS
+	} else if (p->subcmd == EC_PORT80_READ_TIMESTAMPS) {
+		if (offset >= ARRAY_SIZE(history) || entries == 0 ||
+		    entries > EC_PORT80_TIMESTAMP_SIZE_MAX)
+			return EC_RES_INVALID_PARAM;
+
+		for (i = 0; i < entries; i++) {
+			int j = (i + offset) % ARRAY_SIZE(history);
+
+			rsp->timestamps.entries[i].time = history_time[j];
+			rsp->timestamps.entries[i].code = history[j];
+			rsp->timestamps.entries[i].repeats =
+				history_repeats[j];
+		}
+
+		args->response_size =
+			entries * sizeof(rsp->timestamps.entries[0]);
+		return EC_RES_SUCCESS;
+	} else if (p->subcmd == EC_PORT80_SET_DEDUP) {
+		dedup = !!p->set_dedup.enable;
+		return EC_RES_SUCCESS;
+#endif
 	}
 
 	return EC_RES_INVALID_PARAM;
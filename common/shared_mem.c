@@ -5,15 +5,35 @@
 
 /* Shared memory module for Chrome EC */
 
+#include "atomic.h"
 #include "common.h"
 #include "console.h"
 #include "link_defs.h"
 #include "shared_mem.h"
 #include "system.h"
+#include "task.h"
+#include "timer.h"
 #include "util.h"
 
+/*
+ * Buffers currently held, sorted by address. The free space is whatever lies
+ * between them, so there's no bookkeeping inside the region itself and the
+ * region can shrink (see system_usable_ram_end()) while nothing is held.
+ */
+static struct {
+	char *buf;
+	int size;
+} leases[CONFIG_SHARED_MEM_LEASES];
+static int lease_count;
+static struct mutex lease_lock;
+
 static int buf_in_use;
 static int max_used;
+static int max_leases;
+static int busy_count;
+
+/* Tasks waiting in shared_mem_acquire_wait() */
+static uint32_t waiters;
 
 int shared_mem_size(void)
 {
@@ -25,39 +45,194 @@ int shared_mem_size(void)
 	return system_usable_ram_end() - (uintptr_t)__shared_mem_buf;
 }
 
-int shared_mem_acquire(int size, char **dest_ptr)
+static char *align_up(char *p, int align)
 {
+	return (char *)(((uintptr_t)p + align - 1) & ~(uintptr_t)(align - 1));
+}
+
+/*
+ * Find the first gap which fits, returning its index in leases[] and the
+ * start of the buffer in *buf, or -1 if nothing fits. Call with lease_lock
+ * held.
+ */
+static int find_gap(int size, int align, char **buf)
+{
+	char *end = (char *)__shared_mem_buf + shared_mem_size();
+	char *p = (char *)__shared_mem_buf;
+	int i;
+
+	for (i = 0; i <= lease_count; i++) {
+		char *next = i < lease_count ? leases[i].buf : end;
+		char *start = align_up(p, align);
+
+		if (start <= next && next - start >= size) {
+			*buf = start;
+			return i;
+		}
+		if (i < lease_count)
+			p = leases[i].buf + leases[i].size;
+	}
+
+	return -1;
+}
+
+int shared_mem_acquire_aligned(int size, int align, char **dest_ptr)
+{
+	char *buf;
+	int i;
+
 	if (size > shared_mem_size() || size <= 0)
 		return EC_ERROR_INVAL;
 
-	if (buf_in_use)
+	if (align <= 0 || (align & (align - 1)))
+		return EC_ERROR_INVAL;
+
+	mutex_lock(&lease_lock);
+
+	i = lease_count < CONFIG_SHARED_MEM_LEASES ?
+		find_gap(size, align, &buf) : -1;
+	if (i < 0) {
+		busy_count++;
+		mutex_unlock(&lease_lock);
 		return EC_ERROR_BUSY;
+	}
 
-	/*
-	 * We could guard buf_in_use with a mutex, but since shared memory is
-	 * currently only used by debug commands, that's overkill.
-	 */
+	memmove(leases + i + 1, leases + i,
+		(lease_count - i) * sizeof(*leases));
+	leases[i].buf = buf;
+	leases[i].size = size;
+	lease_count++;
 
-	buf_in_use = size;
-	*dest_ptr = __shared_mem_buf;
+	buf_in_use += size;
+	if (max_used < buf_in_use)
+		max_used = buf_in_use;
+	if (max_leases < lease_count)
+		max_leases = lease_count;
 
-	if (max_used < size)
-		max_used = size;
+	mutex_unlock(&lease_lock);
 
+	*dest_ptr = buf;
 	return EC_SUCCESS;
 }
 
+int shared_mem_acquire(int size, char **dest_ptr)
+{
+	return shared_mem_acquire_aligned(size, SHARED_MEM_ALIGN, dest_ptr);
+}
+
+int shared_mem_acquire_wait(int size, char **dest_ptr, int timeout_us)
+{
+	uint32_t id;
+	uint64_t deadline;
+	int remaining;
+	int rv;
+
+	if (in_interrupt_context() || !task_start_called())
+		return shared_mem_acquire(size, dest_ptr);
+
+	id = 1 << task_get_current();
+	deadline = get_time().val + timeout_us;
+
+	/*
+	 * Sign up before trying, so a release between our failed attempt and
+	 * the wait still leaves an event pending. Releases borrow the mutex
+	 * event; both this loop and mutex_lock() recheck after waking, so a
+	 * wakeup meant for the other is harmless.
+	 */
+	atomic_or(&waiters, id);
+	while ((rv = shared_mem_acquire(size, dest_ptr)) == EC_ERROR_BUSY) {
+		remaining = deadline - get_time().val;
+		if (remaining <= 0) {
+			rv = EC_ERROR_TIMEOUT;
+			break;
+		}
+		task_wait_event_mask(TASK_EVENT_MUTEX, remaining);
+		atomic_or(&waiters, id);
+	}
+	atomic_clear(&waiters, id);
+
+	return rv;
+}
+
 void shared_mem_release(void *ptr)
 {
-	buf_in_use = 0;
+	uint32_t wake;
+	int i;
+
+	mutex_lock(&lease_lock);
+
+	for (i = 0; i < lease_count; i++) {
+		if (leases[i].buf != ptr)
+			continue;
+
+		buf_in_use -= leases[i].size;
+		lease_count--;
+		memmove(leases + i, leases + i + 1,
+			(lease_count - i) * sizeof(*leases));
+		break;
+	}
+
+	mutex_unlock(&lease_lock);
+
+	wake = atomic_read_clear(&waiters);
+	while (wake) {
+		i = get_next_bit(&wake);
+		task_set_event(i, TASK_EVENT_MUTEX, 0);
+	}
+}
+
+void shared_mem_get_stats(struct shared_mem_stats *stats)
+{
+	char *end = (char *)__shared_mem_buf + shared_mem_size();
+	char *p = (char *)__shared_mem_buf;
+	int i, gap;
+
+	mutex_lock(&lease_lock);
+
+	stats->size = shared_mem_size();
+	stats->used = buf_in_use;
+	stats->max_used = max_used;
+	stats->leases = lease_count;
+	stats->max_leases = max_leases;
+	stats->busy_count = busy_count;
+
+	/* Largest gap, as shared_mem_acquire() would align it */
+	stats->largest_free = 0;
+	for (i = 0; lease_count < CONFIG_SHARED_MEM_LEASES &&
+		    i <= lease_count; i++) {
+		char *next = i < lease_count ? leases[i].buf : end;
+
+		gap = next - align_up(p, SHARED_MEM_ALIGN);
+		if (stats->largest_free < gap)
+			stats->largest_free = gap;
+		if (i < lease_count)
+			p = leases[i].buf + leases[i].size;
+	}
+
+	mutex_unlock(&lease_lock);
 }
 
 #ifdef CONFIG_CMD_SHMEM
 static int command_shmem(int argc, char **argv)
 {
-	ccprintf("Size:%6d\n", shared_mem_size());
-	ccprintf("Used:%6d\n", buf_in_use);
-	ccprintf("Max: %6d\n", max_used);
+	struct shared_mem_stats stats;
+	int i;
+
+	shared_mem_get_stats(&stats);
+
+	ccprintf("Size:%6d\n", stats.size);
+	ccprintf("Used:%6d in %d/%d\n", stats.used, stats.leases,
+		 CONFIG_SHARED_MEM_LEASES);
+	ccprintf("Free:%6d largest\n", stats.largest_free);
+	ccprintf("Max: %6d in %d\n", stats.max_used, stats.max_leases);
+	ccprintf("Busy:%6d\n", stats.busy_count);
+
+	mutex_lock(&lease_lock);
+	for (i = 0; i < lease_count; i++)
+		ccprintf("  +%-5d %d\n", leases[i].buf - (char *)__shared_mem_buf,
+			 leases[i].size);
+	mutex_unlock(&lease_lock);
+
 	return EC_SUCCESS;
 }
 DECLARE_CONSOLE_COMMAND(shmem, command_shmem,
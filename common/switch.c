@@ -38,6 +38,8 @@ static void switch_update(void)
 
 	prev = *memmap_switches;
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_SWITCHES);
+
 	if (power_button_is_pressed())
 		*memmap_switches |= EC_SWITCH_POWER_BUTTON_PRESSED;
 	else
@@ -60,6 +62,8 @@ static void switch_update(void)
 		*memmap_switches &= ~EC_SWITCH_DEDICATED_RECOVERY;
 #endif
 
+	host_memmap_end_update(EC_MEMMAP_SEQ_SWITCHES);
+
 	if (prev != *memmap_switches)
 		CPRINTS("SW 0x%02x", *memmap_switches);
 }
@@ -71,12 +75,14 @@ static void switch_init(void)
 {
 	/* Set up memory-mapped switch positions */
 	memmap_switches = host_get_memmap(EC_MEMMAP_SWITCHES);
+	host_memmap_begin_update(EC_MEMMAP_SEQ_SWITCHES);
 	*memmap_switches = 0;
 
 	switch_update();
 
 	/* Switch data is now present */
 	*host_get_memmap(EC_MEMMAP_SWITCHES_VERSION) = 1;
+	host_memmap_end_update(EC_MEMMAP_SEQ_SWITCHES);
 
 #ifdef CONFIG_SWITCH_DEDICATED_RECOVERY
 	/* Enable interrupts, now that we've initialized */
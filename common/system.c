@@ -90,6 +90,12 @@ static int disable_jump;  /* Disable ALL jumps if system is locked */
 static int force_locked;  /* Force system locked even if WP isn't enabled */
 static enum ec_reboot_cmd reboot_at_shutdown;
 
+#define JUMP_TIMES_SYSJUMP_TAG 0x4a54  /* "JT" */
+#define JUMP_TIMES_SYSJUMP_VERSION 1
+
+/* When the last jump reached each phase; see enum jump_phase */
+static uint32_t jump_times[JUMP_PHASE_COUNT];
+
 /* On-going actions preventing going into deep-sleep mode */
 uint32_t sleep_mask;
 
@@ -207,6 +213,19 @@ int system_jumped_to_this_image(void)
 	return jumped_to_image;
 }
 
+void system_mark_jump_phase(enum jump_phase phase)
+{
+	if (phase >= JUMP_PHASE_UART_INIT && !jumped_to_image)
+		return;
+
+	jump_times[phase] = get_time().le.lo;
+}
+
+const uint32_t *system_get_jump_times(void)
+{
+	return jumped_to_image ? jump_times : NULL;
+}
+
 int system_add_jump_tag(uint16_t tag, int version, int size, const void *data)
 {
 	struct jump_tag *t;
@@ -415,6 +434,34 @@ const char *system_image_copy_t_to_string(enum system_image_copy_t copy)
 	return image_names[copy < ARRAY_SIZE(image_names) ? copy : 0];
 }
 
+#ifdef CONFIG_USB_POWER_DELIVERY
+/**
+ * Notify USB PD module that we are about to sysjump and give it time to do
+ * what it needs.
+ */
+static void jump_prepare_pd(void)
+{
+#ifdef CONFIG_SYSJUMP_WARM
+	uint64_t deadline;
+#endif
+
+	pd_prepare_sysjump();
+
+#ifdef CONFIG_SYSJUMP_WARM
+	/*
+	 * Jumping while a soft reset is still waiting to be accepted makes the
+	 * port partner fall back to a hard reset and drop the contract, so
+	 * wait for that instead of for a fixed time.
+	 */
+	deadline = get_time().val + PD_T_SENDER_RESPONSE;
+	while (!pd_sysjump_ready() && get_time().val < deadline)
+		usleep(100);
+#else
+	usleep(5*MSEC);
+#endif
+}
+#endif
+
 /**
  * Jump to what we hope is the init address of an image.
  *
@@ -425,6 +472,11 @@ const char *system_image_copy_t_to_string(enum system_image_copy_t copy)
 static void jump_to_image(uintptr_t init_addr)
 {
 	void (*resetvec)(void) = (void(*)(void))init_addr;
+#ifdef CONFIG_SYSJUMP_WARM
+	int pulse_left;
+#endif
+
+	system_mark_jump_phase(JUMP_PHASE_START);
 
 	/*
 	 * Jumping to any image asserts the signal to the Silego chip that that
@@ -436,25 +488,40 @@ static void jump_to_image(uintptr_t init_addr)
 	 * Silego.
 	 */
 	gpio_set_level(GPIO_ENTERING_RW, 1);
+#ifdef CONFIG_SYSJUMP_WARM
+	/* Get PD ready while the pulse is held, rather than after it */
+	pulse_left = get_time().le.lo + MSEC;
+#ifdef CONFIG_USB_POWER_DELIVERY
+	jump_prepare_pd();
+#endif
+	pulse_left -= get_time().le.lo;
+	if (pulse_left > 0)
+		usleep(pulse_left);
+	gpio_set_level(GPIO_ENTERING_RW, 0);
+#else
 	usleep(MSEC);
 	gpio_set_level(GPIO_ENTERING_RW, 0);
 
 #ifdef CONFIG_USB_POWER_DELIVERY
-	/*
-	 * Notify USB PD module that we are about to sysjump and give it time
-	 * to do what it needs.
-	 */
-	pd_prepare_sysjump();
-	usleep(5*MSEC);
+	jump_prepare_pd();
 #endif
+#endif /* CONFIG_SYSJUMP_WARM */
+	system_mark_jump_phase(JUMP_PHASE_PD);
 
 #ifdef CONFIG_I2C
 	/* Prepare I2C module for sysjump */
 	i2c_prepare_sysjump();
 #endif
+	system_mark_jump_phase(JUMP_PHASE_I2C);
+
+#if defined(CONFIG_SYSJUMP_WARM) && !defined(CONFIG_UART_TX_DMA)
+	/* The UART's HOOK_SYSJUMP handler passes unsent output along */
+#else
 	/* Flush UART output unless the UART hasn't been initialized yet */
 	if (uart_init_done())
 		uart_flush_output();
+#endif
+	system_mark_jump_phase(JUMP_PHASE_UART);
 
 	/* Disable interrupts before jump */
 	interrupt_disable();
@@ -473,8 +540,14 @@ static void jump_to_image(uintptr_t init_addr)
 	jdata->struct_size = sizeof(struct jump_data);
 
 	/* Call other hooks; these may add tags */
+	system_mark_jump_phase(JUMP_PHASE_HOOKS);
 	hook_notify(HOOK_SYSJUMP);
 
+	/* Only our half of the timeline means anything to the new image */
+	system_add_jump_tag(JUMP_TIMES_SYSJUMP_TAG, JUMP_TIMES_SYSJUMP_VERSION,
+			    JUMP_PHASE_UART_INIT * sizeof(jump_times[0]),
+			    jump_times);
+
 	/* Jump to the reset vector */
 	resetvec();
 }
@@ -623,6 +696,17 @@ const char *system_get_build_info(void)
 	return build_info;
 }
 
+static void restore_jump_times(void)
+{
+	const uint8_t *prev;
+	int version, size;
+
+	prev = system_get_jump_tag(JUMP_TIMES_SYSJUMP_TAG, &version, &size);
+	if (prev && version == JUMP_TIMES_SYSJUMP_VERSION &&
+	    size <= sizeof(jump_times))
+		memcpy(jump_times, prev, size);
+}
+
 void system_common_pre_init(void)
 {
 	uintptr_t addr;
@@ -699,6 +783,8 @@ void system_common_pre_init(void)
 		 * disallows use of system_add_jump_tag().
 		 */
 		jdata->magic = 0;
+
+		restore_jump_times();
 	} else {
 		/* Clear the whole jump_data struct */
 		memset(jdata, 0, sizeof(struct jump_data));
@@ -749,6 +835,21 @@ static void system_common_shutdown(void)
 }
 DECLARE_HOOK(HOOK_CHIPSET_SHUTDOWN, system_common_shutdown, HOOK_PRIO_DEFAULT);
 
+static void jump_times_init(void)
+{
+	if (!jumped_to_image)
+		return;
+
+	system_mark_jump_phase(JUMP_PHASE_HOOK_INIT);
+
+	/* Older images don't time their half of the jump */
+	if (jump_times[JUMP_PHASE_START])
+		CPRINTS("Sysjump took %d us",
+			jump_times[JUMP_PHASE_HOOK_INIT] -
+			jump_times[JUMP_PHASE_START]);
+}
+DECLARE_HOOK(HOOK_INIT, jump_times_init, HOOK_PRIO_LAST);
+
 /*****************************************************************************/
 /* Console commands */
 
@@ -994,6 +1095,32 @@ DECLARE_CONSOLE_COMMAND(jumptags, command_jumptags,
 			NULL);
 #endif /* CONFIG_CMD_JUMPTAGS */
 
+#ifdef CONFIG_CMD_JUMPTIMES
+static int command_jumptimes(int argc, char **argv)
+{
+	static const char * const phase_names[] = {
+		"start", "pd", "i2c", "uart", "hooks", "uart_init",
+		"inits_done", "hook_init"};
+	const uint32_t *t = system_get_jump_times();
+	int i;
+
+	BUILD_ASSERT(ARRAY_SIZE(phase_names) == JUMP_PHASE_COUNT);
+
+	if (!t || !t[JUMP_PHASE_START])
+		return EC_SUCCESS;
+
+	for (i = 0; i < JUMP_PHASE_COUNT; i++)
+		ccprintf("%-10s %10d us\n", phase_names[i],
+			 t[i] - t[JUMP_PHASE_START]);
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(jumptimes, command_jumptimes,
+			NULL,
+			"Time each phase of the last sysjump",
+			NULL);
+#endif /* CONFIG_CMD_JUMPTIMES */
+
 /*****************************************************************************/
 /* Host commands */
 
@@ -31,6 +31,7 @@ static void update_mapped_memory(void)
 	int i, t;
 	uint8_t *mptr = host_get_memmap(EC_MEMMAP_TEMP_SENSOR);
 
+	host_memmap_begin_update(EC_MEMMAP_SEQ_THERMAL);
 	for (i = 0; i < TEMP_SENSOR_COUNT; i++, mptr++) {
 		/*
 		 * Switch to second range if first one is full, or stop if
@@ -56,6 +57,7 @@ static void update_mapped_memory(void)
 			*mptr = EC_TEMP_SENSOR_ERROR;
 		}
 	}
+	host_memmap_end_update(EC_MEMMAP_SEQ_THERMAL);
 }
 /* Run after other TEMP tasks, so sensors will have updated first. */
 DECLARE_HOOK(HOOK_SECOND, update_mapped_memory, HOOK_PRIO_TEMP_SENSOR_DONE);
@@ -72,6 +74,7 @@ static void temp_sensor_init(void)
 	 */
 	base = host_get_memmap(EC_MEMMAP_TEMP_SENSOR);
 	base_b = host_get_memmap(EC_MEMMAP_TEMP_SENSOR_B);
+	host_memmap_begin_update(EC_MEMMAP_SEQ_THERMAL);
 	for (i = 0; i < TEMP_SENSOR_COUNT; ++i) {
 		if (i < EC_TEMP_SENSOR_ENTRIES)
 			base[i] = EC_TEMP_SENSOR_DEFAULT;
@@ -91,6 +94,7 @@ static void temp_sensor_init(void)
 
 	/* Temp sensor data is present, with B range supported. */
 	*host_get_memmap(EC_MEMMAP_THERMAL_VERSION) = 2;
+	host_memmap_end_update(EC_MEMMAP_SEQ_THERMAL);
 }
 DECLARE_HOOK(HOOK_INIT, temp_sensor_init, HOOK_PRIO_DEFAULT);
 
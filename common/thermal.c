@@ -138,61 +138,137 @@ BUILD_ASSERT(EC_TEMP_THRESH_COUNT == 3);
 /* Keep track of which thresholds have triggered */
 static cond_t cond_hot[EC_TEMP_THRESH_COUNT];
 
-static void thermal_control(void)
-{
-	int i, j, t, rv, f;
-	int count_over[EC_TEMP_THRESH_COUNT];
-	int count_under[EC_TEMP_THRESH_COUNT];
-	int num_valid_limits[EC_TEMP_THRESH_COUNT];
-	int num_sensors_read;
-	int fmax;
-	int dptf_tripped;
-
-	/* Get ready to count things */
-	memset(count_over, 0, sizeof(count_over));
-	memset(count_under, 0, sizeof(count_under));
-	memset(num_valid_limits, 0, sizeof(num_valid_limits));
-	num_sensors_read = 0;
-	fmax = 0;
-	dptf_tripped = 0;
+/*
+ * What the latest sample from each sensor told us, one bit per sensor. Each
+ * sample only updates its own sensor's bits, so the thresholds can be
+ * re-evaluated without going back over the other sensors.
+ */
+BUILD_ASSERT(TEMP_SENSOR_COUNT <= 32);
+static uint32_t sensor_ok;				/* last read worked */
+static uint32_t sensor_limited[EC_TEMP_THRESH_COUNT];	/* limit is set */
+static uint32_t sensor_over[EC_TEMP_THRESH_COUNT];
+static uint32_t sensor_under[EC_TEMP_THRESH_COUNT];
+static uint8_t sensor_fan[TEMP_SENSOR_COUNT];		/* fan % needed */
+
+#ifdef CONFIG_THERMAL_EMA_SHIFT
+#define EMA_SHIFT CONFIG_THERMAL_EMA_SHIFT
+#else
+#define EMA_SHIFT 0
+#endif
 
-	/* go through all the sensors */
-	for (i = 0; i < TEMP_SENSOR_COUNT; ++i) {
+#ifdef CONFIG_THERMAL_HYSTERESIS
+#define HYSTERESIS CONFIG_THERMAL_HYSTERESIS
+#else
+#define HYSTERESIS 0
+#endif
 
-		/* read one */
-		rv = temp_sensor_read(i, &t);
-		if (rv != EC_SUCCESS)
-			continue;
-		else
-			num_sensors_read++;
-
-		/* check all the limits */
-		for (j = 0; j < EC_TEMP_THRESH_COUNT; j++) {
-			int limit = thermal_params[i].temp_host[j];
-			if (limit) {
-				num_valid_limits[j]++;
-				if (t > limit)
-					count_over[j]++;
-				else if (t < limit)
-					count_under[j]++;
-			}
-		}
+/* Filtered temperatures, in 1/256 degrees K */
+static struct {
+	int temp;
+	int slope;		/* per second */
+	uint32_t time;		/* of the last sample, in usec */
+	int valid;
+} filter[TEMP_SENSOR_COUNT];
+
+/*
+ * Read a sensor and pass the result through an exponential moving average
+ * (if CONFIG_THERMAL_EMA_SHIFT is set), keeping track of how fast it's going.
+ */
+static int thermal_read(int id, int *temp_ptr)
+{
+	uint32_t now = get_time().le.lo;
+	int32_t dt_ms;
+	int t, old;
+
+	if (temp_sensor_read(id, &t) != EC_SUCCESS) {
+		/* Don't let a stale value leak into the next good reading */
+		filter[id].valid = 0;
+		return EC_ERROR_UNKNOWN;
+	}
 
-		/* figure out the max fan needed, too */
-		if (thermal_params[i].temp_fan_off &&
-		    thermal_params[i].temp_fan_max) {
-			f = thermal_fan_percent(thermal_params[i].temp_fan_off,
-						thermal_params[i].temp_fan_max,
-						t);
-			if (f > fmax)
-				fmax = f;
+	if (!filter[id].valid) {
+		filter[id].temp = t << 8;
+		filter[id].slope = 0;
+		filter[id].time = now;
+		filter[id].valid = 1;
+	} else {
+		old = filter[id].temp;
+		filter[id].temp += ((t << 8) - old) >> EMA_SHIFT;
+
+		dt_ms = (now - filter[id].time) / MSEC;
+		if (dt_ms > 0) {
+			filter[id].slope += ((filter[id].temp - old) * 1000 /
+					     dt_ms - filter[id].slope)
+				>> EMA_SHIFT;
+			filter[id].time = now;
 		}
+	}
 
-		/* and check the dptf thresholds */
-		dptf_tripped |= dpft_check_temp_threshold(i, t);
+	*temp_ptr = (filter[id].temp + 128) >> 8;
+	return EC_SUCCESS;
+}
+
+/* Temperature to feed into the fan curve */
+static int fan_temp(int id, int t)
+{
+#ifdef CONFIG_THERMAL_FAN_PREDICT_SEC
+	/* Spin up for where we're heading, but never down early */
+	if (filter[id].slope > 0)
+		t += (filter[id].slope * CONFIG_THERMAL_FAN_PREDICT_SEC) >> 8;
+#endif
+	return t;
+}
+
+/* Take a new sample from one sensor. Returns true if a DPTF threshold moved. */
+static int thermal_sample(int id)
+{
+	uint32_t bit = 1 << id;
+	int j, t;
+
+	for (j = 0; j < EC_TEMP_THRESH_COUNT; j++) {
+		sensor_limited[j] &= ~bit;
+		sensor_over[j] &= ~bit;
+		sensor_under[j] &= ~bit;
+	}
+
+	if (thermal_read(id, &t) != EC_SUCCESS) {
+		sensor_ok &= ~bit;
+		return 0;
+	}
+	sensor_ok |= bit;
+
+	/* check all the limits */
+	for (j = 0; j < EC_TEMP_THRESH_COUNT; j++) {
+		int limit = thermal_params[id].temp_host[j];
+		if (limit) {
+			sensor_limited[j] |= bit;
+			if (t > limit)
+				sensor_over[j] |= bit;
+			else if (t < limit - HYSTERESIS)
+				sensor_under[j] |= bit;
+		}
 	}
 
-	if (!num_sensors_read) {
+	/* figure out the fan needed, too */
+	sensor_fan[id] = 0;
+	if (thermal_params[id].temp_fan_off &&
+	    thermal_params[id].temp_fan_max)
+		sensor_fan[id] =
+			thermal_fan_percent(thermal_params[id].temp_fan_off,
+					    thermal_params[id].temp_fan_max,
+					    fan_temp(id, t));
+
+	/* and check the dptf thresholds */
+	return dpft_check_temp_threshold(id, t);
+}
+
+/* Act on the latest samples from all the sensors */
+static void thermal_evaluate(int dptf_tripped)
+{
+	int i, j;
+	int fmax = 0;
+
+	if (!sensor_ok) {
 		/*
 		 * Trigger a SMI event if we can't read any sensors.
 		 *
@@ -214,9 +290,9 @@ static void thermal_control(void)
 	 * be cool again.
 	 */
 	for (j = 0; j < EC_TEMP_THRESH_COUNT; j++) {
-		if (count_over[j])
+		if (sensor_over[j])
 			cond_set_true(&cond_hot[j]);
-		else if (count_under[j] == num_valid_limits[j])
+		else if (sensor_under[j] == sensor_limited[j])
 			cond_set_false(&cond_hot[j]);
 	}
 
@@ -251,6 +327,11 @@ static void thermal_control(void)
 		throttle_ap(THROTTLE_OFF, THROTTLE_SOFT, THROTTLE_SRC_THERMAL);
 	}
 
+	/* The fan has to keep up with the hottest sensor */
+	for (i = 0; i < TEMP_SENSOR_COUNT; i++)
+		if ((sensor_ok & (1 << i)) && sensor_fan[i] > fmax)
+			fmax = sensor_fan[i];
+
 #ifdef CONFIG_FANS
 	/* TODO(crosbug.com/p/23797): For now, we just treat all fans the
 	 * same. It would be better if we could assign different thermal
@@ -266,9 +347,63 @@ static void thermal_control(void)
 		host_set_single_event(EC_HOST_EVENT_THERMAL_THRESHOLD);
 }
 
+#ifdef CONFIG_THERMAL_SENSOR_PERIOD
+
+/* When each sensor is next due to be sampled */
+static uint32_t sample_due[TEMP_SENSOR_COUNT];
+
+static void thermal_control(void)
+{
+	uint32_t now = get_time().le.lo;
+	int i, period;
+	int sampled = 0;
+	int dptf_tripped = 0;
+
+	for (i = 0; i < TEMP_SENSOR_COUNT; ++i) {
+		if ((int32_t)(now - sample_due[i]) < 0)
+			continue;
+
+		period = temp_sensors[i].sample_period_ms;
+		if (!period)
+			period = 1000;
+
+		/*
+		 * Stay in phase, so the period doesn't stretch out to the next
+		 * tick every time. If we've fallen a whole period behind, start
+		 * again from now rather than sampling back to back.
+		 */
+		sample_due[i] += period * MSEC;
+		if ((int32_t)(now - sample_due[i]) >= 0)
+			sample_due[i] = now + period * MSEC;
+
+		dptf_tripped |= thermal_sample(i);
+		sampled = 1;
+	}
+
+	if (sampled)
+		thermal_evaluate(dptf_tripped);
+}
+/* Sensors sample at their own rates, so look every tick to see who's due */
+DECLARE_HOOK(HOOK_TICK, thermal_control, HOOK_PRIO_TEMP_SENSOR_DONE);
+
+#else
+
+static void thermal_control(void)
+{
+	int i;
+	int dptf_tripped = 0;
+
+	/* go through all the sensors */
+	for (i = 0; i < TEMP_SENSOR_COUNT; ++i)
+		dptf_tripped |= thermal_sample(i);
+
+	thermal_evaluate(dptf_tripped);
+}
 /* Wait until after the sensors have been read */
 DECLARE_HOOK(HOOK_SECOND, thermal_control, HOOK_PRIO_TEMP_SENSOR_DONE);
 
+#endif  /* CONFIG_THERMAL_SENSOR_PERIOD */
+
 /*****************************************************************************/
 /* Console commands */
 
@@ -361,6 +361,74 @@ static void uart_rx_dma_init(void)
 DECLARE_HOOK(HOOK_INIT, uart_rx_dma_init, HOOK_PRIO_DEFAULT);
 #endif
 
+#ifdef CONFIG_SYSJUMP_WARM
+#define UART_SYSJUMP_TAG 0x5554  /* "UT" */
+#define UART_SYSJUMP_VERSION 1
+#define UART_SYSJUMP_MAX 255  /* Largest jump tag */
+
+#ifndef CONFIG_UART_TX_DMA
+/* Reverse tx_buf[start..end) in place */
+static void tx_buf_reverse(int start, int end)
+{
+	char c;
+
+	while (start < --end) {
+		c = tx_buf[start];
+		tx_buf[start++] = tx_buf[end];
+		tx_buf[end] = c;
+	}
+}
+
+/*
+ * Pass output which hasn't been sent yet to the image we're jumping to, rather
+ * than making the jump wait for all of it.  Interrupts are disabled by now,
+ * so this has to poll.
+ */
+static void uart_sysjump(void)
+{
+	if (!uart_init_done() || uart_suspended)
+		return;
+
+	/* Send whatever won't fit in the tag */
+	while (TX_BUF_DIFF(tx_buf_head, tx_buf_tail) > UART_SYSJUMP_MAX)
+		uart_process_output();
+
+	/* Don't let the new image reconfigure the UART mid-character */
+	uart_tx_flush();
+
+	/* Rotate what's left to the start of the buffer, to make it one piece */
+	tx_buf_reverse(0, tx_buf_tail);
+	tx_buf_reverse(tx_buf_tail, CONFIG_UART_TX_BUF_SIZE);
+	tx_buf_reverse(0, CONFIG_UART_TX_BUF_SIZE);
+	tx_buf_head = TX_BUF_DIFF(tx_buf_head, tx_buf_tail);
+	tx_buf_tail = 0;
+
+	system_add_jump_tag(UART_SYSJUMP_TAG, UART_SYSJUMP_VERSION,
+			    tx_buf_head, (const char *)tx_buf);
+}
+/* Last, to pick up anything the other handlers print */
+DECLARE_HOOK(HOOK_SYSJUMP, uart_sysjump, HOOK_PRIO_LAST);
+#endif
+
+void uart_restore_output(void)
+{
+	const uint8_t *prev;
+	int version, size, i;
+
+	prev = system_get_jump_tag(UART_SYSJUMP_TAG, &version, &size);
+	if (!prev || version != UART_SYSJUMP_VERSION)
+		return;
+
+	/* Already CRLF-translated, so bypass __tx_char() */
+	for (i = 0; i < size && TX_BUF_NEXT(tx_buf_head) != tx_buf_tail; i++) {
+		tx_buf[tx_buf_head] = prev[i];
+		tx_buf_head = TX_BUF_NEXT(tx_buf_head);
+	}
+
+	uart_tx_start();
+}
+#endif /* CONFIG_SYSJUMP_WARM */
+
 /*****************************************************************************/
 /* Host commands */
 
@@ -563,6 +563,17 @@ void pd_prepare_sysjump(void)
 	pd_soft_reset();
 }
 
+int pd_sysjump_ready(void)
+{
+	int i;
+
+	for (i = 0; i < CONFIG_USB_PD_PORT_COUNT; ++i)
+		if (pd[i].task_state == PD_STATE_SOFT_RESET)
+			return 0;
+
+	return 1;
+}
+
 #ifdef CONFIG_USB_PD_DUAL_ROLE
 static void pd_store_src_cap(int port, int cnt, uint32_t *src_caps)
 {
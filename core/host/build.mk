@@ -8,4 +8,7 @@
 
 CFLAGS_CPU=-fno-builtin
 
-core-y=main.o task.o timer.o panic.o disabled.o stack_trace.o
+core-y=main.o timer.o panic.o disabled.o stack_trace.o
+
+# Tests can ask for the single-threaded, virtual time scheduler
+core-y+=$(if $($(PROJECT)-discrete),task_des.o,task.o)
@@ -55,6 +55,10 @@ int main(int argc, char **argv)
 	uart_init();
 
 	if (system_jumped_to_this_image()) {
+#ifdef CONFIG_SYSJUMP_WARM
+		uart_restore_output();
+#endif
+		system_mark_jump_phase(JUMP_PHASE_UART_INIT);
 		CPRINTS("Emulator initialized after sysjump");
 	} else {
 		CPUTS("\n\n--- Emulator initialized after reboot ---\n");
@@ -63,6 +67,7 @@ int main(int argc, char **argv)
 		CPUTS("]\n");
 	}
 
+	system_mark_jump_phase(JUMP_PHASE_INITS_DONE);
 	task_start();
 
 	return 0;
@@ -0,0 +1,506 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/*
+ * Discrete-event task scheduling for the emulator.
+ *
+ * Instead of running each task in its own thread and letting the host OS
+ * decide who goes next, every task (and the interrupt generator) is a
+ * coroutine on the main thread. Time is virtual: it only moves when a task
+ * sleeps or calls udelay(), and it jumps straight to the next wake time when
+ * nothing is ready to run. A test built this way runs as fast as the CPU
+ * allows and does exactly the same thing every time.
+ *
+ * Tests opt in with "<test>-discrete=y" in test/build.mk.
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "atomic.h"
+#include "common.h"
+#include "compile_time_macros.h"
+#include "console.h"
+#include "host_task.h"
+#include "task.h"
+#include "task_id.h"
+#include "test_util.h"
+#include "timer.h"
+
+/* Generous, since host tasks end up in printf() and friends */
+#define TASK_STACK_SIZE (256 * 1024)
+
+/* The interrupt generator gets the slot after the last task */
+#define INT_GEN_SLOT TASK_ID_COUNT
+#define SLOT_COUNT (TASK_ID_COUNT + 1)
+
+/* Not waiting for a timer */
+#define NEVER (~0ull)
+
+struct emu_task_t {
+	ucontext_t context;
+	void *stack;
+	uint32_t event;
+	timestamp_t wake_time;
+	int heap_pos;		/* in wake_heap[], or -1 */
+	uint8_t enabled;
+	uint8_t started;
+	uint8_t exited;
+};
+
+struct task_args {
+	void (*routine)(void *);
+	void *d;
+};
+
+static struct emu_task_t tasks[SLOT_COUNT];
+static ucontext_t scheduler_context;
+static pthread_t main_thread;
+static int current_slot;
+static task_id_t running_task_id;
+static int task_started;
+static int all_tasks_enabled;
+
+static int in_interrupt;
+static int interrupt_disabled;
+static void (*deferred_isr)(void);
+
+/* Tasks whose timer has expired, but which haven't run yet */
+static uint32_t timer_expired;
+
+/*
+ * Wake times, as a binary min-heap of slots. Ties go to the higher slot, which
+ * is the same order the scheduler would run them in anyway.
+ */
+static int wake_heap[SLOT_COUNT];
+static int wake_heap_size;
+
+BUILD_ASSERT(SLOT_COUNT <= 32);
+
+#define TASK(n, r, d, s) void r(void *);
+CONFIG_TASK_LIST
+CONFIG_TEST_TASK_LIST
+#undef TASK
+
+/* Idle task */
+void __idle(void *d)
+{
+	while (1)
+		task_wait_event(-1);
+}
+
+void _run_test(void *d)
+{
+	run_test();
+}
+
+#define TASK(n, r, d, s) {r, d},
+struct task_args task_info[TASK_ID_COUNT] = {
+	{__idle, NULL},
+	CONFIG_TASK_LIST
+	CONFIG_TEST_TASK_LIST
+	{_run_test, NULL},
+};
+#undef TASK
+
+#define TASK(n, r, d, s) #n,
+static const char * const task_names[] = {
+	"<< idle >>",
+	CONFIG_TASK_LIST
+	CONFIG_TEST_TASK_LIST
+	"<< test runner >>",
+};
+#undef TASK
+
+/*****************************************************************************/
+/* Wake time queue */
+
+static int wakes_before(int a, int b)
+{
+	if (tasks[a].wake_time.val != tasks[b].wake_time.val)
+		return tasks[a].wake_time.val < tasks[b].wake_time.val;
+	return a > b;
+}
+
+static void heap_swap(int i, int j)
+{
+	int t = wake_heap[i];
+
+	wake_heap[i] = wake_heap[j];
+	wake_heap[j] = t;
+	tasks[wake_heap[i]].heap_pos = i;
+	tasks[wake_heap[j]].heap_pos = j;
+}
+
+static void heap_sift(int i)
+{
+	int child;
+
+	while (i > 0 && wakes_before(wake_heap[i], wake_heap[(i - 1) / 2])) {
+		heap_swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+
+	while ((child = 2 * i + 1) < wake_heap_size) {
+		if (child + 1 < wake_heap_size &&
+		    wakes_before(wake_heap[child + 1], wake_heap[child]))
+			child++;
+		if (!wakes_before(wake_heap[child], wake_heap[i]))
+			break;
+		heap_swap(i, child);
+		i = child;
+	}
+}
+
+static void heap_remove(int slot)
+{
+	int i = tasks[slot].heap_pos;
+
+	if (i < 0)
+		return;
+
+	tasks[slot].heap_pos = -1;
+	if (--wake_heap_size == i)
+		return;
+
+	wake_heap[i] = wake_heap[wake_heap_size];
+	tasks[wake_heap[i]].heap_pos = i;
+	heap_sift(i);
+}
+
+static void heap_add(int slot, uint64_t wake_time)
+{
+	heap_remove(slot);
+
+	tasks[slot].wake_time.val = wake_time;
+	tasks[slot].heap_pos = wake_heap_size;
+	wake_heap[wake_heap_size++] = slot;
+	heap_sift(wake_heap_size - 1);
+}
+
+/*****************************************************************************/
+/* Interrupts */
+
+void task_pre_init(void)
+{
+	/* Nothing */
+}
+
+int in_interrupt_context(void)
+{
+	return !!in_interrupt;
+}
+
+void interrupt_disable(void)
+{
+	interrupt_disabled = 1;
+}
+
+void interrupt_enable(void)
+{
+	interrupt_disabled = 0;
+}
+
+void task_register_interrupt(void)
+{
+	main_thread = pthread_self();
+}
+
+void task_trigger_test_interrupt(void (*isr)(void))
+{
+	if (interrupt_disabled)
+		return;
+
+	/* Interrupts don't nest; run this one when the current one is done */
+	if (in_interrupt) {
+		deferred_isr = isr;
+		return;
+	}
+
+	/*
+	 * Whoever triggered the interrupt isn't running task code until we
+	 * return, so that's as good as preempting it.
+	 */
+	in_interrupt = 1;
+	isr();
+	while (deferred_isr) {
+		isr = deferred_isr;
+		deferred_isr = NULL;
+		isr();
+	}
+	in_interrupt = 0;
+}
+
+/*****************************************************************************/
+/* Tasks */
+
+/* Give control back to the scheduler until somebody wakes us */
+static void task_yield(void)
+{
+	swapcontext(&tasks[current_slot].context, &scheduler_context);
+}
+
+void interrupt_generator_udelay(unsigned us)
+{
+	heap_add(INT_GEN_SLOT, get_time().val + us);
+	task_yield();
+}
+
+const char *task_get_name(task_id_t tskid)
+{
+	return task_names[tskid];
+}
+
+pthread_t task_get_thread(task_id_t tskid)
+{
+	/* Everybody shares the main thread */
+	return main_thread;
+}
+
+uint32_t task_set_event(task_id_t tskid, uint32_t event, int wait)
+{
+	tasks[tskid].event = event;
+	if (wait)
+		return task_wait_event(-1);
+	return 0;
+}
+
+uint32_t task_wait_event(int timeout_us)
+{
+	int tid = task_get_current();
+	uint32_t ret;
+
+	if (timeout_us > 0)
+		heap_add(tid, get_time().val + timeout_us);
+
+	task_yield();
+
+	ret = tasks[tid].event;
+	tasks[tid].event = 0;
+	return ret;
+}
+
+uint32_t task_wait_event_mask(uint32_t event_mask, int timeout_us)
+{
+	uint64_t deadline = get_time().val + timeout_us;
+	uint32_t events = 0;
+	int time_remaining_us = timeout_us;
+
+	/* Add the timer event to the mask so we can indicate a timeout */
+	event_mask |= TASK_EVENT_TIMER;
+
+	while (!(events & event_mask)) {
+		/* Collect events to re-post later */
+		events |= task_wait_event(time_remaining_us);
+
+		time_remaining_us = deadline - get_time().val;
+		if (timeout_us > 0 && time_remaining_us <= 0) {
+			/* Ensure we return a TIMER event if we timeout */
+			events |= TASK_EVENT_TIMER;
+			break;
+		}
+	}
+
+	/* Re-post any other events collected */
+	if (events & ~event_mask)
+		tasks[task_get_current()].event |= events & ~event_mask;
+
+	return events & event_mask;
+}
+
+void mutex_lock(struct mutex *mtx)
+{
+	int id = 1 << task_get_current();
+
+	mtx->waiters |= id;
+
+	/*
+	 * Nobody else runs until we wait, so there's no race between looking
+	 * at the lock and taking it.
+	 */
+	while (mtx->lock)
+		/* TODO(crbug.com/435612, crbug.com/435611)
+		 * This discards any pending events! */
+		task_wait_event(-1);
+	mtx->lock = 1;
+
+	mtx->waiters &= ~id;
+}
+
+void mutex_unlock(struct mutex *mtx)
+{
+	int v;
+	mtx->lock = 0;
+
+	for (v = 31; v >= 0; --v)
+		if ((1ul << v) & mtx->waiters) {
+			mtx->waiters &= ~(1ul << v);
+			task_set_event(v, TASK_EVENT_MUTEX, 0);
+			break;
+		}
+}
+
+task_id_t task_get_current(void)
+{
+	return current_slot == INT_GEN_SLOT ? TASK_ID_INT_GEN : current_slot;
+}
+
+task_id_t task_get_running(void)
+{
+	return running_task_id;
+}
+
+void wait_for_task_started(void)
+{
+	int i;
+
+	for (i = 0; i < TASK_ID_COUNT - 1; ++i)
+		while (!tasks[i].started)
+			msleep(10);
+}
+
+int task_start_called(void)
+{
+	return task_started;
+}
+
+test_mockable void interrupt_generator(void)
+{
+}
+
+static void task_entry(int slot)
+{
+	if (slot == INT_GEN_SLOT) {
+		interrupt_generator();
+	} else {
+		/* Discard whatever woke us to start */
+		tasks[slot].event = 0;
+		task_info[slot].routine(task_info[slot].d);
+	}
+
+	/* Catch exited routine */
+	tasks[slot].exited = 1;
+	heap_remove(slot);
+	while (1)
+		task_yield();
+}
+
+static void task_create(int slot)
+{
+	struct emu_task_t *t = tasks + slot;
+
+	t->stack = malloc(TASK_STACK_SIZE);
+	if (!t->stack) {
+		fprintf(stderr, "Can't allocate stack for task %d\n", slot);
+		exit(1);
+	}
+
+	getcontext(&t->context);
+	t->context.uc_stack.ss_sp = t->stack;
+	t->context.uc_stack.ss_size = TASK_STACK_SIZE;
+	t->context.uc_link = NULL;
+	makecontext(&t->context, (void (*)(void))task_entry, 1, slot);
+
+	t->event = TASK_EVENT_WAKE;
+	t->wake_time.val = NEVER;
+	t->heap_pos = -1;
+	t->enabled = 1;
+}
+
+/* Pick the next slot to run, moving time forward if nobody is ready yet. */
+static int task_get_next(void)
+{
+	timestamp_t now;
+	int i;
+
+	while (1) {
+		now = get_time();
+		while (wake_heap_size &&
+		       tasks[wake_heap[0]].wake_time.val <= now.val) {
+			i = wake_heap[0];
+			heap_remove(i);
+			timer_expired |= 1 << i;
+		}
+
+		/* The interrupt generator preempts everything */
+		if (timer_expired & (1 << INT_GEN_SLOT))
+			return INT_GEN_SLOT;
+
+		for (i = TASK_ID_COUNT - 1; i >= 0; --i)
+			if (tasks[i].enabled && !tasks[i].exited &&
+			    (tasks[i].event || (timer_expired & (1 << i))))
+				return i;
+
+		if (!wake_heap_size) {
+			/*
+			 * Everybody is waiting for everybody else. The threaded
+			 * emulator would hang here until the test timed out.
+			 */
+			fprintf(stderr, "All tasks blocked forever at %.6f s\n",
+				(double)now.val / SECOND);
+			emulator_flush();
+			exit(1);
+		}
+
+		force_time(tasks[wake_heap[0]].wake_time);
+	}
+}
+
+void task_scheduler(void)
+{
+	int i;
+
+	task_started = 1;
+
+	while (1) {
+		if (all_tasks_enabled == 1) {
+			for (i = 0; i < TASK_ID_COUNT; ++i)
+				if (!tasks[i].enabled)
+					task_create(i);
+			all_tasks_enabled = 2;
+		}
+
+		i = task_get_next();
+		timer_expired &= ~(1 << i);
+		heap_remove(i);
+		tasks[i].wake_time.val = NEVER;
+
+		current_slot = i;
+		if (i != INT_GEN_SLOT) {
+			running_task_id = i;
+			tasks[i].started = 1;
+		}
+		swapcontext(&scheduler_context, &tasks[i].context);
+	}
+}
+
+int task_start(void)
+{
+	/*
+	 * Start with just the hooks task. After HOOK_INIT, it will call back
+	 * to enable the remaining tasks.
+	 */
+	task_create(TASK_ID_HOOKS);
+
+	/* The interrupt generator is ready to go straight away */
+	task_create(INT_GEN_SLOT);
+	tasks[INT_GEN_SLOT].event = 0;
+	heap_add(INT_GEN_SLOT, get_time().val);
+
+	task_scheduler();
+
+	return 0;
+}
+
+void task_enable_all_tasks(void)
+{
+	/* The scheduler starts them next time round */
+	if (!all_tasks_enabled)
+		all_tasks_enabled = 1;
+}
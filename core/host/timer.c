@@ -34,7 +34,9 @@
  */
 #define TEST_TIME_SLOW_DOWN 10
 
+#ifndef TEST_DISCRETE_EVENT
 static timestamp_t boot_time;
+#endif
 static int time_set;
 
 void usleep(unsigned us)
@@ -50,6 +52,42 @@ void usleep(unsigned us)
 	task_wait_event(us);
 }
 
+#ifdef TEST_DISCRETE_EVENT
+
+/*
+ * Virtual time. It moves when somebody waits for it, or when the scheduler
+ * skips ahead to the next wake time. Reading the clock also costs a
+ * microsecond, so code that polls it until a deadline still gets there.
+ */
+static timestamp_t sim_time;
+
+timestamp_t get_time(void)
+{
+	timestamp_t ret = sim_time;
+
+	sim_time.val++;
+	return ret;
+}
+
+void force_time(timestamp_t ts)
+{
+	sim_time = ts;
+	time_set = 1;
+}
+
+void udelay(unsigned us)
+{
+	if (!in_interrupt_context() && task_get_current() == TASK_ID_INT_GEN) {
+		interrupt_generator_udelay(us);
+		return;
+	}
+
+	/* Nobody else runs while we spin, so just skip to the end */
+	sim_time.val += us;
+}
+
+#else  /* !TEST_DISCRETE_EVENT */
+
 timestamp_t _get_time(void)
 {
 	struct timespec ts;
@@ -88,6 +126,8 @@ void udelay(unsigned us)
 		;
 }
 
+#endif  /* TEST_DISCRETE_EVENT */
+
 int timestamp_expired(timestamp_t deadline, const timestamp_t *now)
 {
 	timestamp_t now_val;
@@ -102,6 +142,8 @@ int timestamp_expired(timestamp_t deadline, const timestamp_t *now)
 
 void timer_init(void)
 {
+#ifndef TEST_DISCRETE_EVENT
 	if (!time_set)
 		boot_time = _get_time();
+#endif
 }
@@ -33,7 +33,7 @@ static void isl29035_init(void)
 	(void)i2c_write8(I2C_PORT_ALS, ILS29035_I2C_ADDR,
 			 ILS29035_REG_COMMAND_I, 0xa0);
 }
-DECLARE_HOOK(HOOK_CHIPSET_RESUME, isl29035_init, HOOK_PRIO_DEFAULT);
+DECLARE_HOOK(HOOK_CHIPSET_RESUME_DEFERRED, isl29035_init, HOOK_PRIO_DEFAULT);
 
 int isl29035_read_lux(int *lux, int af)
 {
@@ -86,9 +86,150 @@ int sb_read_string(int port, int slave_addr, int offset, uint8_t *data,
 #endif
 }
 
+#ifdef CONFIG_BATTERY_SMART_CACHE
+/*
+ * Registers that don't need to be read from the battery every time they're
+ * asked for. Anything not listed here (current, voltage, and what the battery
+ * is asking the charger for) is always read fresh. Entries with no max_age
+ * only change if the battery does, so any failed read drops the whole cache.
+ */
+#define SB_CACHE_SLOW	(10 * SECOND)
+
+struct sb_cache_entry {
+	uint8_t cmd;
+	uint32_t max_age;		/* usec, or 0 to keep until invalidated */
+	uint8_t valid;
+	uint16_t value;
+	uint32_t read_at;
+};
+
+static struct sb_cache_entry sb_cache[] = {
+	{SB_BATTERY_MODE, SB_CACHE_SLOW},
+	{SB_TEMPERATURE, SB_CACHE_SLOW},
+	{SB_RELATIVE_STATE_OF_CHARGE, SB_CACHE_SLOW},
+	{SB_REMAINING_CAPACITY, SB_CACHE_SLOW},
+	{SB_FULL_CHARGE_CAPACITY, SB_CACHE_SLOW},
+	{SB_CYCLE_COUNT, SB_CACHE_SLOW},
+	{SB_DESIGN_CAPACITY, 0},
+	{SB_DESIGN_VOLTAGE, 0},
+	{SB_SPECIFICATION_INFO, 0},
+	{SB_SERIAL_NUMBER, 0},
+};
+
+/* Strings are read once, as a single SMBus block read each */
+struct sb_string_cache_entry {
+	uint8_t cmd;
+	uint8_t valid;
+	char data[32];
+};
+
+static struct sb_string_cache_entry sb_string_cache[] = {
+	{SB_MANUFACTURER_NAME},
+	{SB_DEVICE_NAME},
+	{SB_DEVICE_CHEMISTRY},
+};
+
+void sb_cache_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sb_cache); i++)
+		sb_cache[i].valid = 0;
+	for (i = 0; i < ARRAY_SIZE(sb_string_cache); i++)
+		sb_string_cache[i].valid = 0;
+}
+
+static struct sb_cache_entry *sb_cache_find(int cmd)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(sb_cache); i++)
+		if (sb_cache[i].cmd == cmd)
+			return &sb_cache[i];
+	return NULL;
+}
+
+static int sb_read_cached(int cmd, int *param)
+{
+	struct sb_cache_entry *e = sb_cache_find(cmd);
+	uint32_t now = get_time().le.lo;
+	int rv;
+
+	if (!e)
+		return sb_read(cmd, param);
+
+	if (e->valid && (!e->max_age || now - e->read_at < e->max_age)) {
+		*param = e->value;
+		return EC_SUCCESS;
+	}
+
+	rv = sb_read(cmd, param);
+	if (rv) {
+		sb_cache_invalidate();
+		return rv;
+	}
+
+	e->value = *param;
+	e->read_at = now;
+	e->valid = 1;
+	return EC_SUCCESS;
+}
+
+/* Forget one register, because we've just changed it */
+static void sb_cache_drop(int cmd)
+{
+	struct sb_cache_entry *e = sb_cache_find(cmd);
+
+	if (e)
+		e->valid = 0;
+}
+
+static int sb_read_string_cached(int cmd, char *dest, int size)
+{
+	struct sb_string_cache_entry *s = NULL;
+	int i, rv;
+
+	for (i = 0; i < ARRAY_SIZE(sb_string_cache); i++)
+		if (sb_string_cache[i].cmd == cmd)
+			s = &sb_string_cache[i];
+
+	if (!s)
+		return sb_read_string(I2C_PORT_BATTERY, BATTERY_ADDR, cmd,
+				      (uint8_t *)dest, size);
+
+	if (!s->valid) {
+		rv = sb_read_string(I2C_PORT_BATTERY, BATTERY_ADDR, cmd,
+				    (uint8_t *)s->data, sizeof(s->data));
+		if (rv) {
+			sb_cache_invalidate();
+			return rv;
+		}
+		s->valid = 1;
+	}
+
+	strzcpy(dest, s->data, size);
+	return EC_SUCCESS;
+}
+#else
+static inline int sb_read_cached(int cmd, int *param)
+{
+	return sb_read(cmd, param);
+}
+
+static inline void sb_cache_drop(int cmd)
+{
+}
+
+static inline int sb_read_string_cached(int cmd, char *dest, int size)
+{
+	return sb_read_string(I2C_PORT_BATTERY, BATTERY_ADDR, cmd,
+			      (uint8_t *)dest, size);
+}
+#endif
+
 int battery_get_mode(int *mode)
 {
-	return sb_read(SB_BATTERY_MODE, mode);
+	return sb_read_cached(SB_BATTERY_MODE, mode);
 }
 
 /**
@@ -104,8 +245,10 @@ static int battery_force_mah_mode(void)
 	if (rv)
 		return rv;
 
-	if (val & MODE_CAPACITY)
+	if (val & MODE_CAPACITY) {
 		rv = sb_write(SB_BATTERY_MODE, val & ~MODE_CAPACITY);
+		sb_cache_drop(SB_BATTERY_MODE);
+	}
 
 	return rv;
 }
@@ -121,7 +264,7 @@ int battery_remaining_capacity(int *capacity)
 	if (rv)
 		return rv;
 
-	return sb_read(SB_REMAINING_CAPACITY, capacity);
+	return sb_read_cached(SB_REMAINING_CAPACITY, capacity);
 }
 
 int battery_full_charge_capacity(int *capacity)
@@ -130,7 +273,7 @@ int battery_full_charge_capacity(int *capacity)
 	if (rv)
 		return rv;
 
-	return sb_read(SB_FULL_CHARGE_CAPACITY, capacity);
+	return sb_read_cached(SB_FULL_CHARGE_CAPACITY, capacity);
 }
 
 int battery_time_to_empty(int *minutes)
@@ -157,7 +300,7 @@ int battery_status(int *status)
 /* Battery charge cycle count */
 int battery_cycle_count(int *count)
 {
-	return sb_read(SB_CYCLE_COUNT, count);
+	return sb_read_cached(SB_CYCLE_COUNT, count);
 }
 
 int battery_design_capacity(int *capacity)
@@ -166,7 +309,7 @@ int battery_design_capacity(int *capacity)
 	if (rv)
 		return rv;
 
-	return sb_read(SB_DESIGN_CAPACITY, capacity);
+	return sb_read_cached(SB_DESIGN_CAPACITY, capacity);
 }
 
 /* Designed battery output voltage
@@ -174,13 +317,13 @@ int battery_design_capacity(int *capacity)
  */
 int battery_design_voltage(int *voltage)
 {
-	return sb_read(SB_DESIGN_VOLTAGE, voltage);
+	return sb_read_cached(SB_DESIGN_VOLTAGE, voltage);
 }
 
 /* Read serial number */
 int battery_serial_number(int *serial)
 {
-	return sb_read(SB_SERIAL_NUMBER, serial);
+	return sb_read_cached(SB_SERIAL_NUMBER, serial);
 }
 
 test_mockable int battery_time_at_rate(int rate, int *minutes)
@@ -229,7 +372,7 @@ test_mockable int battery_manufacture_date(int *year, int *month, int *day)
 	int rv;
 	int ymd;
 
-	rv = sb_read(SB_SPECIFICATION_INFO, &ymd);
+	rv = sb_read_cached(SB_SPECIFICATION_INFO, &ymd);
 	if (rv)
 		return rv;
 
@@ -246,22 +389,19 @@ test_mockable int battery_manufacture_date(int *year, int *month, int *day)
 /* Read manufacturer name */
 test_mockable int battery_manufacturer_name(char *dest, int size)
 {
-	return sb_read_string(I2C_PORT_BATTERY, BATTERY_ADDR,
-			       SB_MANUFACTURER_NAME, dest, size);
+	return sb_read_string_cached(SB_MANUFACTURER_NAME, dest, size);
 }
 
 /* Read device name */
 test_mockable int battery_device_name(char *dest, int size)
 {
-	return sb_read_string(I2C_PORT_BATTERY, BATTERY_ADDR,
-			       SB_DEVICE_NAME, dest, size);
+	return sb_read_string_cached(SB_DEVICE_NAME, dest, size);
 }
 
 /* Read battery type/chemistry */
 test_mockable int battery_device_chemistry(char *dest, int size)
 {
-	return sb_read_string(I2C_PORT_BATTERY, BATTERY_ADDR,
-			       SB_DEVICE_CHEMISTRY, dest, size);
+	return sb_read_string_cached(SB_DEVICE_CHEMISTRY, dest, size);
 }
 
 void battery_get_params(struct batt_params *batt)
@@ -269,10 +409,11 @@ void battery_get_params(struct batt_params *batt)
 	struct batt_params batt_new = {0};
 	int v;
 
-	if (sb_read(SB_TEMPERATURE, &batt_new.temperature))
+	if (sb_read_cached(SB_TEMPERATURE, &batt_new.temperature))
 		batt_new.flags |= BATT_FLAG_BAD_TEMPERATURE;
 
-	if (sb_read(SB_RELATIVE_STATE_OF_CHARGE, &batt_new.state_of_charge))
+	if (sb_read_cached(SB_RELATIVE_STATE_OF_CHARGE,
+			   &batt_new.state_of_charge))
 		batt_new.flags |= BATT_FLAG_BAD_STATE_OF_CHARGE;
 
 	if (sb_read(SB_VOLTAGE, &batt_new.voltage))
@@ -300,6 +441,10 @@ void battery_get_params(struct batt_params *batt)
 	if ((batt_new.flags & BATT_FLAG_BAD_ANY) != BATT_FLAG_BAD_ANY)
 		batt_new.flags |= BATT_FLAG_RESPONSIVE;
 
+	/* The battery may have been reset or swapped; don't trust the cache */
+	if (batt_new.flags & BATT_FLAG_BAD_ANY)
+		sb_cache_invalidate();
+
 #if defined(CONFIG_BATTERY_PRESENT_CUSTOM) ||	\
 	defined(CONFIG_BATTERY_PRESENT_GPIO)
 	/* Hardware can tell us for certain */
@@ -412,6 +557,8 @@ static int host_command_sb_write_word(struct host_cmd_handler_args *args)
 	if (p->reg > 0x1c)
 		return EC_RES_INVALID_PARAM;
 	rv = sb_write(p->reg, p->value);
+	/* We don't know what that did to the rest of the registers */
+	sb_cache_invalidate();
 	if (rv)
 		return EC_RES_ERROR;
 
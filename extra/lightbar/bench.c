@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Headless lightbar benchmark. Each lightbyte program is run by the real
+ * lightbar task and LED controller code against a simulated clock and I2C
+ * bus, so a long run takes no real time. We count what it costs (opcodes,
+ * I2C transactions and bytes, task wakeups) and compare the colors it
+ * produces against a golden trace.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "simulation.h"
+
+static int verbose;
+static int update_golden;
+static const char *golden_dir = "golden";
+static const char *prog_name;
+
+/* Simulated time, in usecs */
+static uint64_t sim_time;
+static uint64_t sim_limit = 10 * SECOND;
+static uint32_t sim_event;
+
+/* What the program cost us */
+static unsigned int opcodes;
+static unsigned int i2c_xfers;
+static unsigned int i2c_bytes;
+static unsigned int wakeups;
+
+/* The registers of both LED controllers, as lb_common.c left them */
+static uint8_t ctrl_regs[2][0x20];
+
+/* What the LEDs look like, and what they looked like last time we said */
+static uint8_t traced_leds[NUM_LEDS][3];
+static int traced_power = -1;
+static int traced_brightness = -1;
+
+static FILE *trace;
+static char *trace_buf;
+static size_t trace_len;
+
+/* The controllers' standby bit, which lb_on() and lb_off() set and clear */
+static int leds_powered(void)
+{
+	return !!(ctrl_regs[0][0x01] & 0x20);
+}
+
+/* Add a line to the trace if the visible state has changed */
+static void trace_frame(void)
+{
+	uint8_t leds[NUM_LEDS][3];
+	int fake_power = leds_powered();
+	int brightness = lb_get_brightness();
+	int i;
+
+	for (i = 0; i < NUM_LEDS; i++)
+		lb_get_rgb(i, &leds[i][0], &leds[i][1], &leds[i][2]);
+
+	if (fake_power == traced_power && brightness == traced_brightness &&
+	    !memcmp(leds, traced_leds, sizeof(leds)))
+		return;
+
+	fprintf(trace, "%10" PRIu64 " %-3s %02x", sim_time,
+		fake_power ? "on" : "off", brightness);
+	for (i = 0; i < NUM_LEDS; i++)
+		fprintf(trace, " %02x%02x%02x",
+			leds[i][0], leds[i][1], leds[i][2]);
+	fprintf(trace, "\n");
+
+	memcpy(traced_leds, leds, sizeof(leds));
+	traced_power = fake_power;
+	traced_brightness = brightness;
+}
+
+static int write_golden(const char *filename)
+{
+	FILE *fp = fopen(filename, "w");
+
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			filename, strerror(errno));
+		return 1;
+	}
+	fwrite(trace_buf, 1, trace_len, fp);
+	fclose(fp);
+	return 0;
+}
+
+/* Compare the trace with the golden one, reporting the first difference */
+static int check_golden(const char *filename)
+{
+	FILE *fp = fopen(filename, "r");
+	char want[128];
+	const char *got = trace_buf;
+	const char *eol;
+	int line;
+
+	if (!fp) {
+		fprintf(stderr, "Can't open %s: %s\n",
+			filename, strerror(errno));
+		return 1;
+	}
+
+	for (line = 1; *got; line++, got = eol + 1) {
+		eol = strchr(got, '\n');
+		if (!fgets(want, sizeof(want), fp)) {
+			fprintf(stderr, "%s:%d: extra: %.*s\n", filename, line,
+				(int)(eol - got), got);
+			fclose(fp);
+			return 1;
+		}
+		if (strlen(want) != eol - got + 1 ||
+		    strncmp(want, got, eol - got + 1)) {
+			fprintf(stderr, "%s:%d: want: %s", filename, line,
+				want);
+			fprintf(stderr, "%s:%d: got:  %.*s\n", filename, line,
+				(int)(eol - got), got);
+			fclose(fp);
+			return 1;
+		}
+	}
+	if (fgets(want, sizeof(want), fp)) {
+		fprintf(stderr, "%s:%d: missing: %s", filename, line, want);
+		fclose(fp);
+		return 1;
+	}
+
+	fclose(fp);
+	return 0;
+}
+
+/* The simulated time is up. Report on this program and quit. */
+static void finish(void)
+{
+	char filename[256];
+	const char *base, *dot;
+	double secs = (double)sim_limit / SECOND;
+	int rv;
+
+	fclose(trace);
+
+	base = strrchr(prog_name, '/');
+	base = base ? base + 1 : prog_name;
+	dot = strrchr(base, '.');
+	snprintf(filename, sizeof(filename), "%s/%.*s.trace", golden_dir,
+		 dot ? (int)(dot - base) : (int)strlen(base), base);
+
+	if (update_golden)
+		rv = write_golden(filename);
+	else
+		rv = check_golden(filename);
+
+	printf("%-24s %10.1f %10.1f %10.1f %10.1f  %s\n",
+	       base, opcodes / secs, i2c_xfers / secs, i2c_bytes / secs,
+	       wakeups / secs,
+	       rv ? "FAIL" : update_golden ? "updated" : "ok");
+	fflush(stdout);
+	exit(rv);
+}
+
+/* Run one program in the lightbar task. This doesn't return. */
+static void run_program(const char *filename)
+{
+	char *load[] = { "lightbar", "program", (char *)filename };
+	char *seq[] = { "lightbar", "seq", "program" };
+
+	prog_name = filename;
+	trace = open_memstream(&trace_buf, &trace_len);
+
+	if (fake_consolecmd_lightbar(ARRAY_SIZE(load), load))
+		exit(1);
+	fake_consolecmd_lightbar(ARRAY_SIZE(seq), seq);
+
+	lightbar_task();
+}
+
+static void usage(const char *progname)
+{
+	printf("\nUsage: %s [-u] [-v] [-g DIR] [-t SECS] PROGRAM.bin...\n\n"
+	       "Run lightbyte programs for SECS simulated seconds (default"
+	       " %d), report\nthe opcodes, I2C transactions, I2C bytes and"
+	       " task wakeups per second, and\ncompare the LED colors with"
+	       " the golden traces in DIR (default \"%s\").\n\n"
+	       "  -u  Update the golden traces instead of checking them\n"
+	       "  -v  Show the lightbar console output\n\n",
+	       progname, (int)(sim_limit / SECOND), golden_dir);
+}
+
+int main(int argc, char *argv[])
+{
+	int c, i, status;
+	int failed = 0;
+	pid_t pid;
+
+	while ((c = getopt(argc, argv, "g:t:uvh")) != -1) {
+		switch (c) {
+		case 'g':
+			golden_dir = optarg;
+			break;
+		case 't':
+			sim_limit = strtoul(optarg, NULL, 0) * SECOND;
+			break;
+		case 'u':
+			update_golden = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind == argc || sim_limit < SECOND) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	printf("%-24s %10s %10s %10s %10s\n", "program", "opcodes/s",
+	       "xfers/s", "bytes/s", "wakeups/s");
+
+	/* Each program gets a fresh copy of the lightbar task's state */
+	for (i = optind; i < argc; i++) {
+		fflush(stdout);
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid)
+			run_program(argv[i]);
+		if (waitpid(pid, &status, 0) < 0 ||
+		    !WIFEXITED(status) || WEXITSTATUS(status)) {
+			if (!WIFEXITED(status))
+				printf("%-24s crashed\n", argv[i]);
+			failed++;
+		}
+	}
+
+	if (failed)
+		printf("\n%d of %d programs failed\n", failed, argc - optind);
+	return !!failed;
+}
+
+/****************************************************************************/
+/* Fake functions. We only have to implement enough for lightbar.c and
+ * lb_common.c */
+
+uint32_t task_wait_event(int timeout_us)
+{
+	uint32_t event;
+
+	trace_frame();
+	wakeups++;
+
+	if (sim_event) {
+		event = sim_event;
+		sim_event = 0;
+		return event;
+	}
+
+	/* Nobody else is going to wake us, so that's the end of it */
+	if (timeout_us < 0 || sim_time + timeout_us >= sim_limit) {
+		sim_time = sim_limit;
+		finish();
+	}
+
+	sim_time += timeout_us;
+	return TASK_EVENT_TIMER;
+}
+
+uint32_t task_set_event(task_id_t tskid,	/* always LIGHTBAR */
+			uint32_t event,
+			int wait_for_reply)	/* always 0 */
+{
+	sim_event |= event;
+	return 0;
+}
+
+timestamp_t get_time(void)
+{
+	timestamp_t ret;
+
+	ret.val = sim_time;
+	return ret;
+}
+
+void cprintf(int zero, const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+	char *newfmt;
+
+	if (!verbose)
+		return;
+
+	newfmt = strdup(fmt);
+	for (s = newfmt; *s; s++)
+		if (*s == '%' && s[1] == 'T')
+			*s = 'T';
+
+	va_start(ap, fmt);
+	vprintf(newfmt, ap);
+	va_end(ap);
+
+	free(newfmt);
+}
+
+void cprints(int zero, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!verbose)
+		return;
+
+	printf("[%" PRIu64 " ", sim_time);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("]\n");
+}
+
+int system_add_jump_tag(uint16_t tag, int version, int size, const void *data)
+{
+	return 0;
+}
+
+uint8_t *system_get_jump_tag(uint16_t tag, int *version, int *size)
+{
+	return 0;
+}
+
+void lb_sim_opcode(uint8_t opcode)
+{
+	opcodes++;
+}
+
+/*
+ * The LED controllers. The register address goes out first, and the
+ * ADP886x auto-increments it for multi-byte accesses. Bytes are what goes
+ * over the bus after the slave address: the register address, then the data.
+ */
+
+static uint8_t *ctrl_reg(int slave_addr, int reg)
+{
+	return &ctrl_regs[slave_addr == 0x56][reg % sizeof(ctrl_regs[0])];
+}
+
+int i2c_xfer(int port, int slave_addr, const uint8_t *out, int out_size,
+	     uint8_t *in, int in_size, int flags)
+{
+	int i;
+
+	i2c_xfers++;
+	i2c_bytes += out_size + in_size;
+
+	for (i = 1; i < out_size; i++)
+		*ctrl_reg(slave_addr, out[0] + i - 1) = out[i];
+	for (i = 0; i < in_size; i++)
+		in[i] = *ctrl_reg(slave_addr, out[0] + i);
+
+	return 0;
+}
+
+void i2c_lock(int port, int lock)
+{
+}
+
+int i2c_write8(int port, int slave_addr, int offset, int data)
+{
+	uint8_t out[2] = { offset, data };
+
+	return i2c_xfer(port, slave_addr, out, 2, NULL, 0, I2C_XFER_SINGLE);
+}
+
+int i2c_read8(int port, int slave_addr, int offset, int *data)
+{
+	uint8_t out = offset;
+	uint8_t in;
+	int rv;
+
+	rv = i2c_xfer(port, slave_addr, &out, 1, &in, 1, I2C_XFER_SINGLE);
+	*data = in;
+	return rv;
+}
+
+int lb_power(int enabled)
+{
+	return leds_powered();
+}
@@ -24,6 +24,8 @@ void init_windows(void);
 int lb_read_params_from_file(const char *filename,
 			     struct lightbar_params_v1 *p);
 int lb_load_program(const char *filename, struct lightbar_program *prog);
+/* Called by the lightbyte interpreter for each opcode it executes */
+void lb_sim_opcode(uint8_t opcode);
 /* Interfaces to the EC code that we're encapsulating */
 void lightbar_task(void);
 int fake_consolecmd_lightbar(int argc, char *argv[]);
@@ -93,6 +95,16 @@ struct host_cmd_handler_args {
 	int response_size;
 };
 
+/* I2C, for lb_common.c */
+#define I2C_PORT_LIGHTBAR 0
+#define I2C_XFER_SINGLE 3
+
+int i2c_read8(int port, int slave_addr, int offset, int *data);
+int i2c_write8(int port, int slave_addr, int offset, int data);
+int i2c_xfer(int port, int slave_addr, const uint8_t *out, int out_size,
+	     uint8_t *in, int in_size, int flags);
+void i2c_lock(int port, int lock);
+
 /* EC functions that we have to provide */
 uint32_t task_wait_event(int timeout_us);
 uint32_t task_set_event(task_id_t tskid, uint32_t event, int wait_for_reply);
@@ -207,6 +207,9 @@ void lb_set_rgb(unsigned int led, int red, int green, int blue)
 		setrgb(led, red, green, blue);
 }
 
+void lb_batch_begin(void) { }
+void lb_batch_end(void) { }
+
 int lb_get_rgb(unsigned int led, uint8_t *red, uint8_t *green, uint8_t *blue)
 {
 	led %= NUM_LEDS;
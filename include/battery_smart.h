@@ -153,5 +153,12 @@ int sb_read_string(int port, int slave_addr, int offset, uint8_t *data,
 /* Write to battery */
 int sb_write(int cmd, int param);
 
+/* Forget any battery register values cached by the smart battery driver */
+#ifdef CONFIG_BATTERY_SMART_CACHE
+void sb_cache_invalidate(void);
+#else
+static inline void sb_cache_invalidate(void) { }
+#endif
+
 #endif /* __CROS_EC_BATTERY_SMART_H */
 
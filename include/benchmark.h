@@ -0,0 +1,54 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Microbenchmarks for common code */
+
+#ifndef __CROS_EC_BENCHMARK_H
+#define __CROS_EC_BENCHMARK_H
+
+#include "common.h"
+
+struct benchmark_t {
+	const char *name;
+	/* Called once before timing starts, if not NULL */
+	void (*setup)(void);
+	/* The operation being timed */
+	void (*run)(void);
+};
+
+struct benchmark_result {
+	/* Operations per sample, and how many samples were taken */
+	uint32_t iterations;
+	uint32_t samples;
+	/* Time per operation across the samples, in nanoseconds */
+	uint32_t min_ns;
+	uint32_t median_ns;
+	uint32_t mean_ns;
+	uint32_t max_ns;
+};
+
+/**
+ * Time a benchmark.
+ *
+ * The operation is run in batches large enough for the clock to measure,
+ * after a warmup batch which isn't counted.
+ *
+ * @param b		Benchmark to run
+ * @param r		Destination for the results
+ * @return EC_SUCCESS, or non-zero if error.
+ */
+int benchmark_run(const struct benchmark_t *b, struct benchmark_result *r);
+
+/**
+ * Print a benchmark result to the console as one line of JSON.
+ */
+void benchmark_print(const struct benchmark_t *b,
+		     const struct benchmark_result *r);
+
+/* The built-in benchmarks of common code */
+extern const struct benchmark_t benchmarks[];
+extern const int benchmark_count;
+
+#endif  /* __CROS_EC_BENCHMARK_H */
@@ -5,6 +5,7 @@
 
 #include "battery.h"
 #include "charger.h"
+#include "gpio.h"
 #include "timer.h"
 
 #ifndef __CROS_EC_CHARGE_STATE_V2_H
@@ -68,5 +69,11 @@ enum ec_status charger_profile_override_set_param(uint32_t param,
  */
 int charge_set_input_current_limit(int ma);
 
+/*
+ * Interrupt handler for charger/gauge ALERT and PROCHOT lines, when the
+ * charger task polls adaptively (CONFIG_CHARGER_ADAPTIVE_POLL).
+ */
+void charger_alert_interrupt(enum gpio_signal signal);
+
 #endif /* __CROS_EC_CHARGE_STATE_V2_H */
 
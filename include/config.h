@@ -58,6 +58,20 @@
 /* Include the ADC analog watchdog feature in the ADC code */
 #define CONFIG_ADC_WATCHDOG
 
+/*
+ * Scan all ADC channels in the background, into a DMA ring, so that
+ * adc_read_channel() returns the latest averaged value without blocking.
+ * Needs the ADC to itself, so undef CONFIG_ADC_WATCHDOG to use it.  Only
+ * supported on STM32F0 (which also needs TIM_ADC).
+ */
+#undef CONFIG_ADC_SCAN
+
+/* Number of most recent scans averaged for each value in scan mode */
+#define CONFIG_ADC_SCAN_OVERSAMPLE 4
+
+/* Time between scans in scan mode, in ms */
+#define CONFIG_ADC_SCAN_INTERVAL_MS 1
+
 /*
  * Some ALS modules may be connected to the EC. We need the command, and
  * specific drivers for each module.
@@ -141,6 +155,13 @@
  */
 #undef CONFIG_BATTERY_SMART
 
+/*
+ * Cache smart battery registers which change slowly or not at all, instead
+ * of reading them over SMBus every time they're asked for. Current and
+ * voltage are always read from the battery.
+ */
+#undef CONFIG_BATTERY_SMART_CACHE
+
 /*
  * Critical battery shutdown timeout (seconds)
  *
@@ -188,6 +209,12 @@
  */
 #undef CONFIG_BATTERY_REVIVE_DISCONNECT
 
+/*
+ * Build the microbenchmark suite for common code (common/benchmark.c), with a
+ * "benchmark" console command which prints the results as JSON.
+ */
+#undef CONFIG_BENCHMARK
+
 /* Boot header storage offset. */
 #undef CONFIG_BOOT_HEADER_STORAGE_OFF
 
@@ -281,6 +308,18 @@
 #undef CONFIG_CHARGER_ISL9237
 #undef CONFIG_CHARGER_TPS65090  /* Note: does not use CONFIG_CHARGER */
 
+/*
+ * Let charger_task() (CONFIG_CHARGER_V2) pick its poll period from what the
+ * battery is doing. It polls closely during precharge, the constant-voltage
+ * taper and input current ramping. While the AP is off or suspended and the
+ * battery is full or idle, it backs off exponentially, up to
+ * CHARGE_POLL_PERIOD_VERY_LONG. With the AP on it never polls less often than
+ * CHARGE_POLL_PERIOD_LONG. The task is woken early by AC changes, the AP
+ * resuming and input current limit changes. Boards may also route
+ * charger/gauge ALERT lines to charger_alert_interrupt(); none do so yet.
+ */
+#undef CONFIG_CHARGER_ADAPTIVE_POLL
+
 /*
  * BQ2589x IR Compensation settings.
  * Should be the combination of BQ2589X_IR_TREG_xxxC, BQ2589X_IR_VCLAMP_yyyMV
@@ -416,6 +455,7 @@
 
 #undef CONFIG_CMD_ACCELS
 #undef CONFIG_CMD_ACCEL_INFO
+#undef CONFIG_CMD_ACPISTATS
 #undef CONFIG_CMD_BATDEBUG
 #define CONFIG_CMD_CHARGER
 #undef CONFIG_CMD_CHGRAMP
@@ -436,6 +476,7 @@
 #define CONFIG_CMD_INA
 #define CONFIG_CMD_REGULATOR
 #undef CONFIG_CMD_JUMPTAGS
+#undef CONFIG_CMD_JUMPTIMES
 #undef CONFIG_CMD_LID_ANGLE
 #undef CONFIG_CMD_MCDP
 #define CONFIG_CMD_PD
@@ -653,6 +694,20 @@
  */
 #undef CONFIG_FAN_UPDATE_PERIOD
 
+/*
+ * Regulate fan speed in common code, with a PID controller plus feed-forward
+ * driving the fan's duty cycle from its filtered tachometer reading, instead
+ * of the chip's own RPM mode.  Also adds stall detection and restart, and
+ * smooths out the speed changes the thermal engine asks for.
+ */
+#undef CONFIG_FAN_PID
+
+/* Fastest the fan speed may change under CONFIG_FAN_PID, in rpm per second */
+#define CONFIG_FAN_PID_SLEW_RPM 500
+
+/* Ignore changes in the requested fan speed smaller than this, in rpm */
+#define CONFIG_FAN_PID_HYSTERESIS_RPM 100
+
 /*****************************************************************************/
 /* Flash configuration */
 
@@ -834,6 +889,19 @@
 #undef  CONFIG_HOSTCMD_EVENTS
 #endif
 
+/*
+ * Coalesce bursts of host events, so noisy sources don't interrupt the AP
+ * for every change.  New events in a coalesced class (battery, thermal, USB)
+ * are held for the batching window, and each class is signaled no more often
+ * than its minimum interval.  Other events, and all events while the AP is
+ * not in S0, are signaled at once.
+ */
+#undef CONFIG_HOSTCMD_EVENT_COALESCE
+#define CONFIG_HOSTCMD_EVENT_COALESCE_WINDOW   (10   * MSEC)
+#define CONFIG_HOSTCMD_EVENT_COALESCE_BATTERY  (1000 * MSEC)
+#define CONFIG_HOSTCMD_EVENT_COALESCE_THERMAL  (500  * MSEC)
+#define CONFIG_HOSTCMD_EVENT_COALESCE_USB      (250  * MSEC)
+
 /*
  * For ECs where the host command interface is I2C, slave
  * address which the EC will respond to.
@@ -883,6 +951,13 @@
 /* Enable the software routine for CRC computation */
 #undef CONFIG_SW_CRC
 
+/*
+ * Number of bytes the software CRC routine consumes per step: 4 or 8. Each
+ * step needs that many 1 kB lookup tables, so this trades flash for speed on
+ * long buffers; if undefined, a single table is used one byte at a time.
+ */
+#undef CONFIG_SW_CRC_SLICE
+
 /*****************************************************************************/
 
 /* Enable system hibernate */
@@ -1011,6 +1086,12 @@
 /* The board uses a negative edge-triggered GPIO for keyboard interrupts. */
 #undef CONFIG_KEYBOARD_IRQ_GPIO
 
+/*
+ * Timestamp key events through scanning, debouncing, queueing and host read,
+ * and report latency histograms through EC_CMD_KEYBOARD_LATENCY.
+ */
+#undef CONFIG_KEYBOARD_LATENCY
+
 /* Compile code for 8042 keyboard protocol */
 #undef CONFIG_KEYBOARD_PROTOCOL_8042
 
@@ -1238,6 +1319,12 @@
  */
 #undef CONFIG_PORT80_TASK_EN
 
+/*
+ * Record when each port 80 code arrives, so the AP firmware's boot can be
+ * profiled.  Costs 5 bytes of RAM per history entry.
+ */
+#undef CONFIG_PORT80_TIMESTAMPS
+
 /*****************************************************************************/
 
 /* Compile common code to support power button debouncing */
@@ -1261,6 +1348,23 @@
 /* Support stopping in S5 on shutdown */
 #undef CONFIG_POWER_SHUTDOWN_PAUSE_IN_S5
 
+/*
+ * Record a timeline of power state entries and exits and of each
+ * power_wait_signals() wait, readable through EC_CMD_POWER_TIMELINE and the
+ * 'powertimeline' console command.
+ */
+#undef CONFIG_POWER_TIMELINE
+
+/* Number of timeline records kept */
+#define CONFIG_POWER_TIMELINE_ENTRIES 32
+
+/*
+ * Default time budget for each transition state (G3->S5, S3->S0, etc.), in
+ * us.  A transition which takes longer, or a signal wait within it which does,
+ * is flagged in the timeline.  The host can change the budget of any state.
+ */
+#define CONFIG_POWER_TIMELINE_BUDGET_US 100000
+
 /* Use part of the EC's data EEPROM to hold persistent storage for the AP. */
 #undef CONFIG_PSTORE
 
@@ -1350,6 +1454,12 @@
 /* Support computing SHA-256 hash (without the VBOOT code) */
 #undef CONFIG_SHA256
 
+/*
+ * Number of shared memory buffers which may be held at once. Each one costs a
+ * few bytes of RAM; with 1, the shared memory region has a single owner.
+ */
+#define CONFIG_SHARED_MEM_LEASES 4
+
 /* Emulate the CLZ (Count Leading Zeros) in software for CPU lacking support */
 #undef CONFIG_SOFTWARE_CLZ
 
@@ -1415,6 +1525,15 @@
 /* Support dedicated recovery signal from servo board */
 #undef CONFIG_SWITCH_DEDICATED_RECOVERY
 
+/*
+ * Jump between images without waiting out the slow parts of handing over.
+ * Buffered console output is passed to the new image in a jump tag instead of
+ * being flushed first (unless CONFIG_UART_TX_DMA, which can't be stopped
+ * cleanly), USB PD waits only until its soft resets have actually completed,
+ * and the ENTERING_RW pulse overlaps that wait.
+ */
+#undef CONFIG_SYSJUMP_WARM
+
 /*
  * System should remain unlocked even if write protect is enabled.
  *
@@ -1466,6 +1585,32 @@
 #undef CONFIG_TEMP_SENSOR_TMP006	/* TI TMP006 sensor, on I2C bus */
 #undef CONFIG_TEMP_SENSOR_TMP432	/* TI TMP432 sensor, on I2C bus */
 
+/*
+ * Smooth the temperatures used by thermal control with an exponential moving
+ * average, giving each new reading a weight of 1/(2^N).
+ */
+#undef CONFIG_THERMAL_EMA_SHIFT
+
+/*
+ * Drive the fan curve from where the temperature will be in N seconds at its
+ * current rate of rise, so the fan spins up ahead of a load step. Thresholds
+ * and throttling still use the measured temperature.
+ */
+#undef CONFIG_THERMAL_FAN_PREDICT_SEC
+
+/*
+ * Once a host temperature threshold has tripped, wait until every sensor is
+ * N degrees below it before releasing it, rather than just below it.
+ */
+#undef CONFIG_THERMAL_HYSTERESIS
+
+/*
+ * Sample each temperature sensor at its own rate (temp_sensor_t's
+ * sample_period_ms), checked every HOOK_TICK, instead of sampling all of them
+ * once a second.
+ */
+#undef CONFIG_THERMAL_SENSOR_PERIOD
+
 /*
  * If defined, active-high GPIO which indicates temperature sensor chips are
  * powered.  If not defined, temperature sensors are assumed to be always
@@ -1496,6 +1641,13 @@
 /* USB stream config */
 #undef CONFIG_STREAM_USB
 
+/*
+ * Give each USB stream two packet buffers per direction, so the host can keep
+ * streaming while we move the last packet to or from its queue.  Doubles the
+ * USB packet RAM the streams use.
+ */
+#undef CONFIG_STREAM_USB_DOUBLE_BUFFER
+
 /*****************************************************************************/
 /* UART config */
 
@@ -1677,6 +1829,13 @@
 /* Enable USB serial console module. */
 #undef CONFIG_USB_CONSOLE
 
+/*
+ * Give the USB console a second TX packet buffer, so output is formatted
+ * while the last packet is being sent, and long output goes out as several
+ * packets rather than being cut off.
+ */
+#undef CONFIG_USB_CONSOLE_DOUBLE_BUFFER
+
 /* Support USB HID interface. */
 #undef CONFIG_USB_HID
 
@@ -1755,6 +1914,19 @@
 /* USB SPI config */
 #undef CONFIG_USB_SPI
 
+/*
+ * Let the USB SPI bridge queue commands and accept extended commands: long
+ * transfers, and flash writes which wait for the flash on the device rather
+ * than having the host poll its status over USB.  See chip/stm32/usb_spi.h.
+ */
+#undef CONFIG_USB_SPI_PIPELINE
+
+/* Largest payload or read of an extended USB SPI command, in bytes */
+#define CONFIG_USB_SPI_BUFFER_SIZE 1024
+
+/* Number of received USB SPI packets which can wait to be processed */
+#define CONFIG_USB_SPI_PIPELINE_DEPTH 4
+
 /*****************************************************************************/
 
 /* Support computing hash of code for verified boot */
@@ -8,6 +8,38 @@
 /* CRC-32 implementation with USB constants */
 /* Note: it's a stateful CRC-32 to match the hardware block interface */
 
+#include "common.h"
+
+/*
+ * Streaming interface. Each caller keeps its own context, so any number of
+ * CRCs can be in progress at once, and buffers are hashed in one call.
+ */
+
+/**
+ * Start a new CRC in the given context.
+ */
+void crc32_ctx_init(uint32_t *ctx);
+
+/**
+ * Add a little-endian 32-bit, 16-bit or 8-bit value to the CRC.
+ */
+void crc32_ctx_hash32(uint32_t *ctx, uint32_t val);
+void crc32_ctx_hash16(uint32_t *ctx, uint16_t val);
+void crc32_ctx_hash8(uint32_t *ctx, uint8_t val);
+
+/**
+ * Add a buffer of any length and alignment to the CRC.
+ */
+void crc32_ctx_hash(uint32_t *ctx, const void *buf, int size);
+
+/**
+ * Return the CRC of everything hashed into the context so far. The context
+ * may continue to be used afterwards.
+ */
+uint32_t crc32_ctx_result(uint32_t *ctx);
+
+/* Single-stream interface, as provided by the hardware block */
+
 #ifdef CONFIG_HW_CRC
 #include "crc_hw.h"
 #else
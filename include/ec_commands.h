@@ -67,7 +67,8 @@
 #define EC_MEMMAP_SWITCHES_VERSION 0x25 /* Version of data in 0x30 - 0x33 */
 #define EC_MEMMAP_EVENTS_VERSION   0x26 /* Version of data in 0x34 - 0x3f */
 #define EC_MEMMAP_HOST_CMD_FLAGS   0x27 /* Host cmd interface flags (8 bits) */
-/* Unused 0x28 - 0x2f */
+#define EC_MEMMAP_SEQ              0x28 /* Update counts 0x28 - 0x2b */
+/* Unused 0x2c - 0x2f */
 #define EC_MEMMAP_SWITCHES         0x30	/* 8 bits */
 /* Unused 0x31 - 0x33 */
 #define EC_MEMMAP_HOST_EVENTS      0x34 /* 32 bits */
@@ -145,6 +146,19 @@
 #define EC_FAN_SPEED_NOT_PRESENT   0xffff  /* Entry not present */
 #define EC_FAN_SPEED_STALLED       0xfffe  /* Fan stalled */
 
+/*
+ * Update counts at EC_MEMMAP_SEQ, one byte per region, valid only if
+ * EC_MEMMAP_ID_VERSION returns >= 2.  A region's count is odd while the EC is
+ * updating the region, and changes each time it does.  To read a consistent
+ * snapshot of a region, read its count (and try again if it's odd), read the
+ * data, then read the count again and start over if it changed.
+ */
+#define EC_MEMMAP_SEQ_THERMAL      0 /* 0x00 - 0x1f */
+#define EC_MEMMAP_SEQ_SWITCHES     1 /* 0x30 - 0x33 */
+#define EC_MEMMAP_SEQ_BATTERY      2 /* 0x40 - 0x7f */
+#define EC_MEMMAP_SEQ_ACC          3 /* 0x90 - 0xa5 */
+#define EC_MEMMAP_SEQ_COUNT        4
+
 /* Battery bit flags at EC_MEMMAP_BATT_FLAG. */
 #define EC_BATT_FLAG_AC_PRESENT   0x01
 #define EC_BATT_FLAG_BATT_PRESENT 0x02
@@ -1199,6 +1213,42 @@ struct ec_params_pwm_set_fan_duty_v1 {
 	uint8_t fan_idx;
 } __packed;
 
+/*
+ * Get the state of a fan's closed-loop controller (CONFIG_FAN_PID), and
+ * optionally retune it.
+ */
+#define EC_CMD_PWM_FAN_PID 0x25
+
+/* Set the gains to the ones given */
+#define EC_FAN_PID_SET_GAINS (1 << 0)
+
+struct ec_params_pwm_fan_pid {
+	uint8_t fan_idx;
+	uint8_t flags;		/* EC_FAN_PID_* */
+	uint16_t reserved;
+	/* Gains, in per-mille duty per 1024 rpm (or rpm * tick, for ki) */
+	int32_t kp;
+	int32_t ki;
+	int32_t kd;
+} __packed;
+
+struct ec_response_pwm_fan_pid {
+	uint32_t target_rpm;	/* Asked for by the thermal engine */
+	uint32_t setpoint_rpm;	/* Target, after the slew rate limit */
+	uint32_t filtered_rpm;	/* Filtered tachometer reading */
+	uint32_t duty;		/* Output, in per-mille */
+	/* Output terms, in per-mille: feed-forward, P, I and D */
+	int32_t ff;
+	int32_t p;
+	int32_t i;
+	int32_t d;
+	/* Current gains */
+	int32_t kp;
+	int32_t ki;
+	int32_t kd;
+	uint32_t stalls;	/* Number of stalls restarted from */
+} __packed;
+
 /*****************************************************************************/
 /*
  * Lightbar commands. This looks worse than it is. Since we only use one HOST
@@ -2014,11 +2064,22 @@ struct ec_response_rtc {
 #define EC_CMD_PORT80_LAST_BOOT 0x48
 #define EC_CMD_PORT80_READ 0x48
 
+/* Maximum timestamped entries that can be read in a single command */
+#define EC_PORT80_TIMESTAMP_SIZE_MAX 16
+
 enum ec_port80_subcmd {
 	EC_PORT80_GET_INFO = 0,
 	EC_PORT80_READ_BUFFER,
+	/* Read entries with their arrival times; uses read_buffer params */
+	EC_PORT80_READ_TIMESTAMPS,
+	/* Fold repeats of the same code into one entry, or stop doing so */
+	EC_PORT80_SET_DEDUP,
 };
 
+/* Flags for get_info */
+#define EC_PORT80_FLAG_TIMESTAMPS (1 << 0)  /* Arrival times are recorded */
+#define EC_PORT80_FLAG_DEDUP      (1 << 1)  /* Repeated codes are folded */
+
 struct ec_params_port80_read {
 	uint16_t subcmd;
 	union {
@@ -2026,19 +2087,33 @@ struct ec_params_port80_read {
 			uint32_t offset;
 			uint32_t num_entries;
 		} read_buffer;
+		struct {
+			uint8_t enable;
+		} set_dedup;
 	};
 } __packed;
 
+struct ec_port80_timestamp {
+	uint32_t time;     /* EC time the code arrived, in us (low 32 bits) */
+	uint16_t code;
+	uint16_t repeats;  /* Further writes of the code folded into this one */
+} __packed;
+
 struct ec_response_port80_read {
 	union {
 		struct {
 			uint32_t writes;
 			uint32_t history_size;
 			uint32_t last_boot;
+			uint32_t flags;  /* EC_PORT80_FLAG_* */
 		} get_info;
 		struct {
 			uint16_t codes[EC_PORT80_SIZE_MAX];
 		} data;
+		struct {
+			struct ec_port80_timestamp
+				entries[EC_PORT80_TIMESTAMP_SIZE_MAX];
+		} timestamps;
 	};
 } __packed;
 
@@ -2046,6 +2121,78 @@ struct ec_response_port80_last_boot {
 	uint16_t code;
 } __packed;
 
+/*****************************************************************************/
+/* Power sequencing timeline */
+
+#define EC_CMD_POWER_TIMELINE 0x49
+
+/* Maximum records that can be read in a single command */
+#define EC_POWER_TIMELINE_SIZE_MAX 8
+
+enum ec_power_timeline_subcmd {
+	EC_POWER_TIMELINE_GET_INFO = 0,
+	EC_POWER_TIMELINE_READ,
+	EC_POWER_TIMELINE_SET_BUDGET,
+	EC_POWER_TIMELINE_CLEAR,
+};
+
+enum ec_power_timeline_type {
+	EC_POWER_TIMELINE_STATE = 0,	/* Time spent in a power state */
+	EC_POWER_TIMELINE_WAIT,		/* Wait for power input signals */
+};
+
+/* Took longer than the budget for its state */
+#define EC_POWER_TIMELINE_FLAG_OVER_BUDGET	(1 << 0)
+/* Signal wait gave up before the signals arrived */
+#define EC_POWER_TIMELINE_FLAG_TIMEOUT		(1 << 1)
+/* Still in this state; duration is the time so far */
+#define EC_POWER_TIMELINE_FLAG_ACTIVE		(1 << 2)
+
+/*
+ * Power states are numbered as in the EC's 'powerinfo' console command: G3,
+ * S5, S3, S0, then the transitions G3->S5, S5->S3, S3->S0, S0->S3, S3->S5
+ * and S5->G3.
+ */
+struct ec_power_timeline_entry {
+	uint32_t time;		/* Start time in us (low 32 bits of EC time) */
+	uint32_t duration;	/* us, saturating at 0xffffffff */
+	uint32_t signals;	/* Signals waited for, or present on state exit */
+	uint8_t type;		/* enum ec_power_timeline_type */
+	uint8_t state;		/* Power state, or the state which waited */
+	uint8_t flags;		/* EC_POWER_TIMELINE_FLAG_* */
+	uint8_t reserved;
+} __packed;
+
+struct ec_params_power_timeline {
+	uint16_t subcmd;	/* enum ec_power_timeline_subcmd */
+	union {
+		struct {
+			/* Index of first record, counting from the first ever */
+			uint32_t offset;
+			uint32_t num_entries;
+		} read;
+		struct {
+			uint32_t state;
+			uint32_t budget_us;	/* 0 means no budget */
+		} set_budget;
+	};
+} __packed;
+
+struct ec_response_power_timeline {
+	union {
+		struct {
+			uint32_t records;	/* Records made since clear */
+			uint32_t history_size;	/* Most recent records kept */
+			uint32_t over_budget;	/* Records over budget */
+		} get_info;
+		struct {
+			uint32_t num_entries;
+			struct ec_power_timeline_entry
+				entries[EC_POWER_TIMELINE_SIZE_MAX];
+		} read;
+	};
+} __packed;
+
 /*****************************************************************************/
 /* Thermal engine commands. Note that there are two implementations. We'll
  * reuse the command number, but the data and behavior is incompatible.
@@ -2359,6 +2506,47 @@ struct ec_response_get_next_event {
 	union ec_response_get_next_data data;
 } __packed;
 
+/*
+ * Get keyboard input latency statistics.
+ *
+ * Each key event is timestamped when the key change is first sampled, when
+ * it finishes debouncing, when it is queued for the host (MKBP FIFO or 8042
+ * output queue) and when the host reads it.  The time spent in each of those
+ * stages is accumulated into log2 histograms.
+ */
+#define EC_CMD_KEYBOARD_LATENCY 0x68
+
+enum ec_kb_latency_stage {
+	EC_KB_LATENCY_DEBOUNCE = 0,	/* First sample to debounce done */
+	EC_KB_LATENCY_QUEUE = 1,	/* Debounce done to queued for host */
+	EC_KB_LATENCY_HOST = 2,		/* Queued to read by host */
+	EC_KB_LATENCY_TOTAL = 3,	/* First sample to read by host */
+
+	EC_KB_LATENCY_STAGE_COUNT
+};
+
+/*
+ * Histogram bucket n counts latencies in [2^(n+8), 2^(n+9)) us, except that
+ * the first bucket also counts everything shorter and the last bucket also
+ * counts everything longer.
+ */
+#define EC_KB_LATENCY_BUCKETS 12
+#define EC_KB_LATENCY_BUCKET_SHIFT 8
+
+/* Clear the statistics after reading them */
+#define EC_KB_LATENCY_FLAG_RESET (1 << 0)
+
+struct ec_params_keyboard_latency {
+	uint8_t flags;		/* EC_KB_LATENCY_FLAG_* */
+} __packed;
+
+struct ec_response_keyboard_latency {
+	uint32_t events;	/* Events read by the host */
+	uint32_t dropped;	/* Events never queued or read */
+	uint32_t max_us[EC_KB_LATENCY_STAGE_COUNT];
+	uint16_t histogram[EC_KB_LATENCY_STAGE_COUNT][EC_KB_LATENCY_BUCKETS];
+} __packed;
+
 /*****************************************************************************/
 /* Temperature sensor commands */
 
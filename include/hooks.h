@@ -93,6 +93,21 @@ enum hook_type {
 	 */
 	HOOK_CHIPSET_RESUME,
 
+	/*
+	 * Work on resume which the AP doesn't need to wait for, such as
+	 * setting up an ambient light sensor.  Called once the
+	 * HOOK_CHIPSET_RESUME hooks are done, so the chipset task can carry on
+	 * with the power sequence while these run.  Skipped if the system
+	 * suspends again before they get a chance to.
+	 *
+	 * A suspend can still arrive while one of these is running, so
+	 * anything with a HOOK_CHIPSET_SUSPEND counterpart belongs in
+	 * HOOK_CHIPSET_RESUME instead.
+	 *
+	 * Hook routines are called from the HOOKS task.
+	 */
+	HOOK_CHIPSET_RESUME_DEFERRED,
+
 	/*
 	 * System is suspending, or shutting down; all voltage rails are still
 	 * on.
@@ -123,6 +123,32 @@ struct host_command {
  */
 uint8_t *host_get_memmap(int offset);
 
+/**
+ * Start updating a region of the memory-mapped buffer.
+ *
+ * Makes the region's update count (see EC_MEMMAP_SEQ) odd, so a host reading
+ * the region knows to try again, until host_memmap_end_update().  Calls may
+ * nest, and may come from more than one task.
+ *
+ * @param region	Region being updated (EC_MEMMAP_SEQ_*)
+ */
+void host_memmap_begin_update(int region);
+
+/**
+ * Finish updating a region of the memory-mapped buffer.
+ *
+ * @param region	Region being updated (EC_MEMMAP_SEQ_*)
+ */
+void host_memmap_end_update(int region);
+
+/**
+ * Find a command by command number.
+ *
+ * @param command	Command number to find
+ * @return The command structure, or NULL if no match found.
+ */
+const struct host_command *find_host_command(int command);
+
 /**
  * Process a host command and return its response
  *
@@ -0,0 +1,50 @@
+/* Copyright 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ */
+
+/* Keyboard input latency tracking for Chrome EC */
+
+#ifndef __CROS_EC_KEYBOARD_LATENCY_H
+#define __CROS_EC_KEYBOARD_LATENCY_H
+
+#include "common.h"
+
+#ifdef CONFIG_KEYBOARD_LATENCY
+/**
+ * Record a key event which has finished debouncing.
+ *
+ * Any earlier event which was never queued for the host is counted as
+ * dropped.
+ *
+ * @param sampled	Time (get_time().le.lo) the change was first sampled
+ * @param debounced	Time the change finished debouncing
+ */
+void keyboard_latency_debounced(uint32_t sampled, uint32_t debounced);
+
+/**
+ * Record that pending debounced events were queued for the host.
+ */
+void keyboard_latency_queued(void);
+
+/**
+ * Record that the host read queued events.
+ *
+ * @param all		Non-zero if the host read everything queued so far,
+ *			zero if it read only the oldest queued event.
+ */
+void keyboard_latency_host_read(int all);
+
+/**
+ * Drop all events in flight, e.g. when the host queue is flushed.
+ */
+void keyboard_latency_clear_pending(void);
+#else
+static inline void keyboard_latency_debounced(uint32_t sampled,
+					      uint32_t debounced) { }
+static inline void keyboard_latency_queued(void) { }
+static inline void keyboard_latency_host_read(int all) { }
+static inline void keyboard_latency_clear_pending(void) { }
+#endif
+
+#endif  /* __CROS_EC_KEYBOARD_LATENCY_H */
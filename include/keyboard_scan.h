@@ -19,6 +19,12 @@ struct keyboard_scan_config {
 	uint16_t debounce_up_us;
 	/* Time between start of scans when in polling mode */
 	uint16_t scan_period_us;
+	/*
+	 * Longest time between start of scans when in polling mode and no
+	 * keys are down.  The scan period backs off towards this while the
+	 * keyboard is idle.  0 means always scan every scan_period_us.
+	 */
+	uint16_t idle_scan_period_us;
 	/*
 	 * Minimum time between end of one scan and start of the next one.
 	 * This ensures keyboard scanning doesn't starve the rest of the system
@@ -16,6 +16,10 @@
 
 /* Set the color of one LED (or all if the LED number is too large) */
 void lb_set_rgb(unsigned int led, int red, int green, int blue);
+/* Defer lb_set_rgb() and lb_set_brightness() output until lb_batch_end().
+ * Calls may nest; the LEDs are updated when the outermost batch ends. */
+void lb_batch_begin(void);
+void lb_batch_end(void);
 /* Get the current color of one LED. Fails if the LED number is too large. */
 int lb_get_rgb(unsigned int led, uint8_t *red, uint8_t *green, uint8_t *blue);
 /* Set the overall brightness level. */
@@ -12,6 +12,9 @@
  * NOT intended for allocating long-term buffers; those should in general be
  * static variables allocated at compile-time.  It is NOT a full-featured
  * replacement for malloc() / free().
+ *
+ * Up to CONFIG_SHARED_MEM_LEASES buffers may be held at once, carved out of
+ * the same region first-fit, so small requests don't lock everyone else out.
  */
 
 #ifndef __CROS_EC_SHARED_MEM_H
@@ -19,6 +22,24 @@
 
 #include "common.h"
 
+/* Alignment of buffers from shared_mem_acquire() */
+#define SHARED_MEM_ALIGN 4
+
+struct shared_mem_stats {
+	/* Size of the region, and how much of it is currently held */
+	int size;
+	int used;
+	/* High-water marks of bytes and buffers held */
+	int max_used;
+	int max_leases;
+	/* Buffers currently held */
+	int leases;
+	/* Largest request which could currently succeed */
+	int largest_free;
+	/* Requests refused with EC_ERROR_BUSY since boot */
+	int busy_count;
+};
+
 /**
  * Initializes the module.
  */
@@ -37,14 +58,49 @@ int shared_mem_size(void);
  * @param dest_ptr	If successful, set on return to the start of the
  *			granted memory buffer.
  *
- * @return EC_SUCCESS if successful, EC_ERROR_BUSY if buffer in use, or
- * other non-zero error code.
+ * @return EC_SUCCESS if successful, EC_ERROR_BUSY if there isn't room right
+ * now, or other non-zero error code.
  */
 int shared_mem_acquire(int size, char **dest_ptr);
 
+/**
+ * Acquires a shared memory area with the given alignment.
+ *
+ * @param size		Number of bytes requested
+ * @param align		Required alignment of the buffer; a power of two
+ * @param dest_ptr	If successful, set on return to the start of the
+ *			granted memory buffer.
+ *
+ * @return EC_SUCCESS if successful, EC_ERROR_BUSY if there isn't room right
+ * now, or other non-zero error code.
+ */
+int shared_mem_acquire_aligned(int size, int align, char **dest_ptr);
+
+/**
+ * Acquires a shared memory area, waiting for other holders to release
+ * enough of it if necessary.
+ *
+ * Only waits when called from a task; elsewhere this is the same as
+ * shared_mem_acquire().
+ *
+ * @param size		Number of bytes requested
+ * @param dest_ptr	If successful, set on return to the start of the
+ *			granted memory buffer.
+ * @param timeout_us	How long to wait, in us
+ *
+ * @return EC_SUCCESS if successful, EC_ERROR_TIMEOUT if there still wasn't
+ * room after the timeout, or other non-zero error code.
+ */
+int shared_mem_acquire_wait(int size, char **dest_ptr, int timeout_us);
+
 /**
  * Releases a shared memory area previously allocated via shared_mem_acquire().
  */
 void shared_mem_release(void *ptr);
 
+/**
+ * Get usage statistics for the shared memory region.
+ */
+void shared_mem_get_stats(struct shared_mem_stats *stats);
+
 #endif  /* __CROS_EC_SHARED_MEM_H */
@@ -103,6 +103,40 @@ enum system_image_copy_t system_get_image_copy(void);
  */
 int system_jumped_to_this_image(void);
 
+/* Milestones of a jump between images, timed with get_time() */
+enum jump_phase {
+	/* In the image we jumped from */
+	JUMP_PHASE_START = 0,		/* jump requested */
+	JUMP_PHASE_PD,			/* USB PD ready to jump */
+	JUMP_PHASE_I2C,			/* I2C ports idle and locked */
+	JUMP_PHASE_UART,		/* console output flushed or handed over */
+	JUMP_PHASE_HOOKS,		/* HOOK_SYSJUMP handlers starting */
+	/* In the image we jumped to */
+	JUMP_PHASE_UART_INIT,		/* UART initialized */
+	JUMP_PHASE_INITS_DONE,		/* about to start tasks */
+	JUMP_PHASE_HOOK_INIT,		/* HOOK_INIT handlers done */
+
+	JUMP_PHASE_COUNT
+};
+
+/**
+ * Record the time a jump between images reached the given phase.
+ *
+ * Phases in the image we jumped to are ignored unless we actually jumped.
+ */
+void system_mark_jump_phase(enum jump_phase phase);
+
+/**
+ * Return the times (low word of get_time()) each phase of the last jump was
+ * reached, indexed by enum jump_phase, or NULL if we didn't jump to this
+ * image.  Phases not reached or not timed by the previous image are 0.
+ *
+ * Time stands still from when the timer's HOOK_SYSJUMP handler saves it until
+ * timer_init() in the new image, so the HOOKS to UART_INIT phase is short by
+ * however long the reset vector and pre-init take.
+ */
+const uint32_t *system_get_jump_times(void);
+
 /**
  * Preserve data across a jump between images.
  *
@@ -40,6 +40,9 @@ struct temp_sensor_t {
 	/* Delay between reading temperature and taking action about it,
 	 * in seconds. */
 	int action_delay_sec;
+	/* How often thermal control samples this sensor, in ms, if
+	 * CONFIG_THERMAL_SENSOR_PERIOD is defined. 0 means once a second. */
+	int sample_period_ms;
 };
 
 #ifdef CONFIG_TEMP_SENSOR
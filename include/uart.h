@@ -70,6 +70,14 @@ int uart_vprintf(const char *format, va_list args);
  */
 void uart_flush_output(void);
 
+/**
+ * Queue the output the image we jumped from hadn't sent yet.
+ *
+ * With CONFIG_SYSJUMP_WARM, that output is passed along instead of being
+ * flushed before the jump.  Call right after uart_init().
+ */
+void uart_restore_output(void);
+
 /*
  * Input functions
  *
@@ -1496,6 +1496,12 @@ void pd_soft_reset(void);
 /* Prepare PD communication for sysjump */
 void pd_prepare_sysjump(void);
 
+/**
+ * Return non-zero once the soft resets sent by pd_prepare_sysjump() have been
+ * accepted (or have given up), so it's safe to jump without losing a contract.
+ */
+int pd_sysjump_ready(void);
+
 /**
  * Signal power request to indicate a charger update that affects the port.
  *
@@ -64,6 +64,128 @@ static uint32_t hibernate_delay = CONFIG_HIBERNATE_DELAY_SEC;
 static int pause_in_s5;
 #endif
 
+#ifdef CONFIG_POWER_TIMELINE
+#define TIMELINE_BUDGET CONFIG_POWER_TIMELINE_BUDGET_US
+
+static struct ec_power_timeline_entry timeline[CONFIG_POWER_TIMELINE_ENTRIES];
+static uint32_t timeline_records;	/* Records made since clear */
+static uint32_t timeline_over_budget;	/* How many were over budget */
+static uint32_t timeline_state_rec;	/* Record of the current state */
+static uint64_t timeline_state_start;	/* When we entered the current state */
+static struct mutex timeline_lock;
+
+/* Budget for each power state in us, 0 if none */
+static uint32_t timeline_budget[] = {
+	[POWER_G3S5] = TIMELINE_BUDGET,
+	[POWER_S5S3] = TIMELINE_BUDGET,
+	[POWER_S3S0] = TIMELINE_BUDGET,
+	[POWER_S0S3] = TIMELINE_BUDGET,
+	[POWER_S3S5] = TIMELINE_BUDGET,
+	[POWER_S5G3] = TIMELINE_BUDGET,
+};
+BUILD_ASSERT(ARRAY_SIZE(timeline_budget) == ARRAY_SIZE(state_names));
+
+/* Return the record with absolute index rec, or NULL if it's been lost. */
+static struct ec_power_timeline_entry *timeline_get(uint32_t rec)
+{
+	if (rec >= timeline_records ||
+	    timeline_records - rec > CONFIG_POWER_TIMELINE_ENTRIES)
+		return NULL;
+
+	return timeline + rec % CONFIG_POWER_TIMELINE_ENTRIES;
+}
+
+/* Start a new record.  Call with timeline_lock held. */
+static struct ec_power_timeline_entry *timeline_add(int type, uint64_t start)
+{
+	struct ec_power_timeline_entry *e =
+		timeline + timeline_records % CONFIG_POWER_TIMELINE_ENTRIES;
+
+	timeline_records++;
+	memset(e, 0, sizeof(*e));
+	e->type = type;
+	e->state = state;
+	e->time = (uint32_t)start;
+
+	return e;
+}
+
+/*
+ * Fill in how long a record took, and check it against the budget.  Call with
+ * timeline_lock held.
+ *
+ * @return Non-zero if it was over budget.
+ */
+static int timeline_finish(struct ec_power_timeline_entry *e, uint64_t start,
+			   uint64_t end)
+{
+	uint64_t us = end - start;
+	uint32_t budget = timeline_budget[e->state];
+
+	e->duration = MIN(us, (uint64_t)0xffffffff);
+	if (!budget || e->duration <= budget)
+		return 0;
+
+	e->flags |= EC_POWER_TIMELINE_FLAG_OVER_BUDGET;
+	timeline_over_budget++;
+	return 1;
+}
+
+/* Close the current state's record and open one for the new state. */
+static void timeline_set_state(enum power_state new_state)
+{
+	struct ec_power_timeline_entry *e;
+	uint64_t now = get_time().val;
+	uint64_t took = now - timeline_state_start;
+	int over = 0;
+
+	mutex_lock(&timeline_lock);
+
+	e = timeline_get(timeline_state_rec);
+	if (e && (e->flags & EC_POWER_TIMELINE_FLAG_ACTIVE)) {
+		e->flags &= ~EC_POWER_TIMELINE_FLAG_ACTIVE;
+		e->signals = in_signals;
+		over = timeline_finish(e, timeline_state_start, now);
+	}
+
+	e = timeline_add(EC_POWER_TIMELINE_STATE, now);
+	e->state = new_state;
+	e->flags = EC_POWER_TIMELINE_FLAG_ACTIVE;
+	timeline_state_rec = timeline_records - 1;
+	timeline_state_start = now;
+
+	mutex_unlock(&timeline_lock);
+
+	if (over)
+		CPRINTS("power %s took %d us, over budget",
+			state_names[state], (int)took);
+}
+
+static void timeline_wait(uint32_t want, uint64_t start, int rv)
+{
+	struct ec_power_timeline_entry *e;
+	uint64_t now = get_time().val;
+	int over;
+
+	mutex_lock(&timeline_lock);
+
+	e = timeline_add(EC_POWER_TIMELINE_WAIT, start);
+	e->signals = want;
+	if (rv != EC_SUCCESS)
+		e->flags |= EC_POWER_TIMELINE_FLAG_TIMEOUT;
+	over = timeline_finish(e, start, now);
+
+	mutex_unlock(&timeline_lock);
+
+	if (over)
+		CPRINTS("power %s wait for 0x%04x took %d us, over budget",
+			state_names[state], want, (int)(now - start));
+}
+#else
+static inline void timeline_set_state(enum power_state new_state) { }
+static inline void timeline_wait(uint32_t want, uint64_t start, int rv) { }
+#endif /* CONFIG_POWER_TIMELINE */
+
 /**
  * Update input signals mask
  */
@@ -102,17 +224,22 @@ int power_has_signals(uint32_t want)
 
 int power_wait_signals(uint32_t want)
 {
+	uint64_t start;
+	int rv = EC_SUCCESS;
+
 	in_want = want;
 	if (!want)
 		return EC_SUCCESS;
 
+	start = get_time().val;
 	while ((in_signals & in_want) != in_want) {
 		if (task_wait_event(DEFAULT_TIMEOUT) == TASK_EVENT_TIMER) {
 			power_update_signals();
 			CPRINTS("power timeout on input; "
 				"wanted 0x%04x, got 0x%04x",
 				in_want, in_signals & in_want);
-			return EC_ERROR_TIMEOUT;
+			rv = EC_ERROR_TIMEOUT;
+			break;
 		}
 		/*
 		 * TODO(crosbug.com/p/23772): should really shrink the
@@ -121,7 +248,9 @@ int power_wait_signals(uint32_t want)
 		 * longer in the same state we were when we started waiting.
 		 */
 	}
-	return EC_SUCCESS;
+
+	timeline_wait(want, start, rv);
+	return rv;
 }
 
 void power_set_state(enum power_state new_state)
@@ -130,6 +259,7 @@ void power_set_state(enum power_state new_state)
 	if (new_state == POWER_G3)
 		last_shutdown_time = get_time().val;
 
+	timeline_set_state(new_state);
 	state = new_state;
 }
 
@@ -559,3 +689,165 @@ DECLARE_CONSOLE_COMMAND(pause_in_s5, command_pause_in_s5,
 			"Should the AP pause in S5 during shutdown?",
 			NULL);
 #endif /* CONFIG_POWER_SHUTDOWN_PAUSE_IN_S5 */
+
+#ifdef CONFIG_POWER_TIMELINE
+static void timeline_clear(void)
+{
+	mutex_lock(&timeline_lock);
+	timeline_records = timeline_over_budget = 0;
+	mutex_unlock(&timeline_lock);
+
+	/* Start again from the state we're in now */
+	timeline_set_state(state);
+}
+
+static int timeline_set_budget(int s, uint32_t budget_us)
+{
+	if (s < 0 || s >= ARRAY_SIZE(timeline_budget))
+		return EC_ERROR_INVAL;
+
+	timeline_budget[s] = budget_us;
+	return EC_SUCCESS;
+}
+
+/* Copy a record, filling in the duration so far if it's still going. */
+static void timeline_copy(struct ec_power_timeline_entry *dest,
+			  const struct ec_power_timeline_entry *e)
+{
+	*dest = *e;
+	if (e->flags & EC_POWER_TIMELINE_FLAG_ACTIVE)
+		dest->duration = MIN(get_time().val - timeline_state_start,
+				     (uint64_t)0xffffffff);
+}
+
+static int host_command_power_timeline(struct host_cmd_handler_args *args)
+{
+	const struct ec_params_power_timeline *p = args->params;
+	struct ec_response_power_timeline *r = args->response;
+	struct ec_power_timeline_entry *e;
+	uint32_t i;
+
+	switch (p->subcmd) {
+	case EC_POWER_TIMELINE_GET_INFO:
+		mutex_lock(&timeline_lock);
+		r->get_info.records = timeline_records;
+		r->get_info.history_size = CONFIG_POWER_TIMELINE_ENTRIES;
+		r->get_info.over_budget = timeline_over_budget;
+		mutex_unlock(&timeline_lock);
+		args->response_size = sizeof(r->get_info);
+		return EC_RES_SUCCESS;
+
+	case EC_POWER_TIMELINE_READ:
+		mutex_lock(&timeline_lock);
+		for (i = 0; i < p->read.num_entries &&
+			    i < EC_POWER_TIMELINE_SIZE_MAX; i++) {
+			e = timeline_get(p->read.offset + i);
+			if (!e)
+				break;
+			timeline_copy(r->read.entries + i, e);
+		}
+		mutex_unlock(&timeline_lock);
+
+		/* Asking for records which were never made, or are lost */
+		if (!i && p->read.num_entries)
+			return EC_RES_INVALID_PARAM;
+
+		r->read.num_entries = i;
+		args->response_size = sizeof(r->read.num_entries) +
+			i * sizeof(r->read.entries[0]);
+		return EC_RES_SUCCESS;
+
+	case EC_POWER_TIMELINE_SET_BUDGET:
+		if (timeline_set_budget(p->set_budget.state,
+					p->set_budget.budget_us))
+			return EC_RES_INVALID_PARAM;
+		return EC_RES_SUCCESS;
+
+	case EC_POWER_TIMELINE_CLEAR:
+		timeline_clear();
+		return EC_RES_SUCCESS;
+	}
+
+	return EC_RES_INVALID_PARAM;
+}
+DECLARE_HOST_COMMAND(EC_CMD_POWER_TIMELINE,
+		     host_command_power_timeline,
+		     EC_VER_MASK(0));
+
+static int command_powertimeline(int argc, char **argv)
+{
+	struct ec_power_timeline_entry e, *ep;
+	uint32_t first, i;
+	char *end;
+	int s, budget;
+
+	if (argc > 1 && !strcasecmp(argv[1], "clear")) {
+		timeline_clear();
+		return EC_SUCCESS;
+	}
+
+	if (argc > 1 && !strcasecmp(argv[1], "budget")) {
+		if (argc < 4)
+			return EC_ERROR_PARAM_COUNT;
+
+		for (s = 0; s < ARRAY_SIZE(state_names); s++)
+			if (!strcasecmp(argv[2], state_names[s]))
+				break;
+		if (timeline_set_budget(s, 0))
+			return EC_ERROR_PARAM2;
+
+		budget = strtoi(argv[3], &end, 0);
+		if (*end || budget < 0)
+			return EC_ERROR_PARAM3;
+
+		return timeline_set_budget(s, budget);
+	}
+
+	if (argc > 1)
+		return EC_ERROR_PARAM1;
+
+	ccprintf("Budgets (us):");
+	for (s = 0; s < ARRAY_SIZE(state_names); s++)
+		if (timeline_budget[s])
+			ccprintf(" %s=%d", state_names[s], timeline_budget[s]);
+	ccprintf("\n");
+
+	first = timeline_records > CONFIG_POWER_TIMELINE_ENTRIES ?
+		timeline_records - CONFIG_POWER_TIMELINE_ENTRIES : 0;
+	for (i = first; i < timeline_records; i++) {
+		mutex_lock(&timeline_lock);
+		ep = timeline_get(i);
+		if (ep)
+			timeline_copy(&e, ep);
+		mutex_unlock(&timeline_lock);
+
+		/* Overwritten while we were printing */
+		if (!ep)
+			continue;
+
+		if (e.type == EC_POWER_TIMELINE_STATE)
+			ccprintf("%10d %10d  %-6s in 0x%04x",
+				 e.time, e.duration, state_names[e.state],
+				 e.signals);
+		else
+			ccprintf("%10d %10d    wait 0x%04x",
+				 e.time, e.duration, e.signals);
+
+		ccprintf("%s%s%s\n",
+			 e.flags & EC_POWER_TIMELINE_FLAG_ACTIVE ? " now" : "",
+			 e.flags & EC_POWER_TIMELINE_FLAG_TIMEOUT ?
+			 " TIMEOUT" : "",
+			 e.flags & EC_POWER_TIMELINE_FLAG_OVER_BUDGET ?
+			 " OVER" : "");
+		cflush();
+	}
+	ccprintf("%d records, %d over budget\n",
+		 timeline_records, timeline_over_budget);
+
+	return EC_SUCCESS;
+}
+DECLARE_CONSOLE_COMMAND(powertimeline, command_powertimeline,
+			"[clear | budget <state> <us>]",
+			"Show power state timeline",
+			NULL);
+#endif /* CONFIG_POWER_TIMELINE */
@@ -12,6 +12,7 @@
 #include "console.h"
 #include "i2c.h"
 #include "test_util.h"
+#include "timer.h"
 #include "util.h"
 
 /* Test state */
@@ -24,6 +25,7 @@ static void reset_and_fail_on(int first, int last)
 	/* We're not initializing the fake battery, so everything reads zero */
 	memset(&batt, 0, sizeof(typeof(batt)));
 	read_count = write_count = 0;
+	sb_cache_invalidate();
 	fail_on_first = first;
 	fail_on_last = last;
 }
@@ -79,9 +81,59 @@ static int test_param_failures(void)
 	return EC_SUCCESS;
 }
 
+static int test_cache(void)
+{
+	int full_reads, v;
+	char name[32];
+
+	/* The first time around, everything comes from the battery */
+	reset_and_fail_on(0, 0);
+	battery_get_params(&batt);
+	TEST_ASSERT(batt.flags & BATT_FLAG_RESPONSIVE);
+	full_reads = read_count;
+
+	/* After that, only current, voltage and the charging request */
+	read_count = 0;
+	battery_get_params(&batt);
+	TEST_ASSERT(!(batt.flags & BATT_FLAG_BAD_ANY));
+	TEST_ASSERT(read_count == 4);
+
+	/* Static values are read once */
+	TEST_ASSERT(battery_design_capacity(&v) == EC_SUCCESS);
+	TEST_ASSERT(battery_device_chemistry(name, sizeof(name)) ==
+		    EC_SUCCESS);
+	read_count = 0;
+	TEST_ASSERT(battery_design_capacity(&v) == EC_SUCCESS);
+	TEST_ASSERT(battery_device_chemistry(name, sizeof(name)) ==
+		    EC_SUCCESS);
+	TEST_ASSERT(read_count == 0);
+
+	/* Slow values are read again once they've aged */
+	usleep(30 * SECOND);
+	read_count = 0;
+	battery_get_params(&batt);
+	TEST_ASSERT(read_count == full_reads);
+
+	/* A failed read throws the cache away */
+	read_count = 0;
+	fail_on_first = fail_on_last = 1;
+	battery_get_params(&batt);
+	TEST_ASSERT(batt.flags & BATT_FLAG_BAD_VOLTAGE);
+	fail_on_first = fail_on_last = 0;
+	read_count = 0;
+	battery_get_params(&batt);
+	TEST_ASSERT(read_count == full_reads);
+	read_count = 0;
+	TEST_ASSERT(battery_design_capacity(&v) == EC_SUCCESS);
+	TEST_ASSERT(read_count == 1);
+
+	return EC_SUCCESS;
+}
+
 void run_test(void)
 {
 	RUN_TEST(test_param_failures);
+	RUN_TEST(test_cache);
 
 	test_print_result();
 }
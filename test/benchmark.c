@@ -0,0 +1,44 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Run the common code benchmarks on the emulator. The results are printed as
+ * JSON lines, the same as the "benchmark" console command prints on a real
+ * EC, so the two can be compared.
+ */
+
+#include "benchmark.h"
+#include "common.h"
+#include "console.h"
+#include "test_util.h"
+#include "util.h"
+
+static int test_benchmarks(void)
+{
+	struct benchmark_result r;
+	int i;
+
+	TEST_ASSERT(benchmark_count > 0);
+
+	for (i = 0; i < benchmark_count; i++) {
+		TEST_ASSERT(benchmark_run(benchmarks + i, &r) == EC_SUCCESS);
+		benchmark_print(benchmarks + i, &r);
+
+		TEST_ASSERT(r.iterations > 0);
+		TEST_ASSERT(r.samples > 0);
+		TEST_ASSERT(r.min_ns <= r.median_ns);
+		TEST_ASSERT(r.median_ns <= r.max_ns);
+		TEST_ASSERT(r.min_ns <= r.mean_ns && r.mean_ns <= r.max_ns);
+	}
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_benchmarks);
+
+	test_print_result();
+}
@@ -39,19 +39,24 @@ test-list-host+=sbs_charging host_command
 test-list-host+=bklight_lid bklight_passthru interrupt timer_dos button
 test-list-host+=math_util sbs_charging_v2 battery_get_params_smart
 test-list-host+=lightbar inductive_charging usb_pd fan charge_manager
-test-list-host+=charge_ramp
+test-list-host+=charge_ramp benchmark crc32 shared_mem sysjump fan_pid
+test-list-host+=host_event_coalesce sbs_charging_v2_adaptive thermal_filter
 
 battery_get_params_smart-y=battery_get_params_smart.o
+benchmark-y=benchmark.o
 bklight_lid-y=bklight_lid.o
 bklight_passthru-y=bklight_passthru.o
 button-y=button.o
 charge_manager-y=charge_manager.o
+charge_manager-discrete=y
 charge_ramp-y+=charge_ramp.o
 console_edit-y=console_edit.o
+crc32-y=crc32.o
 extpwr_gpio-y=extpwr_gpio.o
 flash-y=flash.o
 hooks-y=hooks.o
 host_command-y=host_command.o
+host_event_coalesce-y=host_event_coalesce.o
 inductive_charging-y=inductive_charging.o
 interrupt-y=interrupt.o
 interrupt-scale=10
@@ -68,13 +73,21 @@ powerdemo-y=powerdemo.o
 queue-y=queue.o
 sbs_charging-y=sbs_charging.o
 sbs_charging_v2-y=sbs_charging_v2.o
+sbs_charging_v2-discrete=y
+sbs_charging_v2_adaptive-y=sbs_charging_v2.o
+sbs_charging_v2_adaptive-discrete=y
+shared_mem-y=shared_mem.o
 stress-y=stress.o
+sysjump-y=sysjump.o
 system-y=system.o
 thermal-y=thermal.o
+thermal_filter-y=thermal.o
 timer_calib-y=timer_calib.o
 timer_dos-y=timer_dos.o
 usb_pd-y=usb_pd.o
+usb_pd-discrete=y
 utils-y=utils.o
 battery_get_params_smart-y=battery_get_params_smart.o
 lightbar-y=lightbar.o
 fan-y=fan.o
+fan_pid-y=fan_pid.o
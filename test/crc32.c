@@ -0,0 +1,145 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for the CRC-32 routines.
+ */
+
+#include "common.h"
+#include "crc.h"
+#include "test_util.h"
+#include "util.h"
+
+static uint8_t data[300];
+
+/* The slow, obviously right way: one bit at a time */
+static uint32_t crc32_bitwise(const uint8_t *p, int size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	int i;
+
+	while (size--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+	}
+
+	return crc ^ 0xFFFFFFFF;
+}
+
+static void fill_data(void)
+{
+	int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = prng_no_seed();
+}
+
+static int test_known_value(void)
+{
+	uint32_t ctx;
+
+	crc32_ctx_init(&ctx);
+	crc32_ctx_hash(&ctx, "123456789", 9);
+	TEST_ASSERT(crc32_ctx_result(&ctx) == 0xcbf43926);
+
+	return EC_SUCCESS;
+}
+
+static int test_legacy(void)
+{
+	uint32_t ctx;
+	int i;
+
+	crc32_init();
+	crc32_ctx_init(&ctx);
+	for (i = 0; i + 4 <= sizeof(data); i += 4) {
+		crc32_hash32(data[i] | data[i + 1] << 8 |
+			     data[i + 2] << 16 | data[i + 3] << 24);
+		crc32_hash16(data[i] | data[i + 1] << 8);
+	}
+	for (i = 0; i + 4 <= sizeof(data); i += 4) {
+		crc32_ctx_hash(&ctx, data + i, 4);
+		crc32_ctx_hash(&ctx, data + i, 2);
+	}
+	TEST_ASSERT(crc32_result() == crc32_ctx_result(&ctx));
+
+	return EC_SUCCESS;
+}
+
+/* Every alignment and length, so each slice loop starts and ends anywhere */
+static int test_alignment(void)
+{
+	uint32_t ctx, bytewise;
+	int start, len, i;
+
+	for (start = 0; start < 16; start++) {
+		for (len = 0; len < 64; len++) {
+			crc32_ctx_init(&ctx);
+			crc32_ctx_hash(&ctx, data + start, len);
+
+			crc32_ctx_init(&bytewise);
+			for (i = 0; i < len; i++)
+				crc32_ctx_hash8(&bytewise, data[start + i]);
+
+			TEST_ASSERT(crc32_ctx_result(&ctx) ==
+				    crc32_bitwise(data + start, len));
+			TEST_ASSERT(crc32_ctx_result(&bytewise) ==
+				    crc32_ctx_result(&ctx));
+		}
+	}
+
+	return EC_SUCCESS;
+}
+
+static int test_split(void)
+{
+	uint32_t ctx;
+	uint32_t expect = crc32_bitwise(data, sizeof(data));
+	int split;
+
+	for (split = 0; split <= sizeof(data); split += 7) {
+		crc32_ctx_init(&ctx);
+		crc32_ctx_hash(&ctx, data, split);
+		crc32_ctx_hash(&ctx, data + split, sizeof(data) - split);
+		TEST_ASSERT(crc32_ctx_result(&ctx) == expect);
+	}
+
+	return EC_SUCCESS;
+}
+
+static int test_interleaved(void)
+{
+	uint32_t a, b;
+	int i;
+
+	crc32_ctx_init(&a);
+	crc32_ctx_init(&b);
+	for (i = 0; i < sizeof(data); i += 10) {
+		crc32_ctx_hash(&a, data + i, 10);
+		crc32_ctx_hash(&b, data + sizeof(data) - 10 - i, 10);
+	}
+
+	TEST_ASSERT(crc32_ctx_result(&a) == crc32_bitwise(data, sizeof(data)));
+
+	crc32_ctx_init(&a);
+	for (i = 0; i < sizeof(data); i += 10)
+		crc32_ctx_hash(&a, data + sizeof(data) - 10 - i, 10);
+	TEST_ASSERT(crc32_ctx_result(&a) == crc32_ctx_result(&b));
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+	fill_data();
+
+	RUN_TEST(test_known_value);
+	RUN_TEST(test_legacy);
+	RUN_TEST(test_alignment);
+	RUN_TEST(test_split);
+	RUN_TEST(test_interleaved);
+
+	test_print_result();
+}
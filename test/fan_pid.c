@@ -0,0 +1,149 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test closed-loop fan control.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "ec_commands.h"
+#include "fan.h"
+#include "hooks.h"
+#include "math_util.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+/* From board/host/fan.c; with no RPM mode, the fan's speed follows its duty */
+extern int mock_rpm;
+extern int mock_stuck;
+
+static struct ec_response_pwm_fan_pid pid;
+
+static int get_pid(void)
+{
+	struct ec_params_pwm_fan_pid p = { .fan_idx = 0 };
+
+	return test_send_host_command(EC_CMD_PWM_FAN_PID, 0, &p, sizeof(p),
+				      &pid, sizeof(pid));
+}
+
+/* Wait for the controller to catch up with the target */
+static int wait_for_target(void)
+{
+	int i;
+
+	for (i = 0; i < 100; i++) {
+		usleep(HOOK_TICK_INTERVAL);
+		TEST_ASSERT(get_pid() == EC_RES_SUCCESS);
+		if (pid.setpoint_rpm == pid.target_rpm &&
+		    ABS((int)pid.filtered_rpm - (int)pid.target_rpm) < 50)
+			return EC_SUCCESS;
+	}
+
+	return EC_ERROR_TIMEOUT;
+}
+
+static int test_slew(void)
+{
+	int last;
+
+	fan_set_percent_needed(0, 0);
+	usleep(2 * HOOK_TICK_INTERVAL);
+	TEST_ASSERT(mock_rpm == 0);
+
+	/* Spinning up starts from rpm_start, and ramps from there */
+	fan_set_percent_needed(0, 100);
+	usleep(HOOK_TICK_INTERVAL);
+	TEST_ASSERT(get_pid() == EC_RES_SUCCESS);
+	TEST_ASSERT(pid.target_rpm == fans[0].rpm_max);
+	TEST_ASSERT(pid.setpoint_rpm >= fans[0].rpm_start);
+	last = pid.setpoint_rpm;
+
+	usleep(SECOND);
+	TEST_ASSERT(get_pid() == EC_RES_SUCCESS);
+	TEST_ASSERT(pid.setpoint_rpm > last);
+	TEST_ASSERT(pid.setpoint_rpm - last <=
+		    CONFIG_FAN_PID_SLEW_RPM * 3 / 2);
+
+	TEST_ASSERT(wait_for_target() == EC_SUCCESS);
+	TEST_ASSERT(pid.stalls == 0);
+
+	return EC_SUCCESS;
+}
+
+static int test_hysteresis(void)
+{
+	/* Small changes don't move the target... */
+	fan_set_percent_needed(0, 99);
+	TEST_ASSERT(get_pid() == EC_RES_SUCCESS);
+	TEST_ASSERT(pid.target_rpm == fans[0].rpm_max);
+
+	/* ...but bigger ones do */
+	fan_set_percent_needed(0, 50);
+	TEST_ASSERT(get_pid() == EC_RES_SUCCESS);
+	TEST_ASSERT(pid.target_rpm == fan_percent_to_rpm(0, 50));
+	TEST_ASSERT(wait_for_target() == EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+static int test_stall(void)
+{
+	int i, kicked = 0;
+
+	mock_stuck = 1;
+	for (i = 0; i < 20 && !kicked; i++) {
+		usleep(HOOK_TICK_INTERVAL);
+		TEST_ASSERT(get_pid() == EC_RES_SUCCESS);
+		kicked = pid.stalls == 1 && fan_get_duty(0) == 100;
+	}
+	TEST_ASSERT(kicked);
+
+	/* Once it turns again, it comes back up to speed */
+	mock_stuck = 0;
+	TEST_ASSERT(wait_for_target() == EC_SUCCESS);
+	TEST_ASSERT(pid.stalls == 1);
+
+	return EC_SUCCESS;
+}
+
+static int test_gains(void)
+{
+	struct ec_params_pwm_fan_pid p = {
+		.fan_idx = 0,
+		.flags = EC_FAN_PID_SET_GAINS,
+		.kp = 100,
+		.ki = 20,
+		.kd = 5,
+	};
+
+	TEST_ASSERT(test_send_host_command(EC_CMD_PWM_FAN_PID, 0, &p,
+					   sizeof(p), &pid, sizeof(pid)) ==
+		    EC_RES_SUCCESS);
+	TEST_ASSERT(pid.kp == 100 && pid.ki == 20 && pid.kd == 5);
+
+	p.fan_idx = CONFIG_FANS;
+	TEST_ASSERT(test_send_host_command(EC_CMD_PWM_FAN_PID, 0, &p,
+					   sizeof(p), &pid, sizeof(pid)) ==
+		    EC_RES_INVALID_PARAM);
+
+	/* Still steady with the new gains */
+	fan_set_percent_needed(0, 100);
+	TEST_ASSERT(wait_for_target() == EC_SUCCESS);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_slew);
+	RUN_TEST(test_hysteresis);
+	RUN_TEST(test_stall);
+	RUN_TEST(test_gains);
+
+	test_print_result();
+}
@@ -8,6 +8,7 @@
 #include "common.h"
 #include "console.h"
 #include "hooks.h"
+#include "task.h"
 #include "test_util.h"
 #include "timer.h"
 #include "util.h"
@@ -20,6 +21,10 @@ static timestamp_t tick_time[2];
 static int second_hook_count;
 static timestamp_t second_time[2];
 static int deferred_call_count;
+static int resume_hook_count;
+static int resume_deferred_hook_count;
+static int resume_count_seen_by_deferred;
+static task_id_t resume_deferred_task;
 
 static void init_hook(void)
 {
@@ -51,6 +56,21 @@ static void second_hook(void)
 }
 DECLARE_HOOK(HOOK_SECOND, second_hook, HOOK_PRIO_DEFAULT);
 
+static void resume_hook(void)
+{
+	resume_hook_count++;
+}
+DECLARE_HOOK(HOOK_CHIPSET_RESUME, resume_hook, HOOK_PRIO_DEFAULT);
+
+static void resume_deferred_hook(void)
+{
+	resume_deferred_hook_count++;
+	resume_count_seen_by_deferred = resume_hook_count;
+	resume_deferred_task = task_get_current();
+}
+DECLARE_HOOK(HOOK_CHIPSET_RESUME_DEFERRED, resume_deferred_hook,
+	     HOOK_PRIO_DEFAULT);
+
 static void deferred_func(void)
 {
 	deferred_call_count++;
@@ -130,6 +150,27 @@ static int test_deferred(void)
 	return EC_SUCCESS;
 }
 
+static int test_resume_deferred(void)
+{
+	/* Deferred resume hooks run afterwards, from the hook task */
+	hook_notify(HOOK_CHIPSET_RESUME);
+	TEST_ASSERT(resume_hook_count == 1);
+	TEST_ASSERT(resume_deferred_hook_count == 0);
+	usleep(MSEC);
+	TEST_ASSERT(resume_deferred_hook_count == 1);
+	TEST_ASSERT(resume_count_seen_by_deferred == 1);
+	TEST_ASSERT(resume_deferred_task == TASK_ID_HOOKS);
+
+	/* Suspending before they get to run skips them */
+	hook_notify(HOOK_CHIPSET_RESUME);
+	hook_notify(HOOK_CHIPSET_SUSPEND);
+	usleep(MSEC);
+	TEST_ASSERT(resume_hook_count == 2);
+	TEST_ASSERT(resume_deferred_hook_count == 1);
+
+	return EC_SUCCESS;
+}
+
 void run_test(void)
 {
 	test_reset();
@@ -138,6 +179,7 @@ void run_test(void)
 	RUN_TEST(test_ticks);
 	RUN_TEST(test_priority);
 	RUN_TEST(test_deferred);
+	RUN_TEST(test_resume_deferred);
 
 	test_print_result();
 }
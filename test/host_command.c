@@ -167,6 +167,36 @@ static int test_hostcmd_invalid_checksum(void)
 	return EC_SUCCESS;
 }
 
+static int test_memmap_update_count(void)
+{
+	uint8_t *seq = host_get_memmap(EC_MEMMAP_SEQ) + EC_MEMMAP_SEQ_BATTERY;
+	uint8_t start;
+
+	TEST_ASSERT(*host_get_memmap(EC_MEMMAP_ID_VERSION) >= 2);
+	TEST_ASSERT(!(*seq & 1));
+	start = *seq;
+
+	/* Odd through nested updates, and even but changed after */
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+	TEST_ASSERT(*seq & 1);
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+	TEST_ASSERT(*seq & 1);
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+	TEST_ASSERT(*seq & 1);
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+	TEST_ASSERT(!(*seq & 1));
+	TEST_ASSERT(*seq != start);
+
+	/* An update left unfinished by a previous image doesn't confuse it */
+	*seq |= 1;
+	host_memmap_begin_update(EC_MEMMAP_SEQ_BATTERY);
+	TEST_ASSERT(*seq & 1);
+	host_memmap_end_update(EC_MEMMAP_SEQ_BATTERY);
+	TEST_ASSERT(!(*seq & 1));
+
+	return EC_SUCCESS;
+}
+
 void run_test(void)
 {
 	wait_for_task_started();
@@ -180,6 +210,7 @@ void run_test(void)
 	RUN_TEST(test_hostcmd_wrong_command_version);
 	RUN_TEST(test_hostcmd_wrong_struct_version);
 	RUN_TEST(test_hostcmd_invalid_checksum);
+	RUN_TEST(test_memmap_update_count);
 
 	test_print_result();
 }
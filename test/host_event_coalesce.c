@@ -0,0 +1,134 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Test host event coalescing.
+ */
+
+#include "chipset.h"
+#include "common.h"
+#include "console.h"
+#include "hooks.h"
+#include "host_command.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+#define BATTERY EC_HOST_EVENT_MASK(EC_HOST_EVENT_BATTERY)
+#define BATTERY_STATUS EC_HOST_EVENT_MASK(EC_HOST_EVENT_BATTERY_STATUS)
+#define THERMAL EC_HOST_EVENT_MASK(EC_HOST_EVENT_THERMAL)
+#define LID_CLOSED EC_HOST_EVENT_MASK(EC_HOST_EVENT_LID_CLOSED)
+
+static int ap_on;
+
+int chipset_in_state(int state_mask)
+{
+	return state_mask & (ap_on ? CHIPSET_STATE_ON : CHIPSET_STATE_SOFT_OFF);
+}
+
+/* What the host can see */
+static uint32_t host_events(void)
+{
+	return *(uint32_t *)host_get_memmap(EC_MEMMAP_HOST_EVENTS);
+}
+
+static int test_ap_off(void)
+{
+	/* Let the host command task set its events first */
+	msleep(10);
+	ap_on = 0;
+	host_clear_events(0xffffffff);
+
+	host_set_events(BATTERY);
+	TEST_ASSERT(host_events() == BATTERY);
+
+	host_clear_events(0xffffffff);
+	return EC_SUCCESS;
+}
+
+static int test_batch(void)
+{
+	ap_on = 1;
+
+	/* Held for the window, along with anything else in the class */
+	host_set_events(BATTERY);
+	TEST_ASSERT(host_get_events() == BATTERY);
+	TEST_ASSERT(host_events() == 0);
+	host_set_events(BATTERY_STATUS);
+	TEST_ASSERT(host_events() == 0);
+
+	msleep(CONFIG_HOSTCMD_EVENT_COALESCE_WINDOW / MSEC + 5);
+	TEST_ASSERT(host_events() == (BATTERY | BATTERY_STATUS));
+
+	/* Setting what the host can already see is harmless */
+	host_set_events(BATTERY);
+	TEST_ASSERT(host_events() == (BATTERY | BATTERY_STATUS));
+
+	host_clear_events(0xffffffff);
+	return EC_SUCCESS;
+}
+
+static int test_min_interval(void)
+{
+	/* Battery was signaled just now, so it has to wait */
+	host_set_events(BATTERY);
+	msleep(CONFIG_HOSTCMD_EVENT_COALESCE_BATTERY / MSEC / 2);
+	TEST_ASSERT(host_events() == 0);
+
+	/* Other classes aren't held up by it */
+	host_set_events(THERMAL);
+	msleep(CONFIG_HOSTCMD_EVENT_COALESCE_WINDOW / MSEC + 5);
+	TEST_ASSERT(host_events() == THERMAL);
+
+	/* Uncoalesced events go straight through */
+	host_set_events(LID_CLOSED);
+	TEST_ASSERT(host_events() == (THERMAL | LID_CLOSED));
+
+	msleep(CONFIG_HOSTCMD_EVENT_COALESCE_BATTERY / MSEC / 2);
+	TEST_ASSERT(host_events() == (BATTERY | THERMAL | LID_CLOSED));
+
+	host_clear_events(0xffffffff);
+	return EC_SUCCESS;
+}
+
+static int test_drop(void)
+{
+	msleep(CONFIG_HOSTCMD_EVENT_COALESCE_THERMAL / MSEC);
+
+	/* Cleared before it's signaled, so the host never sees it */
+	host_set_events(THERMAL);
+	host_clear_events(THERMAL);
+	TEST_ASSERT(host_get_events() == 0);
+	msleep(CONFIG_HOSTCMD_EVENT_COALESCE_WINDOW / MSEC + 5);
+	TEST_ASSERT(host_events() == 0);
+
+	return EC_SUCCESS;
+}
+
+static int test_suspend(void)
+{
+	host_set_events(BATTERY);
+	TEST_ASSERT(host_events() == 0);
+
+	/* Everything held goes out when the AP leaves S0 */
+	ap_on = 0;
+	hook_notify(HOOK_CHIPSET_SUSPEND);
+	msleep(1);
+	TEST_ASSERT(host_events() == BATTERY);
+
+	host_clear_events(0xffffffff);
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_ap_off);
+	RUN_TEST(test_batch);
+	RUN_TEST(test_min_interval);
+	RUN_TEST(test_drop);
+	RUN_TEST(test_suspend);
+
+	test_print_result();
+}
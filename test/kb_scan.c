@@ -11,6 +11,7 @@
 #include "gpio.h"
 #include "hooks.h"
 #include "host_command.h"
+#include "keyboard_latency.h"
 #include "keyboard_raw.h"
 #include "keyboard_scan.h"
 #include "lid_switch.h"
@@ -31,6 +32,9 @@
 		old = fifo_add_count; \
 	} while (0)
 
+/* From common/keyboard_scan.c */
+extern volatile int kbd_polls;
+
 static uint8_t mock_state[KEYBOARD_COLS];
 static int column_driven;
 static int fifo_add_count;
@@ -71,6 +75,7 @@ int keyboard_raw_read_rows(void)
 int keyboard_fifo_add(const uint8_t *buffp)
 {
 	fifo_add_count++;
+	keyboard_latency_queued();
 	return EC_SUCCESS;
 }
 
@@ -252,6 +257,164 @@ static int debounce_test(void)
 	return EC_SUCCESS;
 }
 
+/* Number of scans the scan task makes in the next ms milliseconds */
+static int count_scans(int ms)
+{
+	int old_polls = kbd_polls;
+
+	msleep(ms);
+	return kbd_polls - old_polls;
+}
+
+static int idle_scan_test(void)
+{
+	struct keyboard_scan_config *config = keyboard_scan_get_config();
+	uint32_t old_poll_timeout = config->poll_timeout_us;
+	int scans;
+
+	/* Keep polling long enough to watch the scan rate */
+	config->poll_timeout_us = 2 * SECOND;
+
+	/* Without an idle period, scans stay at scan_period_us */
+	mock_key(1, 1, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	mock_key(1, 1, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	msleep(200);
+	scans = count_scans(300);
+	ccprintf("%d scans in 300 ms at a fixed rate\n", scans);
+	TEST_ASSERT(scans > 300 * MSEC / config->scan_period_us / 2);
+
+	/* With one, they back off to idle_scan_period_us once keys are up */
+	config->idle_scan_period_us = 30 * MSEC;
+
+	mock_key(1, 1, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	mock_key(1, 1, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	msleep(200);
+	scans = count_scans(300);
+	ccprintf("%d scans in 300 ms backed off\n", scans);
+	TEST_ASSERT(scans <= 300 * MSEC / config->idle_scan_period_us + 2);
+
+	/* Still polling but backed off; a new key must be seen promptly */
+	msleep(KEYDOWN_DELAY_MS * 2);
+	mock_key(2, 2, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	mock_key(2, 2, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+
+	/* Ghosting is still detected with the governor on */
+	mock_key(1, 1, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	mock_key(2, 2, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	mock_key(1, 2, 1);
+	mock_key(2, 1, 1);
+	TEST_ASSERT(expect_no_keychange() == EC_SUCCESS);
+	mock_key(2, 1, 0);
+	mock_key(1, 2, 0);
+	mock_key(2, 2, 0);
+	mock_key(1, 1, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+
+	config->idle_scan_period_us = 0;
+	config->poll_timeout_us = old_poll_timeout;
+
+	return EC_SUCCESS;
+}
+
+static int get_latency(struct ec_response_keyboard_latency *r, int reset)
+{
+	struct ec_params_keyboard_latency params;
+
+	params.flags = reset ? EC_KB_LATENCY_FLAG_RESET : 0;
+
+	return test_send_host_command(EC_CMD_KEYBOARD_LATENCY, 0, &params,
+				      sizeof(params), r, sizeof(*r));
+}
+
+/*
+ * Check the latency stats for a single key event, which the host took at
+ * least 5 ms to read. With one event, every stat comes from that event.
+ */
+static int check_latency_event(const struct ec_response_keyboard_latency *r,
+			       int debounce_us)
+{
+	int s, b, n;
+
+	TEST_ASSERT(r->events == 1);
+	TEST_ASSERT(r->dropped == 0);
+
+	for (s = 0; s < EC_KB_LATENCY_STAGE_COUNT; s++) {
+		for (b = n = 0; b < EC_KB_LATENCY_BUCKETS; b++)
+			n += r->histogram[s][b];
+		TEST_ASSERT(n == 1);
+	}
+
+	/* Debounce can't finish before the debounce time */
+	TEST_ASSERT(r->max_us[EC_KB_LATENCY_DEBOUNCE] >= debounce_us);
+	TEST_ASSERT(r->max_us[EC_KB_LATENCY_HOST] >= 5 * MSEC);
+
+	/* And the stages add up to the whole */
+	TEST_ASSERT(r->max_us[EC_KB_LATENCY_TOTAL] ==
+		    r->max_us[EC_KB_LATENCY_DEBOUNCE] +
+		    r->max_us[EC_KB_LATENCY_QUEUE] +
+		    r->max_us[EC_KB_LATENCY_HOST]);
+
+	ccprintf("Latency us: debounce %d queue %d host %d total %d\n",
+		 r->max_us[EC_KB_LATENCY_DEBOUNCE],
+		 r->max_us[EC_KB_LATENCY_QUEUE],
+		 r->max_us[EC_KB_LATENCY_HOST],
+		 r->max_us[EC_KB_LATENCY_TOTAL]);
+
+	return EC_SUCCESS;
+}
+
+static int latency_test(void)
+{
+	struct ec_response_keyboard_latency r;
+	const struct keyboard_scan_config *config = keyboard_scan_get_config();
+
+	/* Nobody read the events from earlier tests */
+	keyboard_latency_clear_pending();
+	TEST_ASSERT(get_latency(&r, 1) == EC_RES_SUCCESS);
+
+	/* Press and release, with the host taking a while to read each */
+	mock_key(1, 1, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	msleep(5);
+	keyboard_latency_host_read(0);
+	TEST_ASSERT(get_latency(&r, 1) == EC_RES_SUCCESS);
+	TEST_ASSERT(check_latency_event(&r, config->debounce_down_us) ==
+		    EC_SUCCESS);
+
+	mock_key(1, 1, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	msleep(5);
+	keyboard_latency_host_read(0);
+	TEST_ASSERT(get_latency(&r, 1) == EC_RES_SUCCESS);
+	TEST_ASSERT(check_latency_event(&r, config->debounce_up_us) ==
+		    EC_SUCCESS);
+
+	/* An event the host never reads is dropped when the queue clears */
+	mock_key(1, 1, 1);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	keyboard_latency_clear_pending();
+	mock_key(1, 1, 0);
+	TEST_ASSERT(expect_keychange() == EC_SUCCESS);
+	keyboard_latency_host_read(1);
+
+	TEST_ASSERT(get_latency(&r, 1) == EC_RES_SUCCESS);
+	TEST_ASSERT(r.events == 1);
+	TEST_ASSERT(r.dropped == 1);
+
+	TEST_ASSERT(get_latency(&r, 0) == EC_RES_SUCCESS);
+	TEST_ASSERT(r.events == 0);
+
+	return EC_SUCCESS;
+}
+
 static int simulate_key_test(void)
 {
 	int old_count;
@@ -383,6 +546,8 @@ static void run_test_step1(void)
 
 	RUN_TEST(deghost_test);
 	RUN_TEST(debounce_test);
+	RUN_TEST(idle_scan_test);
+	RUN_TEST(latency_test);
 	RUN_TEST(simulate_key_test);
 #ifdef EMU_BUILD
 	RUN_TEST(runtime_key_test);
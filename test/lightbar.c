@@ -7,6 +7,7 @@
 #include "ec_commands.h"
 #include "lightbar.h"
 #include "host_command.h"
+#include "i2c.h"
 #include "test_util.h"
 #include "timer.h"
 #include "util.h"
@@ -52,6 +53,78 @@ static int set_seq(int s)
 	return EC_RES_SUCCESS;
 }
 
+/* Count writes to the LED current registers of either controller */
+static int led_writes;
+
+/* Make writes to the LED current registers fail */
+static int led_writes_fail;
+
+static int lb_i2c_write8(int port, int slave_addr, int offset, int data)
+{
+	if (port != I2C_PORT_LIGHTBAR ||
+	    (slave_addr != 0x54 && slave_addr != 0x56))
+		return EC_ERROR_INVAL;
+	if (offset >= 0x15 && offset <= 0x1a) {
+		if (led_writes_fail)
+			return EC_ERROR_UNKNOWN;
+		led_writes++;
+	}
+	return EC_SUCCESS;
+}
+DECLARE_TEST_I2C_WRITE8(lb_i2c_write8);
+
+static int set_rgb(int led, int red, int green, int blue)
+{
+	struct ec_params_lightbar params;
+	struct ec_response_lightbar resp;
+
+	params.cmd = LIGHTBAR_CMD_SET_RGB;
+	params.set_rgb.led = led;
+	params.set_rgb.red = red;
+	params.set_rgb.green = green;
+	params.set_rgb.blue = blue;
+	return test_send_host_command(EC_CMD_LIGHTBAR_CMD, 0,
+				      &params, sizeof(params),
+				      &resp, sizeof(resp));
+}
+
+static int test_led_writes(void)
+{
+	/* Keep the task from changing the LEDs underneath us */
+	TEST_ASSERT(set_seq(LIGHTBAR_STOP) == EC_RES_SUCCESS);
+	msleep(500);
+	TEST_ASSERT(get_seq() == LIGHTBAR_STOP);
+
+	/* New colors get written */
+	TEST_ASSERT(set_rgb(0, 0, 0, 0) == EC_RES_SUCCESS);
+	led_writes = 0;
+	TEST_ASSERT(set_rgb(0, 100, 110, 120) == EC_RES_SUCCESS);
+	TEST_ASSERT(led_writes == 3);
+
+	/* Setting the same color again is free */
+	led_writes = 0;
+	TEST_ASSERT(set_rgb(0, 100, 110, 120) == EC_RES_SUCCESS);
+	TEST_ASSERT(led_writes == 0);
+
+	/* Only the channel that changed is written */
+	TEST_ASSERT(set_rgb(0, 100, 110, 130) == EC_RES_SUCCESS);
+	TEST_ASSERT(led_writes == 1);
+
+	/* A failed write is sent again, even if the color doesn't change */
+	led_writes_fail = 1;
+	TEST_ASSERT(set_rgb(0, 10, 20, 30) == EC_RES_SUCCESS);
+	led_writes_fail = 0;
+	led_writes = 0;
+	TEST_ASSERT(set_rgb(0, 10, 20, 30) == EC_RES_SUCCESS);
+	TEST_ASSERT(led_writes == 3);
+	led_writes = 0;
+	TEST_ASSERT(set_rgb(0, 10, 20, 30) == EC_RES_SUCCESS);
+	TEST_ASSERT(led_writes == 0);
+
+	TEST_ASSERT(set_seq(LIGHTBAR_S5) == EC_RES_SUCCESS);
+	return EC_SUCCESS;
+}
+
 static int test_double_oneshots(void)
 {
 	/* Start in S0 */
@@ -280,5 +353,6 @@ void run_test(void)
 	RUN_TEST(test_stop_timeout);
 	RUN_TEST(test_oneshots_norm_msg);
 	RUN_TEST(test_double_oneshots);
+	RUN_TEST(test_led_writes);
 	test_print_result();
 }
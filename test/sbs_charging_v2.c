@@ -24,6 +24,7 @@ static int is_shutdown;
 static int is_force_discharge;
 static int is_hibernated;
 static int override_voltage, override_current, override_usec;
+static int charger_loops;
 
 /* The simulation doesn't really hibernate, so we must reset this ourselves */
 extern timestamp_t shutdown_warning_time;
@@ -60,6 +61,8 @@ void system_hibernate(int sec, int usec)
 
 int charger_profile_override(struct charge_state_data *curr)
 {
+	charger_loops++;
+
 	if (override_voltage)
 		curr->requested_voltage = override_voltage;
 	if (override_current)
@@ -672,7 +675,63 @@ static int test_low_battery_hostevents(void)
 	return EC_SUCCESS;
 }
 
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+static int test_adaptive_poll(void)
+{
+	/* Full battery on AC, with the AP running */
+	test_setup(1);
+	sb_write(SB_RELATIVE_STATE_OF_CHARGE, 100);
+	sb_write(SB_ABSOLUTE_STATE_OF_CHARGE, 100);
+	sb_write(SB_CHARGING_CURRENT, 0);
+	sb_write(SB_CURRENT, 0);
+	wait_charging_state();
+	TEST_ASSERT(charge_get_percent() == 100);
+
+	/* Nothing is changing, but the AP is on so there's no back-off */
+	charger_loops = 0;
+	sleep(10);
+	ccprintf("[CHARGING TEST] %d loops in 10s, AP on\n", charger_loops);
+	TEST_ASSERT(charger_loops >= 15);
+
+	/*
+	 * With the AP suspended, the task should back off. (Not off, since
+	 * our profile override caps the period then.)
+	 */
+	mock_chipset_state = CHIPSET_STATE_SUSPEND;
+	charger_loops = 0;
+	sleep(60);
+	ccprintf("[CHARGING TEST] %d loops in 60s, AP suspended\n", charger_loops);
+	TEST_ASSERT(charger_loops > 0 && charger_loops < 15);
+
+	/* An alert brings it right back, and restarts the back-off */
+	charger_loops = 0;
+	charger_alert_interrupt(GPIO_AC_PRESENT);
+	msleep(WAIT_CHARGER_TASK);
+	TEST_ASSERT(charger_loops == 1);
+	sleep(4);
+	TEST_ASSERT(charger_loops >= 2);
 
+	/* So does any change while it's backed off */
+	sleep(60);
+	sb_write(SB_RELATIVE_STATE_OF_CHARGE, 60);
+	sb_write(SB_CHARGING_CURRENT, 4000);
+	charger_loops = 0;
+	gpio_set_level(GPIO_AC_PRESENT, 0);
+	sleep(5);
+	TEST_ASSERT(charger_loops >= 2);
+
+	/* And once the AP resumes, it's back to polling every period */
+	sleep(60);
+	mock_chipset_state = CHIPSET_STATE_ON;
+	hook_notify(HOOK_CHIPSET_RESUME);
+	msleep(WAIT_CHARGER_TASK);
+	charger_loops = 0;
+	sleep(5);
+	TEST_ASSERT(charger_loops >= 5);
+
+	return EC_SUCCESS;
+}
+#endif
 
 void run_test(void)
 {
@@ -683,6 +742,9 @@ void run_test(void)
 	RUN_TEST(test_hc_charge_state);
 	RUN_TEST(test_hc_current_limit);
 	RUN_TEST(test_low_battery_hostevents);
+#ifdef CONFIG_CHARGER_ADAPTIVE_POLL
+	RUN_TEST(test_adaptive_poll);
+#endif
 
 	test_print_result();
 }
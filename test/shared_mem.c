@@ -0,0 +1,176 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for shared memory leases.
+ */
+
+#include "common.h"
+#include "shared_mem.h"
+#include "task.h"
+#include "test_util.h"
+#include "timer.h"
+#include "util.h"
+
+/* Buffer for the releaser task to give back, and when */
+static char *to_release;
+static int release_delay_ms;
+
+int releaser_task(void *unused)
+{
+	while (1) {
+		task_wait_event(-1);
+		msleep(release_delay_ms);
+		shared_mem_release(to_release);
+	}
+
+	return EC_SUCCESS;
+}
+
+static int test_concurrent(void)
+{
+	int sz = shared_mem_size();
+	char *a, *b, *c;
+
+	TEST_ASSERT(shared_mem_acquire(sz / 4, &a) == EC_SUCCESS);
+	TEST_ASSERT(shared_mem_acquire(sz / 4, &b) == EC_SUCCESS);
+	TEST_ASSERT(a != b);
+
+	/* No overlap, and writing one doesn't disturb the other */
+	TEST_ASSERT(a + sz / 4 <= b || b + sz / 4 <= a);
+	memset(a, 0xaa, sz / 4);
+	memset(b, 0x55, sz / 4);
+	TEST_ASSERT_MEMSET(a, (char)0xaa, sz / 4);
+
+	/* Not enough left for the whole region */
+	TEST_ASSERT(shared_mem_acquire(sz, &c) == EC_ERROR_BUSY);
+
+	/* Freeing the first leaves a hole, which is reused */
+	shared_mem_release(a);
+	TEST_ASSERT(shared_mem_acquire(sz / 8, &c) == EC_SUCCESS);
+	TEST_ASSERT(c == a);
+
+	shared_mem_release(b);
+	shared_mem_release(c);
+
+	/* Everything is back */
+	TEST_ASSERT(shared_mem_acquire(sz, &a) == EC_SUCCESS);
+	shared_mem_release(a);
+
+	return EC_SUCCESS;
+}
+
+static int test_alignment(void)
+{
+	char *a, *b;
+
+	TEST_ASSERT(shared_mem_acquire(3, &a) == EC_SUCCESS);
+	TEST_ASSERT(((uintptr_t)a & (SHARED_MEM_ALIGN - 1)) == 0);
+
+	TEST_ASSERT(shared_mem_acquire_aligned(5, 64, &b) == EC_SUCCESS);
+	TEST_ASSERT(((uintptr_t)b & 63) == 0);
+	shared_mem_release(b);
+
+	TEST_ASSERT(shared_mem_acquire_aligned(5, 3, &b) == EC_ERROR_INVAL);
+	TEST_ASSERT(shared_mem_acquire_aligned(5, 0, &b) == EC_ERROR_INVAL);
+
+	shared_mem_release(a);
+
+	return EC_SUCCESS;
+}
+
+static int test_lease_limit(void)
+{
+	char *bufs[CONFIG_SHARED_MEM_LEASES];
+	char *extra;
+	int i;
+
+	for (i = 0; i < CONFIG_SHARED_MEM_LEASES; i++)
+		TEST_ASSERT(shared_mem_acquire(8, bufs + i) == EC_SUCCESS);
+	TEST_ASSERT(shared_mem_acquire(8, &extra) == EC_ERROR_BUSY);
+
+	for (i = 0; i < CONFIG_SHARED_MEM_LEASES; i++)
+		shared_mem_release(bufs[i]);
+
+	return EC_SUCCESS;
+}
+
+static int test_stats(void)
+{
+	struct shared_mem_stats stats;
+	int sz = shared_mem_size();
+	int half = (sz / 2) & ~(SHARED_MEM_ALIGN - 1);
+	int busy;
+	char *a, *b;
+
+	shared_mem_get_stats(&stats);
+	TEST_ASSERT(stats.size == sz);
+	TEST_ASSERT(stats.used == 0);
+	TEST_ASSERT(stats.leases == 0);
+	TEST_ASSERT(stats.largest_free == sz);
+	busy = stats.busy_count;
+
+	TEST_ASSERT(shared_mem_acquire(half, &a) == EC_SUCCESS);
+	TEST_ASSERT(shared_mem_acquire(16, &b) == EC_SUCCESS);
+	TEST_ASSERT(b == a + half);
+	TEST_ASSERT(shared_mem_acquire(sz, &b) == EC_ERROR_BUSY);
+
+	shared_mem_get_stats(&stats);
+	TEST_ASSERT(stats.used == half + 16);
+	TEST_ASSERT(stats.leases == 2);
+	TEST_ASSERT(stats.largest_free == sz - half - 16);
+	TEST_ASSERT(stats.max_used >= half + 16);
+	TEST_ASSERT(stats.max_leases >= 2);
+	TEST_ASSERT(stats.busy_count == busy + 1);
+
+	shared_mem_release(a);
+
+	/* The high-water mark stays put */
+	shared_mem_get_stats(&stats);
+	TEST_ASSERT(stats.used == 16);
+	TEST_ASSERT(stats.max_used >= half + 16);
+	TEST_ASSERT(stats.largest_free == MAX(half, sz - half - 16));
+
+	shared_mem_release(a + half);
+
+	return EC_SUCCESS;
+}
+
+static int test_wait(void)
+{
+	int sz = shared_mem_size();
+	timestamp_t start;
+	char *a, *b;
+
+	TEST_ASSERT(shared_mem_acquire(sz, &a) == EC_SUCCESS);
+
+	/* Nobody gives it back */
+	start = get_time();
+	TEST_ASSERT(shared_mem_acquire_wait(16, &b, 20 * MSEC) ==
+		    EC_ERROR_TIMEOUT);
+	TEST_ASSERT(get_time().val - start.val >= 20 * MSEC);
+
+	/* Released by another task while we wait */
+	to_release = a;
+	release_delay_ms = 10;
+	task_wake(TASK_ID_RELEASER);
+	start = get_time();
+	TEST_ASSERT(shared_mem_acquire_wait(16, &b, SECOND) == EC_SUCCESS);
+	TEST_ASSERT(get_time().val - start.val < 500 * MSEC);
+	shared_mem_release(b);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	RUN_TEST(test_concurrent);
+	RUN_TEST(test_alignment);
+	RUN_TEST(test_lease_limit);
+	RUN_TEST(test_stats);
+	RUN_TEST(test_wait);
+
+	test_print_result();
+}
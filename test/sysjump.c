@@ -0,0 +1,74 @@
+/* Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+ * Use of this source code is governed by a BSD-style license that can be
+ * found in the LICENSE file.
+ *
+ * Tests for jumping between images.
+ */
+
+#include "common.h"
+#include "console.h"
+#include "system.h"
+#include "test_util.h"
+#include "timer.h"
+#include "uart.h"
+#include "util.h"
+
+#define UART_SYSJUMP_TAG 0x5554  /* "UT" */
+
+static int test_no_jump_times(void)
+{
+	TEST_ASSERT(system_get_jump_times() == NULL);
+
+	return EC_SUCCESS;
+}
+
+static int test_jump(void)
+{
+	ccprintf("Jumping with this still buffered\n");
+	system_run_image_copy(SYSTEM_IMAGE_RW);
+
+	/* Shouldn't reach here */
+	return EC_ERROR_UNKNOWN;
+}
+
+static int test_jump_times(void)
+{
+	const uint32_t *t = system_get_jump_times();
+	int i;
+
+	TEST_ASSERT(t != NULL);
+	TEST_ASSERT(t[JUMP_PHASE_START] != 0);
+
+	/* HOOK_INIT is done by the time the test runs */
+	for (i = 1; i < JUMP_PHASE_COUNT; i++)
+		TEST_ASSERT((int32_t)(t[i] - t[i - 1]) >= 0);
+
+	return EC_SUCCESS;
+}
+
+static int test_uart_handover(void)
+{
+	int version, size;
+
+	/* The UART handed over what was left, even if that was nothing */
+	TEST_ASSERT(system_get_jump_tag(UART_SYSJUMP_TAG, &version, &size));
+	TEST_ASSERT(version == 1);
+	TEST_ASSERT(size <= 255);
+
+	return EC_SUCCESS;
+}
+
+void run_test(void)
+{
+	test_reset();
+
+	if (system_get_image_copy() == SYSTEM_IMAGE_RO) {
+		RUN_TEST(test_no_jump_times);
+		RUN_TEST(test_jump);
+	} else {
+		RUN_TEST(test_jump_times);
+		RUN_TEST(test_uart_handover);
+	}
+
+	test_print_result();
+}
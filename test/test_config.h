@@ -14,6 +14,23 @@
 /* Don't compile vboot hash support unless specifically testing for it */
 #undef CONFIG_VBOOT_HASH
 
+#ifdef TEST_BENCHMARK
+#define CONFIG_BENCHMARK
+#define CONFIG_RSA
+#define CONFIG_SHA256
+#define CONFIG_SW_CRC
+#endif
+
+#ifdef TEST_CRC32
+#define CONFIG_SW_CRC
+#define CONFIG_SW_CRC_SLICE 8
+#endif
+
+#ifdef TEST_SYSJUMP
+#define CONFIG_CMD_JUMPTIMES
+#define CONFIG_SYSJUMP_WARM
+#endif
+
 #ifdef TEST_BKLIGHT_LID
 #define CONFIG_BACKLIGHT_LID
 #endif
@@ -33,6 +50,7 @@
 
 #ifdef TEST_KB_SCAN
 #define CONFIG_KEYBOARD_PROTOCOL_MKBP
+#define CONFIG_KEYBOARD_LATENCY
 #endif
 
 #ifdef TEST_MATH_UTIL
@@ -59,7 +77,7 @@ int board_discharge_on_ac(int enabled);
 #define I2C_PORT_CHARGER 1
 #endif
 
-#ifdef TEST_SBS_CHARGING_V2
+#if defined(TEST_SBS_CHARGING_V2) || defined(TEST_SBS_CHARGING_V2_ADAPTIVE)
 #define CONFIG_BATTERY_MOCK
 #define CONFIG_BATTERY_SMART
 #define CONFIG_CHARGER
@@ -74,7 +92,11 @@ int board_discharge_on_ac(int enabled);
 #define I2C_PORT_CHARGER 1
 #endif
 
-#ifdef TEST_THERMAL
+#ifdef TEST_SBS_CHARGING_V2_ADAPTIVE
+#define CONFIG_CHARGER_ADAPTIVE_POLL
+#endif
+
+#if defined(TEST_THERMAL) || defined(TEST_THERMAL_FILTER)
 #define CONFIG_CHIPSET_CAN_THROTTLE
 #define CONFIG_FANS 1
 #define CONFIG_TEMP_SENSOR
@@ -83,10 +105,26 @@ int board_discharge_on_ac(int enabled);
 int bd99992gw_get_temp(uint16_t adc);
 #endif
 
+#ifdef TEST_THERMAL_FILTER
+#define CONFIG_THERMAL_EMA_SHIFT 2
+#define CONFIG_THERMAL_FAN_PREDICT_SEC 10
+#define CONFIG_THERMAL_HYSTERESIS 2
+#define CONFIG_THERMAL_SENSOR_PERIOD
+#endif
+
 #ifdef TEST_FAN
 #define CONFIG_FANS 1
 #endif
 
+#ifdef TEST_HOST_EVENT_COALESCE
+#define CONFIG_HOSTCMD_EVENT_COALESCE
+#endif
+
+#ifdef TEST_FAN_PID
+#define CONFIG_FANS 1
+#define CONFIG_FAN_PID
+#endif
+
 #ifdef TEST_BUTTON
 #define CONFIG_BUTTON_COUNT 2
 #define CONFIG_KEYBOARD_PROTOCOL_8042
@@ -95,6 +133,7 @@ int bd99992gw_get_temp(uint16_t adc);
 #ifdef TEST_BATTERY_GET_PARAMS_SMART
 #define CONFIG_BATTERY_MOCK
 #define CONFIG_BATTERY_SMART
+#define CONFIG_BATTERY_SMART_CACHE
 #define CONFIG_CHARGER_INPUT_CURRENT 4032
 #define I2C_PORT_MASTER 1
 #define I2C_PORT_BATTERY 1
@@ -31,6 +31,7 @@ BUILD_ASSERT(EC_TEMP_THRESH_COUNT == 3);
 /* Mock functions */
 
 static int mock_temp[TEMP_SENSOR_COUNT];
+static int mock_reads[TEMP_SENSOR_COUNT];
 static int host_throttled;
 static int cpu_throttled;
 static int cpu_shutdown;
@@ -39,6 +40,8 @@ static int no_temps_read;
 
 int dummy_temp_get_val(int idx, int *temp_ptr)
 {
+	mock_reads[idx]++;
+
 	if (mock_temp[idx] >= 0) {
 		*temp_ptr = mock_temp[idx];
 		return EC_SUCCESS;
@@ -88,6 +91,36 @@ static void all_temps(int t)
 	set_temps(t, t, t, t);
 }
 
+#ifdef CONFIG_THERMAL_HYSTERESIS
+#define HYSTERESIS CONFIG_THERMAL_HYSTERESIS
+#else
+#define HYSTERESIS 0
+#endif
+
+/*
+ * Give thermal control time to act on new temperatures. With filtering on,
+ * that means waiting for the filter to settle on them.
+ */
+static void wait_for_temps(void)
+{
+#ifdef CONFIG_THERMAL_EMA_SHIFT
+	sleep(16 << CONFIG_THERMAL_EMA_SHIFT);
+#else
+	sleep(2);
+#endif
+}
+
+#ifdef CONFIG_THERMAL_EMA_SHIFT
+/* Wait for thermal control to take this many more samples of a sensor */
+static void wait_for_samples(int id, int count)
+{
+	int target = mock_reads[id] + count;
+
+	while (mock_reads[id] < target)
+		msleep(10);
+}
+#endif
+
 static void reset_mocks(void)
 {
 	/* Ignore all sensors */
@@ -111,7 +144,7 @@ static void reset_mocks(void)
 static int test_init_val(void)
 {
 	reset_mocks();
-	sleep(2);
+	wait_for_temps();
 
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
@@ -119,7 +152,7 @@ static int test_init_val(void)
 	TEST_ASSERT(fan_pct == 0);
 	TEST_ASSERT(no_temps_read);
 
-	sleep(2);
+	wait_for_temps();
 
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
@@ -135,7 +168,7 @@ static int test_sensors_can_be_read(void)
 	reset_mocks();
 	mock_temp[2] = 100;
 
-	sleep(2);
+	wait_for_temps();
 
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
@@ -154,35 +187,35 @@ static int test_one_fan(void)
 	thermal_params[2].temp_fan_max = 200;
 
 	all_temps(50);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 0);
 
 	all_temps(100);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 0);
 
 	all_temps(101);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 1);
 
 	all_temps(130);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 30);
 
 	all_temps(150);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 50);
 
 	all_temps(170);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 70);
 
 	all_temps(200);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	all_temps(300);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	return EC_SUCCESS;
@@ -198,38 +231,38 @@ static int test_two_fans(void)
 	thermal_params[2].temp_fan_max = 200;
 
 	all_temps(50);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 0);
 
 	all_temps(100);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 0);
 
 	all_temps(101);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 1);
 
 	all_temps(130);
-	sleep(2);
+	wait_for_temps();
 	/* fan 2 is still higher */
 	TEST_ASSERT(fan_pct == 30);
 
 	all_temps(150);
-	sleep(2);
+	wait_for_temps();
 	/* now fan 1 is higher: 150 = 75% of [120-160] */
 	TEST_ASSERT(fan_pct == 75);
 
 	all_temps(170);
-	sleep(2);
+	wait_for_temps();
 	/* fan 1 is maxed now */
 	TEST_ASSERT(fan_pct == 100);
 
 	all_temps(200);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	all_temps(300);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	return EC_SUCCESS;
@@ -249,69 +282,69 @@ static int test_all_fans(void)
 	thermal_params[3].temp_fan_max = 500;
 
 	set_temps(1, 1, 1, 1);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 0);
 
 	/* Each sensor has its own range */
 	set_temps(40, 0, 0, 0);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 50);
 
 	set_temps(0, 140, 0, 0);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 50);
 
 	set_temps(0, 0, 150, 0);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 50);
 
 	set_temps(0, 0, 0, 400);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 50);
 
 	set_temps(60, 0, 0, 0);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	set_temps(0, 160, 0, 0);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	set_temps(0, 0, 200, 0);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	set_temps(0, 0, 0, 500);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	/* But sensor 0 needs the most cooling */
 	all_temps(20);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 0);
 
 	all_temps(21);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 2);
 
 	all_temps(30);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 25);
 
 	all_temps(40);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 50);
 
 	all_temps(50);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 75);
 
 	all_temps(60);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	all_temps(65);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(fan_pct == 100);
 
 	return EC_SUCCESS;
@@ -325,85 +358,85 @@ static int test_one_limit(void)
 	thermal_params[2].temp_host[EC_TEMP_THRESH_HALT] = 300;
 
 	all_temps(50);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(100);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(101);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(100);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
-	all_temps(99);
-	sleep(2);
+	all_temps(99 - HYSTERESIS);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(199);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(200);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(201);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(200);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 0);
 
-	all_temps(199);
-	sleep(2);
+	all_temps(199 - HYSTERESIS);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
-	all_temps(99);
-	sleep(2);
+	all_temps(99 - HYSTERESIS);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(201);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 0);
 
-	all_temps(99);
-	sleep(2);
+	all_temps(99 - HYSTERESIS);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	all_temps(301);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 1);
@@ -411,14 +444,14 @@ static int test_one_limit(void)
 	/* We probably won't be able to read the CPU temp while shutdown,
 	 * so nothing will change. */
 	all_temps(-1);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	/* cpu_shutdown is only set for testing purposes. The thermal task
 	 * doesn't do anything that could clear it. */
 
 	all_temps(50);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 
@@ -442,37 +475,37 @@ static int test_several_limits(void)
 	thermal_params[3].temp_host[EC_TEMP_THRESH_HALT] = 40;
 
 	set_temps(500, 100, 150, 10);
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1); /* 1=low, 2=warn, 3=low */
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	set_temps(500, 50, -1, 10);	/* 1=low, 2=X, 3=low */
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	set_temps(500, 170, 210, 10);	/* 1=warn, 2=high, 3=low */
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	set_temps(500, 100, 50, 40);	/* 1=low, 2=low, 3=high */
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 0);
 
 	set_temps(500, 100, 50, 41);	/* 1=low, 2=low, 3=shutdown */
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 1);
 	TEST_ASSERT(cpu_throttled == 1);
 	TEST_ASSERT(cpu_shutdown == 1);
 
 	all_temps(0);			/* reset from shutdown */
-	sleep(2);
+	wait_for_temps();
 	TEST_ASSERT(host_throttled == 0);
 	TEST_ASSERT(cpu_throttled == 0);
 
@@ -480,6 +513,121 @@ static int test_several_limits(void)
 	return EC_SUCCESS;
 }
 
+#ifdef CONFIG_THERMAL_HYSTERESIS
+static int test_hysteresis(void)
+{
+	reset_mocks();
+	thermal_params[2].temp_host[EC_TEMP_THRESH_WARN] = 100;
+
+	all_temps(101);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 1);
+
+	/* Just under the limit isn't enough to release it */
+	all_temps(99);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 1);
+
+	all_temps(100 - HYSTERESIS);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 1);
+
+	all_temps(99 - HYSTERESIS);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 0);
+
+	/* Nor is it needed to trip it again */
+	all_temps(101);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 1);
+
+	return EC_SUCCESS;
+}
+#endif
+
+#ifdef CONFIG_THERMAL_EMA_SHIFT
+/* The expected values below assume each reading has a weight of 1/4 */
+BUILD_ASSERT(CONFIG_THERMAL_EMA_SHIFT == 2);
+
+static int test_filter(void)
+{
+	reset_mocks();
+	thermal_params[2].temp_host[EC_TEMP_THRESH_WARN] = 150;
+
+	all_temps(100);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 0);
+
+	/* Each new reading only moves the temperature part of the way */
+	all_temps(200);
+	wait_for_samples(2, 1);		/* 125 */
+	TEST_ASSERT(host_throttled == 0);
+	wait_for_samples(2, 1);		/* 143.75 */
+	TEST_ASSERT(host_throttled == 0);
+	wait_for_samples(2, 1);		/* 157.8 */
+	TEST_ASSERT(host_throttled == 1);
+
+	all_temps(100);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 0);
+
+	/* So a single glitch doesn't trip anything */
+	all_temps(300);
+	wait_for_samples(2, 1);		/* 150 */
+	all_temps(100);
+	TEST_ASSERT(host_throttled == 0);
+	wait_for_temps();
+	TEST_ASSERT(host_throttled == 0);
+
+	/* A failed read starts the filter over from the next good one */
+	all_temps(-1);
+	wait_for_samples(2, 1);
+	all_temps(200);
+	wait_for_samples(2, 1);
+	TEST_ASSERT(host_throttled == 1);
+
+	return EC_SUCCESS;
+}
+
+#ifdef CONFIG_THERMAL_FAN_PREDICT_SEC
+static int test_fan_predict(void)
+{
+	int i;
+
+	reset_mocks();
+	thermal_params[2].temp_fan_off = 100;
+	thermal_params[2].temp_fan_max = 200;
+
+	all_temps(100);
+	wait_for_temps();
+	TEST_ASSERT(fan_pct == 0);
+
+	/* Heating up 2 degrees a second, the fan gets ahead of it */
+	for (i = 1; i <= 10; i++) {
+		all_temps(100 + 2 * i);
+		wait_for_samples(2, 1);
+	}
+	ccprintf("fan at %d%% for 20%%\n", fan_pct);
+	TEST_ASSERT(fan_pct > 20);
+
+	/* Once it stops rising, the fan settles where it should be */
+	wait_for_temps();
+	TEST_ASSERT(fan_pct == 20);
+
+	/* But it never slows down early */
+	for (i = 1; i <= 10; i++) {
+		all_temps(120 - 2 * i);
+		wait_for_samples(2, 1);
+		TEST_ASSERT(fan_pct >= 20 - 2 * i);
+	}
+	wait_for_temps();
+	TEST_ASSERT(fan_pct == 0);
+
+	return EC_SUCCESS;
+}
+#endif
+#endif
+
 /* Tests for bd99992gw temperature sensor ADC-to-temp calculation */
 #define LOW_ADC_TEST_VALUE	887 /* 0 C */
 #define HIGH_ADC_TEST_VALUE	100 /* > 100C */
@@ -543,6 +691,15 @@ void run_test(void)
 
 	RUN_TEST(test_one_limit);
 	RUN_TEST(test_several_limits);
+#ifdef CONFIG_THERMAL_HYSTERESIS
+	RUN_TEST(test_hysteresis);
+#endif
+#ifdef CONFIG_THERMAL_EMA_SHIFT
+	RUN_TEST(test_filter);
+#ifdef CONFIG_THERMAL_FAN_PREDICT_SEC
+	RUN_TEST(test_fan_predict);
+#endif
+#endif
 
 	RUN_TEST(test_bd99992_adc_to_temp);
 	test_print_result();
@@ -0,0 +1,445 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Estimate the worst-case stack use of each task in a linked EC image.
+
+The task list is read back out of the image itself (tasks_init[] and
+task_names[]), so what's checked is exactly what the board's ec.tasklist
+built. Stack frames and calls come from the disassembly:
+
+  - Each function's frame is the deepest its pushes and stack pointer
+    adjustments go, wherever they are in the function.
+  - Direct calls and tail calls are followed.
+  - Hooks, deferred calls and console and host commands are run through
+    the linker's dispatch tables (__hooks_*, __cmds, __hcmds, ...). An
+    indirect call is assumed to reach every entry of each table that the
+    function, or something it calls directly, refers to, either itself or
+    through a table of tables like hook_list[]. Other indirect calls can't
+    be followed, so results which depend on them are lower bounds, marked
+    with '>='.
+  - Recursion is reported, and the recursive call counted once.
+
+Interrupts are charged as the hardware does it: the first exception frame and
+the context switch save go on the task's stack; handlers, and any further
+nested frames, go on the system stack, one handler per priority level.
+
+Only Cortex-M images are supported.
+
+Usage: analyzestack.py [--objdump OBJDUMP] [--fpu] [--ram-map] ec.RW.elf
+"""
+
+from __future__ import print_function
+
+import argparse
+import collections
+import re
+import struct
+import subprocess
+import sys
+
+# Exception frame the hardware pushes, and what the context switch adds
+EXC_FRAME = 32
+EXC_FRAME_FPU = EXC_FRAME + 72
+SWITCH_SAVE = 32
+SWITCH_SAVE_FPU = SWITCH_SAVE + 64
+
+# Matches struct in core/cortex-m*/task.c: r0, pc, stack_size (padded)
+TASKS_INIT_ENTRY = struct.Struct('<IIH2x')
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHT_PROGBITS = 1
+STT_FUNC = 2
+
+
+class Elf(object):
+  """Just enough of a 32-bit little-endian ELF reader for our needs."""
+
+  Section = collections.namedtuple('Section',
+                                   'name type flags addr offset size')
+  Symbol = collections.namedtuple('Symbol', 'name value size type shndx')
+
+  def __init__(self, path):
+    with open(path, 'rb') as f:
+      self.data = f.read()
+
+    if self.data[:4] != b'\x7fELF' or self.data[4:6] != b'\x01\x01':
+      raise ValueError('%s is not a 32-bit little-endian ELF' % path)
+
+    (shoff,) = struct.unpack_from('<I', self.data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', self.data, 0x2e)
+
+    raw = [struct.unpack_from('<IIIIIIIIII', self.data, shoff + i * shentsize)
+           for i in range(shnum)]
+    names = raw[shstrndx][4]
+    self.sections = [self.Section(self._str(names + s[0]), s[1], s[2], s[3],
+                                  s[4], s[5]) for s in raw]
+
+    self.symbols = {}
+    for s in raw:
+      if s[1] != 2:  # SHT_SYMTAB
+        continue
+      strtab = raw[s[6]][4]
+      for off in range(s[4], s[4] + s[5], 16):
+        name, value, size, info, _, shndx = struct.unpack_from(
+            '<IIIBBH', self.data, off)
+        if name:
+          sym = self.Symbol(self._str(strtab + name), value, size, info & 0xf,
+                            shndx)
+          self.symbols[sym.name] = sym
+
+  def _str(self, off):
+    return self.data[off:self.data.index(b'\0', off)].decode('ascii')
+
+  def read(self, addr, size):
+    """Read initialized data at an address, or None if there isn't any."""
+    for s in self.sections:
+      if (s.type == SHT_PROGBITS and s.flags & SHF_ALLOC and
+          s.addr <= addr and addr + size <= s.addr + s.size):
+        off = s.offset + addr - s.addr
+        return self.data[off:off + size]
+    return None
+
+  def read_word(self, addr):
+    data = self.read(addr, 4)
+    return struct.unpack('<I', data)[0] if data else None
+
+  def read_string(self, addr):
+    for s in self.sections:
+      if s.type == SHT_PROGBITS and s.addr <= addr < s.addr + s.size:
+        return self._str(s.offset + addr - s.addr)
+    return None
+
+
+class Function(object):
+
+  def __init__(self, name, addr):
+    self.name = name
+    self.addr = addr
+    self.frame = 0
+    # Direct calls, and branches which may be tail calls
+    self.calls = set()
+    self.branches = set()
+    # Literal pool words, to see which tables it refers to
+    self.words = set()
+    self.indirect = False
+    self.dynamic = False
+
+
+# objdump -d --no-show-raw-insn output, from binutils or LLVM
+FUNC_RE = re.compile(r'^([0-9a-f]+) <([^>]+)>:$')
+INSN_RE = re.compile(r'^\s*([0-9a-f]+):\s+(?:(?:[0-9a-f]{2}\s)+\s*)?'
+                     r'(\.?[a-z][\w.]*)\s*(.*)$')
+TARGET_RE = re.compile(r'(?:0x)?[0-9a-f]+\s*<([^>+]+)(?:\+0x[0-9a-f]+)?>')
+IMM_RE = re.compile(r'#(0x[0-9a-f]+|\d+)')
+REG_RANGE_RE = re.compile(r'([a-z]+)(\d+)-[a-z]+(\d+)')
+BRANCH_RE = re.compile(
+    r'^b(eq|ne|cs|cc|hs|lo|mi|pl|vs|vc|hi|ls|ge|lt|gt|le)?$')
+
+
+def CountRegs(operands):
+  """Return the bytes taken by a register list like {r4-r7, lr}."""
+  regs = operands[operands.index('{') + 1:operands.index('}')]
+  size = 0
+  for reg in regs.split(','):
+    reg = reg.strip()
+    m = REG_RANGE_RE.match(reg)
+    count = int(m.group(3)) - int(m.group(2)) + 1 if m else 1
+    size += count * (8 if reg.startswith('d') else 4)
+  return size
+
+
+def Imm(operands):
+  m = IMM_RE.search(operands)
+  return int(m.group(1), 0) if m else None
+
+
+def Disassemble(objdump, elf_path):
+  """Parse the disassembly into Functions, keyed by name."""
+  out = subprocess.check_output([objdump, '-d', '--no-show-raw-insn',
+                                 elf_path])
+  functions = collections.OrderedDict()
+  fn = None
+  depth = 0
+
+  for line in out.decode('utf-8', 'replace').splitlines():
+    m = FUNC_RE.match(line.strip())
+    # LLVM shows ARM mapping symbols ($t, $d) as labels; they aren't functions
+    if m and not m.group(2).startswith('$'):
+      fn = Function(m.group(2), int(m.group(1), 16))
+      functions[fn.name] = fn
+      depth = 0
+    if m:
+      continue
+
+    m = INSN_RE.match(line)
+    if not m or not fn:
+      continue
+    op, args = m.group(2), m.group(3)
+    base = op.split('.')[0]
+    target = TARGET_RE.search(args)
+    args = re.split(r'\s[;@]', args)[0].strip()
+
+    if base == '':
+      # .word, .short: literal pool data
+      if op == '.word':
+        fn.words.add(int(args.split()[0], 16))
+    elif base in ('push', 'vpush') or (base in ('stmdb', 'stmfd') and
+                                       args.startswith('sp!')):
+      depth += CountRegs(args)
+    elif base in ('pop', 'vpop') or (base in ('ldmia', 'ldmfd', 'ldm') and
+                                     args.startswith('sp!')):
+      # Popping pc ends this path; whatever follows is still in the frame
+      if 'pc' not in args:
+        depth -= CountRegs(args)
+    elif base in ('sub', 'subw') and args.startswith('sp'):
+      if Imm(args) is None:
+        fn.dynamic = True
+      else:
+        depth += Imm(args)
+    elif base in ('add', 'addw') and args.startswith('sp'):
+      depth -= Imm(args) or 0
+    elif base == 'mov' and args.startswith('sp,'):
+      fn.dynamic = True
+    elif base in ('bl', 'blx') and target:
+      fn.calls.add(target.group(1))
+    elif BRANCH_RE.match(base) and target:
+      fn.branches.add(target.group(1))
+    elif base in ('blx', 'bx') and args != 'lr':
+      fn.indirect = True
+    elif base in ('ldr', 'mov') and args.startswith('pc'):
+      fn.indirect = True
+
+    fn.frame = max(fn.frame, depth)
+
+  # Branches elsewhere in the same function are just control flow
+  for fn in functions.values():
+    fn.calls |= fn.branches - set([fn.name])
+    fn.calls &= set(functions)
+
+  return functions
+
+
+class Analyzer(object):
+
+  def __init__(self, elf, functions):
+    self.elf = elf
+    self.functions = functions
+    self.by_addr = dict((f.addr, f) for f in functions.values())
+    self.memo = {}
+    self.cycles = set()
+
+    tables = self._DispatchTables()
+    for fn in functions.values():
+      fn.targets = set()
+      if not fn.indirect:
+        continue
+      for f in [fn] + [functions[c] for c in fn.calls]:
+        for holders, targets in tables:
+          if any(lo <= w < hi for w in f.words for lo, hi in holders):
+            fn.targets |= targets
+
+  def _DispatchTables(self):
+    """Return ([(lo, hi) referring to the table], entries) per table."""
+    objects = [(sym.value, sym.value + sym.size)
+               for sym in self.elf.symbols.values() if sym.size and
+               sym.type != STT_FUNC]
+    tables = []
+    for name, start in self.elf.symbols.items():
+      end = self.elf.symbols.get(name + '_end')
+      if not name.startswith('__') or not end:
+        continue
+
+      targets = set()
+      for addr in range(start.value, end.value, 4):
+        word = self.elf.read_word(addr) or 0
+        fn = self.by_addr.get(word & ~1)
+        if fn and word & 1:
+          targets.add(fn.name)
+      if not targets:
+        continue
+
+      # The table itself, and anything which points at it
+      holders = [(start.value, end.value + 1)]
+      for lo, hi in objects:
+        if any(self.elf.read_word(a) == start.value
+               for a in range(lo, hi, 4)):
+          holders.append((lo, hi))
+      tables.append((holders, targets))
+    return tables
+
+  def Worst(self, name, path=()):
+    """Return (bytes, exact, call chain) for the deepest path from name."""
+    if name in self.memo:
+      return self.memo[name]
+    if name in path:
+      self.cycles.add(' -> '.join(path[path.index(name):] + (name,)))
+      return 0, True, []
+
+    fn = self.functions[name]
+    path += (name,)
+    exact = not fn.dynamic and (not fn.indirect or bool(fn.targets))
+
+    deepest, chain = 0, []
+    for callee in sorted(fn.calls | fn.targets):
+      depth, callee_exact, callee_chain = self.Worst(callee, path)
+      exact = exact and callee_exact
+      if depth > deepest:
+        deepest, chain = depth, callee_chain
+
+    self.memo[name] = (fn.frame + deepest, exact, [name] + chain)
+    return self.memo[name]
+
+  def Tasks(self):
+    """Yield (name, routine, stack size) for each task in the image."""
+    init = self.elf.symbols['tasks_init']
+    names = self.elf.symbols.get('task_names')
+    for i in range(init.size // TASKS_INIT_ENTRY.size):
+      _, pc, size = TASKS_INIT_ENTRY.unpack(
+          self.elf.read(init.value + i * TASKS_INIT_ENTRY.size,
+                        TASKS_INIT_ENTRY.size))
+      fn = self.by_addr.get(pc & ~1)
+      task = str(i)
+      if names:
+        task = self.elf.read_string(self.elf.read_word(names.value + i * 4))
+      yield task, fn.name if fn else hex(pc), size
+
+  def Interrupts(self):
+    """Yield (priority, handler) for each interrupt declared."""
+    for name, sym in self.elf.symbols.items():
+      m = re.match(r'prio_(\w+)$', name)
+      if m and ('irq_%s_handler' % m.group(1)) in self.functions:
+        prio = bytearray(self.elf.read(sym.value, 2))[1]
+        yield prio, 'irq_%s_handler' % m.group(1)
+
+
+def Bound(depth, exact):
+  return ('%d' if exact else '>=%d') % depth
+
+
+def Report(analyzer, args):
+  exc_frame = EXC_FRAME_FPU if args.fpu else EXC_FRAME
+  switch_save = SWITCH_SAVE_FPU if args.fpu else SWITCH_SAVE
+  ok = True
+
+  print('%-12s %-28s %6s %8s %7s  %s' %
+        ('Task', 'Routine', 'Size', 'Worst', 'Spare', 'Verdict'))
+  for task, routine, size in analyzer.Tasks():
+    if routine not in analyzer.functions:
+      print('%-12s %-28s %6d  unknown routine' % (task, routine, size))
+      continue
+    depth, exact, chain = analyzer.Worst(routine)
+    depth += exc_frame + switch_save
+    spare = size - depth
+    if spare < 0:
+      verdict = 'UNDER'
+      ok = False
+    elif spare > args.margin * 2:
+      verdict = 'OVER, try %d' % ((depth + args.margin + 7) & ~7)
+    else:
+      verdict = 'ok'
+    print('%-12s %-28s %6d %8s %7d  %s' %
+          (task, routine, size, Bound(depth, exact), spare, verdict))
+    if args.verbose:
+      print('    ' + ' -> '.join(chain))
+
+  # The system stack takes the deepest handler at each priority level,
+  # plus a frame for each nested interrupt
+  levels = collections.defaultdict(lambda: (0, True, None))
+  for prio, handler in analyzer.Interrupts():
+    depth, exact, _ = analyzer.Worst(handler)
+    if depth > levels[prio][0]:
+      levels[prio] = (depth, exact, handler)
+  for handler in ('svc_handler', 'pendsv_handler'):
+    if handler in analyzer.functions:
+      depth, exact, _ = analyzer.Worst(handler)
+      if depth > levels['switch'][0]:
+        levels['switch'] = (depth, exact, handler)
+
+  depth = sum(l[0] for l in levels.values())
+  depth += exc_frame * max(0, len(levels) - 1)
+  exact = all(l[1] for l in levels.values())
+  start = analyzer.elf.symbols.get('stack_start')
+  end = analyzer.elf.symbols.get('stack_end')
+  size = end.value - start.value if start and end else 0
+  print('%-12s %-28s %6d %8s %7d  %s' %
+        ('(system)', '%d priority levels' % len(levels), size,
+         Bound(depth, exact), size - depth,
+         'UNDER' if depth > size else 'ok'))
+  if depth > size:
+    ok = False
+  if args.verbose:
+    for prio in sorted(levels, key=str):
+      print('    %-8s %5d  %s' % (prio, levels[prio][0], levels[prio][2]))
+
+  for cycle in sorted(analyzer.cycles):
+    print('recursion: %s' % cycle)
+
+  if args.verbose:
+    unknown = [f.name for f in analyzer.functions.values()
+               if f.indirect and not f.targets]
+    if unknown:
+      print('indirect calls not followed: %s' % ' '.join(sorted(unknown)))
+
+  return ok
+
+
+def RamMap(elf, top):
+  """Print what's using RAM: writable sections, then the largest objects."""
+  ram = [s for s in elf.sections
+         if s.flags & SHF_ALLOC and s.flags & SHF_WRITE and s.size]
+  print('\n%-24s %10s %8s' % ('RAM section', 'Address', 'Size'))
+  for s in sorted(ram, key=lambda s: s.addr):
+    print('%-24s 0x%08x %8d' % (s.name, s.addr, s.size))
+  print('%-24s %10s %8d' % ('total', '', sum(s.size for s in ram)))
+
+  shared = elf.symbols.get('__shared_mem_buf')
+  if shared:
+    print('%-24s 0x%08x %8s' % ('shared memory from', shared.value, '-'))
+
+  indices = set(elf.sections.index(s) for s in ram)
+  objects = sorted((sym for sym in elf.symbols.values()
+                    if sym.shndx in indices and sym.size),
+                   key=lambda sym: -sym.size)
+  print('\n%-40s %8s' % ('Largest RAM objects', 'Size'))
+  for sym in objects[:top]:
+    print('%-40s %8d' % (sym.name, sym.size))
+
+
+def main(argv):
+  parser = argparse.ArgumentParser(
+      description='Estimate worst-case task stack use of an EC image.')
+  parser.add_argument('--objdump', default='arm-none-eabi-objdump',
+                      help='objdump for the image (default %(default)s)')
+  parser.add_argument('--fpu', action='store_true',
+                      help='tasks may use the FPU (CONFIG_FPU)')
+  parser.add_argument('--margin', type=int, default=64,
+                      help='spare bytes to leave per stack '
+                      '(default %(default)s)')
+  parser.add_argument('--ram-map', action='store_true',
+                      help='also print a map of RAM use')
+  parser.add_argument('--top', type=int, default=20,
+                      help='largest RAM objects to list (default %(default)s)')
+  parser.add_argument('-v', '--verbose', action='store_true',
+                      help='show the deepest call chain for each task')
+  parser.add_argument('elf')
+  args = parser.parse_args(argv)
+
+  elf = Elf(args.elf)
+  if 'tasks_init' not in elf.symbols:
+    sys.stderr.write('%s has no tasks_init[]; not an EC image?\n' % args.elf)
+    return 1
+
+  analyzer = Analyzer(elf, Disassemble(args.objdump, args.elf))
+  ok = Report(analyzer, args)
+  if args.ram_map:
+    RamMap(elf, args.top)
+
+  return 0 if ok else 1
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv[1:]))
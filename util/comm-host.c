@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "comm-host.h"
 #include "ec_commands.h"
@@ -25,6 +26,13 @@ void *ec_outbuf;
 void *ec_inbuf;
 static int command_offset;
 
+/* Version of the memmap ID area, or -1 if not read yet */
+static int memmap_id_version = -1;
+
+/* How long ec_readmem_snapshot() waits for an update to finish */
+#define SNAPSHOT_RETRY_US 1000
+#define SNAPSHOT_TRIES 100
+
 int comm_init_dev(const char *device_name) __attribute__((weak));
 int comm_init_lpc(void) __attribute__((weak));
 int comm_init_i2c(void) __attribute__((weak));
@@ -62,6 +70,48 @@ static int fake_readmem(int offset, int bytes, void *dest)
 	return EC_MEMMAP_TEXT_MAX - 1;
 }
 
+int ec_readmem_snapshot(int region, int offset, int bytes, void *dest)
+{
+	uint8_t seq, seq_after, v;
+	int i, rv;
+
+	if (memmap_id_version < 0) {
+		rv = ec_readmem(EC_MEMMAP_ID_VERSION, sizeof(v), &v);
+		if (rv < 0)
+			return rv;
+		memmap_id_version = v;
+	}
+
+	/* Older ECs don't count updates, so a plain read is the best we have */
+	if (memmap_id_version < 2)
+		return ec_readmem(offset, bytes, dest);
+
+	for (i = 0; i < SNAPSHOT_TRIES; i++) {
+		rv = ec_readmem(EC_MEMMAP_SEQ + region, sizeof(seq), &seq);
+		if (rv < 0)
+			return rv;
+
+		if (!(seq & 1)) {
+			rv = ec_readmem(offset, bytes, dest);
+			if (rv < 0)
+				return rv;
+
+			if (ec_readmem(EC_MEMMAP_SEQ + region, sizeof(seq_after),
+				       &seq_after) < 0)
+				return -1;
+			if (seq_after == seq)
+				return rv;
+
+			/* Updated while we were reading; try again right away */
+			continue;
+		}
+
+		usleep(SNAPSHOT_RETRY_US);
+	}
+
+	return -EECRESULT - EC_RES_BUSY;
+}
+
 void set_command_offset(int offset)
 {
 	command_offset = offset;
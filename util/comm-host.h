@@ -74,4 +74,19 @@ extern int (*ec_command_proto)(int command, int version,
  */
 extern int (*ec_readmem)(int offset, int bytes, void *dest);
 
+/**
+ * Read part of a region of the EC information area consistently, so none of
+ * it comes from partway through the EC updating the region.
+ *
+ * Uses the region's update count at EC_MEMMAP_SEQ, and falls back to a plain
+ * ec_readmem() on ECs without one.  Returns the number of bytes read, or
+ * negative on error (including if the EC kept the region busy too long).
+ *
+ * @param region	Region to read (EC_MEMMAP_SEQ_*)
+ * @param offset	Offset of the data, as for ec_readmem()
+ * @param bytes		Number of bytes to read, as for ec_readmem()
+ * @param dest		Destination for the data
+ */
+int ec_readmem_snapshot(int region, int offset, int bytes, void *dest);
+
 #endif /* __UTIL_COMM_HOST_H */
@@ -117,6 +117,8 @@ const char help_str[] =
 	"      Configure or start/stop the hang detect timer\n"
 	"  hello\n"
 	"      Checks for basic communication with EC\n"
+	"  kblatency [reset]\n"
+	"      Prints keyboard input latency histograms\n"
 	"  kbpress\n"
 	"      Simulate key press\n"
 	"  i2cread\n"
@@ -153,8 +155,12 @@ const char help_str[] =
 	"      Rapidly write bytes to port 80\n"
 	"  port80read\n"
 	"      Print history of port 80 write\n"
+	"  port80timing [dedup <on|off>]\n"
+	"      Print how long the AP firmware spent at each port 80 code\n"
 	"  powerinfo\n"
 	"	Prints power-related information\n"
+	"  powertimeline [clear | budget <state> <us>]\n"
+	"      Prints the timeline of AP power state transitions\n"
 	"  protoinfo\n"
 	"       Prints EC host protocol information\n"
 	"  pstoreinfo\n"
@@ -163,6 +169,8 @@ const char help_str[] =
 	"      Reads from EC host persistent storage to a file\n"
 	"  pstorewrite <offset> <infile>\n"
 	"      Writes to EC host persistent storage from a file\n"
+	"  pwmfanpid <index> [<kp> <ki> <kd>]\n"
+	"      Prints fan controller state, or sets its gains\n"
 	"  pwmgetfanrpm [<index> | all]\n"
 	"      Prints current fan RPM\n"
 	"  pwmgetkblight\n"
@@ -295,18 +303,6 @@ static uint32_t read_mapped_mem32(uint8_t offset)
 	return val;
 }
 
-static int read_mapped_string(uint8_t offset, char *buffer, int max_size)
-{
-	int ret;
-
-	ret = ec_readmem(offset, max_size, buffer);
-	if (ret <= 0) {
-		fprintf(stderr, "failure in %s(): %d\n", __func__, ret);
-		exit(1);
-	}
-	return ret;
-}
-
 int cmd_hello(int argc, char *argv[])
 {
 	struct ec_params_hello p;
@@ -1822,6 +1818,61 @@ int cmd_pwm_set_fan_rpm(int argc, char *argv[])
 }
 
 
+int cmd_pwm_fan_pid(int argc, char *argv[])
+{
+	struct ec_params_pwm_fan_pid p;
+	struct ec_response_pwm_fan_pid r;
+	char *e;
+	int rv;
+
+	if (argc != 2 && argc != 5) {
+		fprintf(stderr, "Usage: %s <index> [<kp> <ki> <kd>]\n",
+			argv[0]);
+		return -1;
+	}
+
+	memset(&p, 0, sizeof(p));
+	p.fan_idx = strtol(argv[1], &e, 0);
+	if (e && *e) {
+		fprintf(stderr, "Bad fan index.\n");
+		return -1;
+	}
+
+	if (argc == 5) {
+		p.flags = EC_FAN_PID_SET_GAINS;
+		p.kp = strtol(argv[2], &e, 0);
+		if (e && *e) {
+			fprintf(stderr, "Bad kp.\n");
+			return -1;
+		}
+		p.ki = strtol(argv[3], &e, 0);
+		if (e && *e) {
+			fprintf(stderr, "Bad ki.\n");
+			return -1;
+		}
+		p.kd = strtol(argv[4], &e, 0);
+		if (e && *e) {
+			fprintf(stderr, "Bad kd.\n");
+			return -1;
+		}
+	}
+
+	rv = ec_command(EC_CMD_PWM_FAN_PID, 0, &p, sizeof(p), &r, sizeof(r));
+	if (rv < 0)
+		return rv;
+
+	printf("Target RPM:   %d\n", r.target_rpm);
+	printf("Setpoint RPM: %d\n", r.setpoint_rpm);
+	printf("Filtered RPM: %d\n", r.filtered_rpm);
+	printf("Duty:         %d.%d%%\n", r.duty / 10, r.duty % 10);
+	printf("Terms:        ff %d p %d i %d d %d\n", r.ff, r.p, r.i, r.d);
+	printf("Gains:        kp %d ki %d kd %d\n", r.kp, r.ki, r.kd);
+	printf("Stalls:       %d\n", r.stalls);
+
+	return 0;
+}
+
+
 int cmd_pwm_get_keyboard_backlight(int argc, char *argv[])
 {
 	struct ec_response_pwm_get_keyboard_backlight r;
@@ -4052,6 +4103,45 @@ int cmd_kbpress(int argc, char *argv[])
 	return 0;
 }
 
+int cmd_kblatency(int argc, char *argv[])
+{
+	static const char * const stage_names[EC_KB_LATENCY_STAGE_COUNT] = {
+		"debounce", "queue", "host", "total"
+	};
+	struct ec_params_keyboard_latency p;
+	struct ec_response_keyboard_latency r;
+	int rv, s, b;
+
+	p.flags = 0;
+	if (argc > 1) {
+		if (strcasecmp(argv[1], "reset")) {
+			fprintf(stderr, "Usage: %s [reset]\n", argv[0]);
+			return -1;
+		}
+		p.flags |= EC_KB_LATENCY_FLAG_RESET;
+	}
+
+	rv = ec_command(EC_CMD_KEYBOARD_LATENCY, 0, &p, sizeof(p),
+			&r, sizeof(r));
+	if (rv < 0)
+		return rv;
+
+	printf("Events: %u, dropped: %u\n", r.events, r.dropped);
+	printf("%-10s %9s  histogram (us upper bound)\n", "stage", "max_us");
+	printf("%-10s %9s ", "", "");
+	for (b = 0; b < EC_KB_LATENCY_BUCKETS; b++)
+		printf(" %7u", 1 << (b + EC_KB_LATENCY_BUCKET_SHIFT + 1));
+	printf("\n");
+	for (s = 0; s < EC_KB_LATENCY_STAGE_COUNT; s++) {
+		printf("%-10s %9u ", stage_names[s], r.max_us[s]);
+		for (b = 0; b < EC_KB_LATENCY_BUCKETS; b++)
+			printf(" %7u", r.histogram[s][b]);
+		printf("\n");
+	}
+
+	return 0;
+}
+
 
 static void print_panic_reg(int regnum, const uint32_t *regs, int index)
 {
@@ -5173,9 +5263,29 @@ int cmd_gpio_set(int argc, char *argv[])
 }
 
 
+/* Battery info from EC_MEMMAP_BATT_VOLT to the end of its strings */
+#define BATT_MEMMAP_SIZE \
+	(EC_MEMMAP_BATT_TYPE + EC_MEMMAP_TEXT_MAX - EC_MEMMAP_BATT_VOLT)
+
+static uint32_t batt_mem32(const uint8_t *batt, int offset)
+{
+	uint32_t val;
+
+	memcpy(&val, batt + offset - EC_MEMMAP_BATT_VOLT, sizeof(val));
+	return val;
+}
+
+static char *batt_mem_string(const uint8_t *batt, int offset, char *text)
+{
+	memcpy(text, batt + offset - EC_MEMMAP_BATT_VOLT, EC_MEMMAP_TEXT_MAX);
+	text[EC_MEMMAP_TEXT_MAX] = '\0';
+	return text;
+}
+
 int cmd_battery(int argc, char *argv[])
 {
-	char batt_text[EC_MEMMAP_TEXT_MAX];
+	uint8_t batt[BATT_MEMMAP_SIZE];
+	char batt_text[EC_MEMMAP_TEXT_MAX + 1];
 	int rv, val;
 
 	val = read_mapped_mem8(EC_MEMMAP_BATTERY_VERSION);
@@ -5184,66 +5294,70 @@ int cmd_battery(int argc, char *argv[])
 		return -1;
 	}
 
+	/* Read it all at once, so the values go together */
+	rv = ec_readmem_snapshot(EC_MEMMAP_SEQ_BATTERY, EC_MEMMAP_BATT_VOLT,
+				 sizeof(batt), batt);
+	if (rv < (int)sizeof(batt)) {
+		fprintf(stderr, "Failed to read battery info: %d\n", rv);
+		return -1;
+	}
+
 	printf("Battery info:\n");
 
-	rv = read_mapped_string(EC_MEMMAP_BATT_MFGR, batt_text,
-			sizeof(batt_text));
-	if (rv < 0 || !is_string_printable(batt_text))
+	batt_mem_string(batt, EC_MEMMAP_BATT_MFGR, batt_text);
+	if (!is_string_printable(batt_text))
 		goto cmd_error;
 	printf("  OEM name:               %s\n", batt_text);
 
-	rv = read_mapped_string(EC_MEMMAP_BATT_MODEL, batt_text,
-			sizeof(batt_text));
-	if (rv < 0 || !is_string_printable(batt_text))
+	batt_mem_string(batt, EC_MEMMAP_BATT_MODEL, batt_text);
+	if (!is_string_printable(batt_text))
 		goto cmd_error;
 	printf("  Model number:           %s\n", batt_text);
 
-	rv = read_mapped_string(EC_MEMMAP_BATT_TYPE, batt_text,
-			sizeof(batt_text));
-	if (rv < 0 || !is_string_printable(batt_text))
+	batt_mem_string(batt, EC_MEMMAP_BATT_TYPE, batt_text);
+	if (!is_string_printable(batt_text))
 		goto cmd_error;
 	printf("  Chemistry   :           %s\n", batt_text);
 
-	rv = read_mapped_string(EC_MEMMAP_BATT_SERIAL, batt_text,
-			sizeof(batt_text));
+	batt_mem_string(batt, EC_MEMMAP_BATT_SERIAL, batt_text);
 	printf("  Serial number:          %s\n", batt_text);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_DCAP);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_DCAP);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Design capacity:        %u mAh\n", val);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_LFCC);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_LFCC);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Last full charge:       %u mAh\n", val);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_DVLT);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_DVLT);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Design output voltage   %u mV\n", val);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_CCNT);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_CCNT);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Cycle count             %u\n", val);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_VOLT);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_VOLT);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Present voltage         %u mV\n", val);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_RATE);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_RATE);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Present current         %u mA\n", val);
 
-	val = read_mapped_mem32(EC_MEMMAP_BATT_CAP);
+	val = batt_mem32(batt, EC_MEMMAP_BATT_CAP);
 	if (!is_battery_range(val))
 		goto cmd_error;
 	printf("  Remaining capacity      %u mAh\n", val);
 
-	val = read_mapped_mem8(EC_MEMMAP_BATT_FLAG);
+	val = batt[EC_MEMMAP_BATT_FLAG - EC_MEMMAP_BATT_VOLT];
 	printf("  Flags                   0x%02x", val);
 	if (val & EC_BATT_FLAG_AC_PRESENT)
 		printf(" AC_PRESENT");
@@ -6133,6 +6247,201 @@ int cmd_port80_read(int argc, char *argv[])
 	return 0;
 }
 
+int cmd_port80_timing(int argc, char *argv[])
+{
+	struct ec_params_port80_read p;
+	struct ec_response_port80_read rsp;
+	struct ec_port80_timestamp *history, *e;
+	uint32_t writes, history_size, start;
+	int i, head, tail, rv;
+
+	memset(&p, 0, sizeof(p));
+	p.subcmd = EC_PORT80_GET_INFO;
+	rv = ec_command(EC_CMD_PORT80_READ, 1, &p, sizeof(p),
+			&rsp, sizeof(rsp));
+	if (rv < 0)
+		return rv;
+	if (rv < sizeof(rsp.get_info) ||
+	    !(rsp.get_info.flags & EC_PORT80_FLAG_TIMESTAMPS)) {
+		fprintf(stderr, "EC doesn't record port 80 timestamps.\n");
+		return -1;
+	}
+	writes = rsp.get_info.writes;
+	history_size = rsp.get_info.history_size;
+
+	if (argc == 3 && !strcasecmp(argv[1], "dedup")) {
+		p.subcmd = EC_PORT80_SET_DEDUP;
+		p.set_dedup.enable = !strcasecmp(argv[2], "on");
+		rv = ec_command(EC_CMD_PORT80_READ, 1, &p, sizeof(p), NULL, 0);
+		if (rv < 0)
+			return rv;
+		printf("Deduplication %s.\n",
+		       p.set_dedup.enable ? "on" : "off");
+		return 0;
+	} else if (argc != 1) {
+		fprintf(stderr, "Usage: %s [dedup <on|off>]\n", argv[0]);
+		return -1;
+	}
+
+	history = malloc(history_size * sizeof(*history));
+	if (!history) {
+		fprintf(stderr, "Unable to allocate buffer.\n");
+		return -1;
+	}
+
+	p.subcmd = EC_PORT80_READ_TIMESTAMPS;
+	for (i = 0; i < history_size; i += EC_PORT80_TIMESTAMP_SIZE_MAX) {
+		p.read_buffer.offset = i;
+		p.read_buffer.num_entries = MIN(EC_PORT80_TIMESTAMP_SIZE_MAX,
+						history_size - i);
+		rv = ec_command(EC_CMD_PORT80_READ, 1, &p, sizeof(p),
+				&rsp, sizeof(rsp));
+		if (rv < 0) {
+			fprintf(stderr, "Read error at offset %d\n", i);
+			free(history);
+			return rv;
+		}
+		memcpy(history + i, rsp.timestamps.entries,
+		       p.read_buffer.num_entries * sizeof(*history));
+	}
+
+	head = writes;
+	if (head > history_size)
+		tail = head - history_size;
+	else
+		tail = 0;
+
+	/*
+	 * Times are relative to the reset or resume which started each boot.
+	 * The last code is still current, so we can't say how long it took.
+	 */
+	start = history[tail % history_size].time;
+	printf("%-8s %12s %12s %8s\n", "code", "at us", "took us", "repeats");
+	for (i = tail; i < head; i++) {
+		e = history + i % history_size;
+
+		if (e->code == PORT_80_EVENT_RESUME ||
+		    e->code == PORT_80_EVENT_RESET) {
+			printf(e->code == PORT_80_EVENT_RESUME ?
+			       "(S3->S0)\n" : "(RESET)\n");
+			start = e->time;
+			continue;
+		}
+
+		printf("  %02x     %12u ", e->code, e->time - start);
+		if (i + 1 < head)
+			printf("%12u", history[(i + 1) % history_size].time -
+			       e->time);
+		else
+			printf("%12s", "-");
+		printf(" %8d\n", e->repeats);
+	}
+
+	free(history);
+	return 0;
+}
+
+static const char * const power_state_names[] = {
+	"G3", "S5", "S3", "S0",
+	"G3->S5", "S5->S3", "S3->S0", "S0->S3", "S3->S5", "S5->G3",
+};
+
+int cmd_power_timeline(int argc, char *argv[])
+{
+	struct ec_params_power_timeline p;
+	struct ec_response_power_timeline r;
+	struct ec_power_timeline_entry *e;
+	uint32_t records, history_size, offset;
+	char *end;
+	int i, rv;
+
+	memset(&p, 0, sizeof(p));
+
+	if (argc > 1 && !strcasecmp(argv[1], "clear")) {
+		p.subcmd = EC_POWER_TIMELINE_CLEAR;
+		rv = ec_command(EC_CMD_POWER_TIMELINE, 0, &p, sizeof(p),
+				NULL, 0);
+		return rv < 0 ? rv : 0;
+	}
+
+	if (argc > 1 && !strcasecmp(argv[1], "budget")) {
+		if (argc < 4) {
+			fprintf(stderr, "Usage: %s budget <state> <us>\n",
+				argv[0]);
+			return -1;
+		}
+		for (i = 0; i < ARRAY_SIZE(power_state_names); i++)
+			if (!strcasecmp(argv[2], power_state_names[i]))
+				break;
+		if (i == ARRAY_SIZE(power_state_names)) {
+			fprintf(stderr, "Bad state.\n");
+			return -1;
+		}
+		p.subcmd = EC_POWER_TIMELINE_SET_BUDGET;
+		p.set_budget.state = i;
+		p.set_budget.budget_us = strtol(argv[3], &end, 0);
+		if (*end) {
+			fprintf(stderr, "Bad budget.\n");
+			return -1;
+		}
+		rv = ec_command(EC_CMD_POWER_TIMELINE, 0, &p, sizeof(p),
+				NULL, 0);
+		return rv < 0 ? rv : 0;
+	}
+
+	p.subcmd = EC_POWER_TIMELINE_GET_INFO;
+	rv = ec_command(EC_CMD_POWER_TIMELINE, 0, &p, sizeof(p),
+			&r, sizeof(r));
+	if (rv < 0)
+		return rv;
+	records = r.get_info.records;
+	history_size = r.get_info.history_size;
+	printf("%d records, %d over budget\n", records,
+	       r.get_info.over_budget);
+
+	p.subcmd = EC_POWER_TIMELINE_READ;
+	offset = records > history_size ? records - history_size : 0;
+	while (offset < records) {
+		p.read.offset = offset;
+		p.read.num_entries = EC_POWER_TIMELINE_SIZE_MAX;
+		rv = ec_command(EC_CMD_POWER_TIMELINE, 0, &p, sizeof(p),
+				&r, sizeof(r));
+		if (rv < 0) {
+			/* Overwritten since we started; skip ahead */
+			if (rv == -EECRESULT - EC_RES_INVALID_PARAM) {
+				offset++;
+				continue;
+			}
+			return rv;
+		}
+		if (!r.read.num_entries)
+			break;
+
+		for (i = 0; i < r.read.num_entries; i++) {
+			e = r.read.entries + i;
+			if (e->type == EC_POWER_TIMELINE_STATE)
+				printf("%10u %10u  %-6s in 0x%04x",
+				       e->time, e->duration,
+				       e->state < ARRAY_SIZE(power_state_names) ?
+				       power_state_names[e->state] : "?",
+				       e->signals);
+			else
+				printf("%10u %10u    wait 0x%04x",
+				       e->time, e->duration, e->signals);
+			printf("%s%s%s\n",
+			       e->flags & EC_POWER_TIMELINE_FLAG_ACTIVE ?
+			       " now" : "",
+			       e->flags & EC_POWER_TIMELINE_FLAG_TIMEOUT ?
+			       " TIMEOUT" : "",
+			       e->flags & EC_POWER_TIMELINE_FLAG_OVER_BUDGET ?
+			       " OVER" : "");
+		}
+		offset += r.read.num_entries;
+	}
+
+	return 0;
+}
+
 struct command {
 	const char *name;
 	int (*handler)(int argc, char *argv[]);
@@ -6352,6 +6661,7 @@ const struct command commands[] = {
 	{"gpioset", cmd_gpio_set},
 	{"hangdetect", cmd_hang_detect},
 	{"hello", cmd_hello},
+	{"kblatency", cmd_kblatency},
 	{"kbpress", cmd_kbpress},
 	{"i2cread", cmd_i2c_read},
 	{"i2cwrite", cmd_i2c_write},
@@ -6369,13 +6679,16 @@ const struct command commands[] = {
 	{"pdgetmode", cmd_pd_get_amode},
 	{"pdsetmode", cmd_pd_set_amode},
 	{"port80read", cmd_port80_read},
+	{"port80timing", cmd_port80_timing},
 	{"pdlog", cmd_pd_log},
 	{"pdwritelog", cmd_pd_write_log},
 	{"powerinfo", cmd_power_info},
+	{"powertimeline", cmd_power_timeline},
 	{"protoinfo", cmd_proto_info},
 	{"pstoreinfo", cmd_pstore_info},
 	{"pstoreread", cmd_pstore_read},
 	{"pstorewrite", cmd_pstore_write},
+	{"pwmfanpid", cmd_pwm_fan_pid},
 	{"pwmgetfanrpm", cmd_pwm_get_fan_rpm},
 	{"pwmgetkblight", cmd_pwm_get_keyboard_backlight},
 	{"pwmgetnumfans", cmd_pwm_get_num_fans},